@@ -3,6 +3,8 @@
 #include <cstring>
 #include <glm/gtx/string_cast.hpp>
 
+#include <sys/resource.h>
+
 #include <rlpbr/preprocess.hpp>
 
 using namespace std;
@@ -10,8 +12,8 @@ using namespace std;
 int main(int argc, const char *argv[]) {
     if (argc < 3) {
         cerr << argv[0] << " SRC DST [X_AXIS Y_AXIS Z_AXIS] [DATA_DIR]"
-             << " [--process-textures] [--build-sdfs]"
-             << endl;
+             << " [--process-textures] [--build-sdfs] [--max-memory]"
+             << " [--chunk-size=SIZE]" << endl;
         exit(EXIT_FAILURE);
     }
 
@@ -62,6 +64,8 @@ int main(int argc, const char *argv[]) {
 
     bool process_textures = false;
     bool build_sdfs = false;
+    bool report_memory = false;
+    float chunk_size = 0.f;
 
     auto setDumpArgs = [&](const char *argument) {
         if (!strcmp(argument, "--process-textures")) {
@@ -70,21 +74,39 @@ int main(int argc, const char *argv[]) {
         if (!strcmp(argument, "--build-sdfs")) {
             build_sdfs = true;
         }
+        if (!strcmp(argument, "--max-memory")) {
+            report_memory = true;
+        }
+        if (!strncmp(argument, "--chunk-size=", 13)) {
+            chunk_size = atof(argument + 13);
+        }
     };
 
-    if (argc > 7) {
-        setDumpArgs(argv[7]);
-    }
-    if (argc > 8) {
-        setDumpArgs(argv[8]);
+    for (int i = 7; i < argc; i++) {
+        setDumpArgs(argv[i]);
     }
 
+    // ru_maxrss is reported in kilobytes on Linux
+    auto printPeakMemory = [&](const char *stage) {
+        if (!report_memory) {
+            return;
+        }
+
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        cout << "Peak memory after " << stage << ": "
+             << usage.ru_maxrss / 1024 << " MiB" << endl;
+    };
+
     cout << "Transform:\n" << glm::to_string(base_txfm) << endl;
 
     RLpbr::ScenePreprocessor dumper(argv[1], base_txfm, data_dir,
-                                    process_textures, build_sdfs);
+                                    process_textures, build_sdfs,
+                                    chunk_size);
+    printPeakMemory("loading");
 
     dumper.dump(argv[2]);
+    printPeakMemory("dump");
 
     return 0;
 }
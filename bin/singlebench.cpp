@@ -101,4 +101,15 @@ int main(int argc, char *argv[]) {
     auto diff = chrono::duration_cast<chrono::milliseconds>(end - start);
     cout << "Batch size " << batch_size << ", Resolution " << res << ", FPS: " << ((double)num_iters * (double)batch_size /
             (double)diff.count()) * 1000.0 << endl;
+    BatchStatistics stats = renderer.getBatchStatistics(batch);
+    cout << "Uploaded " << stats.uploadBytes
+         << " bytes of environment data in the last frame, "
+         << stats.numSharedEnvironments << " / " << batch_size
+         << " environments shared their scene's default TLAS" << endl;
+    cout << "Environment pool hits " << stats.envPoolHits << " / "
+         << stats.envPoolHits + stats.envPoolMisses << ", TLAS pool hits "
+         << stats.tlasPoolHits << " / "
+         << stats.tlasPoolHits + stats.tlasPoolMisses << endl;
+    cout << "CPU stalled " << stats.cpuStallMS
+         << " ms waiting on the GPU in the last frame" << endl;
 }
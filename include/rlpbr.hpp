@@ -15,7 +15,14 @@ class AssetLoader {
 public:
     AssetLoader(LoaderImpl &&backend);
 
-    std::shared_ptr<Scene> loadScene(std::string_view scene_path);
+    // Object libraries are preprocessed like scenes but only their objects
+    // are used. Scenes loaded with a library can instance its objects
+    // (ObjectInstance::libraryFlag), and the library's geometry, BLASes
+    // and textures stay resident once however many scenes share it.
+    std::shared_ptr<Scene> loadObjectLibrary(std::string_view library_path);
+
+    std::shared_ptr<Scene> loadScene(std::string_view scene_path,
+        const std::shared_ptr<Scene> &object_library = nullptr);
 
     std::shared_ptr<EnvironmentMapGroup> loadEnvironmentMaps(
             const char **paths, uint32_t num_maps);
@@ -59,16 +66,47 @@ public:
 
     void render(RenderBatch &batch);
 
+    // Renders only the listed environments. The others cost no uploads,
+    // acceleration structure builds or GPU threads. Their output regions
+    // are left untouched, or zeroed if clear_inactive is set.
+    void render(RenderBatch &batch, const uint32_t *env_idxs,
+                uint32_t num_envs, bool clear_inactive = false);
+
     void waitForBatch(RenderBatch &batch);
 
+    // Non-blocking: true once the batch's last render has finished on the
+    // GPU, so CPU work for the next batch can overlap with rendering
+    bool isBatchReady(RenderBatch &batch);
+
     half *getOutputPointer(RenderBatch &batch) const;
 
     AuxiliaryOutputs getAuxiliaryOutputs(RenderBatch &batch) const;
 
+    ChannelOutputs getChannelOutputs(RenderBatch &batch) const;
+
+    BatchStatistics getBatchStatistics(RenderBatch &batch) const;
+
+    // Settings env renders with, see Environment::setRenderSettings
+    EnvironmentRenderSettings getRenderSettings(const Environment &env) const;
+
+    // Every output channel packs the batch's images back to back in
+    // environment order then view order, each at its environment's
+    // resolution. Returns the index of the view's first pixel.
+    uint64_t getOutputOffset(RenderBatch &batch, uint32_t env_idx,
+                             uint32_t view_idx = 0) const;
+
+    // Resets every environment in the batch in parallel on the renderer's
+    // worker threads. Randomization results don't depend on thread count.
+    void resetEnvironments(RenderBatch &batch);
+
 private:
     RendererImpl backend_;
     float aspect_ratio_;
     uint32_t batch_size_;
+    EnvironmentRenderSettings default_settings_;
+    uint32_t next_rng_stream_;
+    uint64_t random_seed_;
+    bool randomize_materials_;
 };
 
 }
@@ -79,6 +79,30 @@ struct AuxiliaryOutputs {
     half *albedo;
 };
 
+// Buffers for the enabled OutputChannels beyond ColorHalf, nullptr when
+// disabled. depth is half or float depending on the requested format.
+struct ChannelOutputs {
+    uint8_t *rgb8;
+    void *depth;
+    uint32_t *instanceIDs;
+    uint32_t *semanticIDs;
+};
+
+struct BatchStatistics {
+    // Per environment data copied to the GPU by the last render call
+    uint64_t uploadBytes;
+    // Environments that used their scene's shared default TLAS
+    uint32_t numSharedEnvironments;
+    // Running totals for the renderer's environment and TLAS pools
+    uint64_t envPoolHits;
+    uint64_t envPoolMisses;
+    uint64_t tlasPoolHits;
+    uint64_t tlasPoolMisses;
+    // CPU time blocked on the GPU for the batch's last frame, in render()
+    // and waitForBatch()
+    float cpuStallMS;
+};
+
 class RendererImpl {
 public:
     typedef void(*DestroyType)(RenderBackend *);
@@ -91,15 +115,21 @@ public:
         RenderBackend::*MakeBatchType)();
     typedef void(RenderBackend::*RenderType)(RenderBatch &batch);
     typedef void(RenderBackend::*WaitType)(RenderBatch &batch);
+    typedef bool(RenderBackend::*IsReadyType)(RenderBatch &batch);
     typedef half *(RenderBackend::*GetOutputType)(RenderBatch &batch);
     typedef AuxiliaryOutputs(RenderBackend::*GetAuxType)(RenderBatch &batch);
+    typedef ChannelOutputs(RenderBackend::*GetChannelsType)(
+        RenderBatch &batch);
+    typedef BatchStatistics(RenderBackend::*GetStatsType)(RenderBatch &batch);
+    typedef void(RenderBackend::*ResetEnvsType)(RenderBatch &batch);
 
     RendererImpl(DestroyType destroy_ptr,
         MakeLoaderType make_loader_ptr, MakeEnvironmentType make_env_ptr,
         SetEnvMapsType set_env_maps_ptr_, MakeBatchType make_batch_ptr,
-        RenderType render_ptr, WaitType wait_ptr,
+        RenderType render_ptr, WaitType wait_ptr, IsReadyType is_ready_ptr,
         GetOutputType get_output_ptr, GetAuxType get_aux_ptr,
-        RenderBackend *state);
+        GetChannelsType get_channels_ptr, GetStatsType get_stats_ptr,
+        ResetEnvsType reset_envs_ptr, RenderBackend *state);
     RendererImpl(const RendererImpl &) = delete;
     RendererImpl(RendererImpl &&);
 
@@ -121,10 +151,18 @@ public:
 
     inline void waitForBatch(RenderBatch &batch);
 
+    inline bool isBatchReady(RenderBatch &batch);
+
     inline half *getOutputPointer(RenderBatch &batch) const;
 
     inline AuxiliaryOutputs getAuxiliaryOutputs(RenderBatch &batch) const;
 
+    inline ChannelOutputs getChannelOutputs(RenderBatch &batch) const;
+
+    inline BatchStatistics getBatchStatistics(RenderBatch &batch) const;
+
+    inline void resetEnvironments(RenderBatch &batch);
+
 private:
     DestroyType destroy_ptr_;
     MakeLoaderType make_loader_ptr_;
@@ -133,8 +171,12 @@ private:
     MakeBatchType make_batch_ptr_;
     RenderType render_ptr_;
     WaitType wait_ptr_;
+    IsReadyType is_ready_ptr_;
     GetOutputType get_output_ptr_;
     GetAuxType get_aux_ptr_;
+    GetChannelsType get_channels_ptr_;
+    GetStatsType get_stats_ptr_;
+    ResetEnvsType reset_envs_ptr_;
     RenderBackend *state_;
 };
 
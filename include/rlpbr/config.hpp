@@ -23,6 +23,43 @@ enum class RenderFlags : uint32_t {
     AdaptiveSample = 1 << 6,
     Denoise = 1 << 7,
     RandomizeMaterials = 1 << 8,
+    // Outputs land in host memory instead of CUDA imported memory (Vulkan
+    // only). Pointers are valid to read once waitForBatch returns or
+    // isBatchReady is true, and no CUDA device is required.
+    HostOutputs = 1 << 9,
+};
+
+// Per pixel outputs written by the renderer. Each enabled channel gets
+// its own tightly packed buffer.
+enum class OutputChannels : uint32_t {
+    // 4 x fp16: RGB + 16 bit instance index (getOutputPointer)
+    ColorHalf = 1 << 0,
+    // 4 x uint8 sRGB, alpha is 255
+    ColorRGB8 = 1 << 1,
+    // View space depth along the camera's forward axis, 0 on a miss
+    DepthHalf = 1 << 2,
+    DepthFloat = 1 << 3,
+    // uint32 instance slot of the primary hit (see
+    // Environment::getInstanceID), ~0u on a miss
+    InstanceID = 1 << 4,
+    // uint32 object index of the primary hit, matching the "objects" map
+    // in the scene's _ids.json, ~0u on a miss. Object library objects
+    // have ObjectInstance::libraryFlag set.
+    SemanticID = 1 << 5,
+};
+
+// CPU culling of each environment's instances before its TLAS is built
+// (Vulkan only). Culled instances are compacted out of the TLAS, which
+// maps hits back to instance slots, so the InstanceID output doesn't change.
+enum class InstanceCulling : uint32_t {
+    None,
+    // Removes instances whose bounds lie entirely beyond cullDistance of
+    // every view. Paths shorter than cullDistance see the full scene.
+    Strict,
+    // Strict, plus instances outside every pinhole view's frustum, e.g.
+    // behind the camera. Only primary visibility is preserved, culled
+    // instances no longer cast shadows or show up in reflections.
+    Primary,
 };
 
 struct RenderConfig {
@@ -38,6 +75,27 @@ struct RenderConfig {
     RenderFlags flags;
     float clampThreshold;
     BackendSelect backend;
+    // Extra threads used to prepare batch inputs. 0 packs on the calling
+    // thread.
+    uint32_t numWorkerThreads;
+    // Global seed for material and domain randomization
+    uint64_t randomSeed;
+    // Limit on batches submitted but not yet waited on, render() blocks on
+    // the oldest once reached. 0 = no limit.
+    uint32_t maxInFlightBatches;
+    // 0 = ColorHalf only
+    OutputChannels outputChannels;
+    // Upper bound on Environment::getNumViews, output buffers hold
+    // batchSize * maxViewsPerEnv images. 0 = 1.
+    uint32_t maxViewsPerEnv;
+    InstanceCulling culling;
+    // World space distance bound for culling, 0 = unbounded
+    float cullDistance;
+    // Device memory per scene for chunks streamed in around the cameras
+    // (see ScenePreprocessor chunk_size), in bytes. 0 = unlimited.
+    // Soft limit: a chunk's BLAS size is only known once it has been
+    // resident, so chunks streamed in for the first time can exceed it.
+    uint64_t streamingBudget;
 };
 
 inline RenderFlags & operator|=(RenderFlags &a, RenderFlags b)
@@ -58,4 +116,22 @@ inline RenderFlags operator|(RenderFlags a, RenderFlags b)
     return a;
 }
 
+inline OutputChannels & operator|=(OutputChannels &a, OutputChannels b)
+{
+    a = OutputChannels(static_cast<uint32_t>(a) | static_cast<uint32_t>(b));
+    return a;
+}
+
+inline bool operator&(OutputChannels a, OutputChannels b)
+{
+    return (static_cast<uint32_t>(a) & static_cast<uint32_t>(b)) > 0;
+}
+
+inline OutputChannels operator|(OutputChannels a, OutputChannels b)
+{
+    a |= b;
+
+    return a;
+}
+
 }
@@ -12,6 +12,11 @@ namespace RLpbr {
 struct EnvironmentInit;
 
 struct ObjectInstance {
+    // Object indices with this bit set refer to the scene's object library
+    // (AssetLoader::loadObjectLibrary), their material indices refer to
+    // the library's materials
+    static constexpr uint32_t libraryFlag = 1u << 31;
+
     uint32_t objectIndex;
     uint32_t materialOffset;
 };
@@ -21,8 +26,58 @@ struct InstanceTransform {
     glm::mat4x3 inv;
 };
 
+// Members are placed relative to the group's world transform, see
+// Environment::addInstanceGroup
+struct InstanceGroup {
+    // Relative to the parent group
+    InstanceTransform local;
+    InstanceTransform world;
+    uint32_t parent;
+    std::vector<uint32_t> memberIDs;
+    // Relative to the group
+    std::vector<InstanceTransform> memberTransforms;
+    bool dirty;
+    bool removed;
+};
+
+// Elements in [begin, end) have been modified since the last upload
+struct DirtyRange {
+    uint32_t begin;
+    uint32_t end;
+
+    inline void mark(uint32_t idx);
+    inline void mark(uint32_t range_begin, uint32_t range_end);
+    inline void clear();
+    inline bool empty() const;
+};
+
 enum class InstanceFlags : uint32_t {
     Transparent = 1 << 0,
+    // Tombstone for a deleted instance's slot, never intersected
+    Deleted = 1 << 1,
+};
+
+enum class CameraType : uint32_t {
+    Pinhole,
+    // Full sphere, longitude along the image x axis centered on view
+    Equirectangular,
+    // One 90 degree face of a cube around the camera, meant for square
+    // images. Render one view per face to build a cubemap.
+    CubemapFace,
+    // Equidistant fisheye inscribed in the image height, pixels outside
+    // the image circle are black
+    Fisheye,
+    Orthographic,
+};
+
+// Relative to the camera's right, up and view vectors
+enum class CubeFace : uint32_t {
+    Right,
+    Left,
+    Up,
+    Down,
+    Forward,
+    Back,
 };
 
 struct Camera {
@@ -50,6 +105,23 @@ struct Camera {
                            const glm::vec3 &up_vec,
                            const glm::vec3 &right_vec);
 
+    inline void setPinhole();
+    inline void setEquirectangular();
+    inline void setCubemapFace(CubeFace face);
+    // Full field of view in degrees, can exceed 180
+    inline void setFisheye(float fov);
+    // Half of the view volume's height in world units
+    inline void setOrthographic(float half_height);
+
+    // CPU reference for the primary rays the backends generate. raster is
+    // in pixels from the top left corner of a resolution sized image, the
+    // aspect ratio comes from resolution. Returns false for rays outside
+    // the fisheye image circle.
+    inline bool generateRay(const glm::vec2 &raster,
+                            const glm::uvec2 &resolution,
+                            glm::vec3 &ray_origin,
+                            glm::vec3 &ray_dir) const;
+
     glm::vec3 position;
     glm::vec3 view;
     glm::vec3 up;
@@ -57,13 +129,31 @@ struct Camera {
 
     float tanFOV;
     float aspectRatio;
+
+    CameraType type;
+    // Fisheye: half the field of view in radians
+    // Orthographic: half height
+    // CubemapFace: the CubeFace
+    float typeParam;
+};
+
+// Per environment overrides of the RenderConfig settings. 0 keeps the
+// RenderConfig value, which is also the upper bound for every field.
+struct EnvironmentRenderSettings {
+    uint32_t imgWidth;
+    uint32_t imgHeight;
+    uint32_t spp;
+    uint32_t maxDepth;
 };
 
 class Environment {
 public:
     Environment(EnvironmentImpl &&backend,
                 const std::shared_ptr<Scene> &scene,
-                const Camera &cam);
+                const Camera &cam,
+                uint32_t rng_stream,
+                uint64_t random_seed,
+                bool randomize_materials);
 
     Environment(const Environment &) = delete;
     Environment & operator=(const Environment &) = delete;
@@ -80,8 +170,75 @@ public:
                                 bool dynamic = true,
                                 bool kinematic = false);
 
+    uint32_t addInstance(uint32_t obj_idx,
+                         const uint32_t *material_idxs,
+                         uint32_t num_mat_indices,
+                         const glm::vec3 &position,
+                         const glm::quat &rotation,
+                         const glm::vec3 &scale,
+                         bool dynamic = true,
+                         bool kinematic = false);
+
     void deleteInstance(uint32_t inst_id);
 
+    // Bulk versions of addInstance / deleteInstance. material_idxs holds
+    // each instance's num_mat_indices entries back to back, scales may be
+    // nullptr. New instance IDs are written to inst_ids.
+    void addInstances(const uint32_t *obj_idxs,
+                      const uint32_t *material_idxs,
+                      const uint32_t *num_mat_indices,
+                      const glm::vec3 *positions,
+                      const glm::quat *rotations,
+                      const glm::vec3 *scales,
+                      uint32_t num_instances,
+                      uint32_t *inst_ids);
+
+    void deleteInstances(const uint32_t *inst_ids, uint32_t num_instances);
+
+    // Deleted instances leave tombstoned slots (InstanceFlags::Deleted) in
+    // place, so other instances never move and uploads stay incremental.
+    // Slots are reused by later adds. Compaction removes the tombstones,
+    // moving instance data, and runs automatically once more than half
+    // the slots are tombstones.
+    void compactInstances();
+
+    // Instance groups move their member instances together, e.g. the parts
+    // of a piece of furniture or of an articulated object. Groups nest
+    // under an optional parent group (~0u for none), which must already
+    // exist. Group IDs are not reused until reset() removes every group.
+    uint32_t addInstanceGroup(const glm::vec3 &position,
+                              const glm::quat &rotation,
+                              uint32_t parent_group = ~0u);
+
+    // Members and child groups keep their current world transforms
+    void removeInstanceGroup(uint32_t group_id);
+
+    // The instance keeps its current world transform and leaves any
+    // previous group. Deleting an instance removes it from its group.
+    void addToInstanceGroup(uint32_t group_id, uint32_t inst_id);
+    void removeFromInstanceGroup(uint32_t inst_id);
+
+    // Transforms are relative to the parent group. Member transforms of
+    // every updated group and its descendants are recomputed in one pass.
+    // The dirty transform range grows to span their slots, so transforms
+    // of unrelated instances in between are reuploaded as well.
+    inline void setInstanceGroupTransform(uint32_t group_id,
+                                          const glm::vec3 &position,
+                                          const glm::quat &rotation);
+
+    void setInstanceGroupTransforms(const uint32_t *group_ids,
+                                    const glm::vec3 *positions,
+                                    const glm::quat *rotations,
+                                    uint32_t num_groups);
+
+    // World space. Grouped instances stay in their group, at the new
+    // transform relative to the group's current world transform.
+    void setInstanceTransform(uint32_t inst_id, const glm::vec3 &position,
+                              const glm::quat &rotation,
+                              const glm::vec3 &scale = glm::vec3(1.f));
+
+    const InstanceTransform &getInstanceTransform(uint32_t inst_id) const;
+
     inline void moveInstance(uint32_t inst_id, const glm::vec3 &delta);
     inline void rotateInstance(uint32_t inst_id, const glm::quat &rot);
 
@@ -99,6 +256,23 @@ public:
 
     inline void setCameraView(const glm::mat4 &camera_to_world);
 
+    // Extra camera views, each rendered to its own image from the same
+    // instances and acceleration structure. View 0 is the camera set by
+    // setCameraView. Views persist across reset().
+    inline uint32_t addView(const Camera &cam);
+    inline void setView(uint32_t view_idx, const Camera &cam);
+    inline const Camera &getView(uint32_t view_idx) const;
+    inline uint32_t getNumViews() const;
+    // Removes every view but view 0
+    inline void clearExtraViews();
+
+    // Persists across reset()
+    inline void setRenderSettings(const EnvironmentRenderSettings &settings);
+
+    // Settings with 0 fields taken from defaults
+    inline EnvironmentRenderSettings getRenderSettings(
+        const EnvironmentRenderSettings &defaults) const;
+
     uint32_t addLight(const glm::vec3 &position, const glm::vec3 &color);
     void removeLight(uint32_t light_id);
 
@@ -107,50 +281,114 @@ public:
     inline EnvironmentBackend *getBackend();
     inline const Camera &getCamera() const;
 
-    inline const std::vector<ObjectInstance> &
-        getInstances() const;
+    // Environments share the scene's default instances, transforms and
+    // flags until they first modify them
+    const std::vector<ObjectInstance> &getInstances() const;
 
-    inline const std::vector<uint32_t> &
-        getInstanceMaterials() const;
+    const std::vector<uint32_t> &getInstanceMaterials() const;
 
-    inline std::vector<uint32_t> &
-        getInstanceMaterials();
+    // Makes the materials private and marks them all for upload
+    std::vector<uint32_t> &getInstanceMaterials();
 
-    inline const std::vector<InstanceTransform> &
-        getTransforms() const;
+    const std::vector<InstanceTransform> &getTransforms() const;
 
-    inline const std::vector<InstanceFlags> &
-        getInstanceFlags() const;
+    const std::vector<InstanceFlags> &getInstanceFlags() const;
 
     inline uint32_t getNumInstances() const;
 
+    // Maps an instance slot, as written to the InstanceID output channel,
+    // back to the ID returned by addInstance
+    inline uint32_t getInstanceID(uint32_t inst_idx) const;
+
+    inline bool hasDefaultInstances() const;
+
     inline bool isDirty() const;
     inline void setDirty() const;
     inline void clearDirty() const;
 
-    // Reset environment to default instances / materials
+    // Tracks which per environment data backends need to reupload.
+    // Independent from isDirty(), which covers acceleration structures.
+    inline const DirtyRange &getDirtyTransforms() const;
+    inline const DirtyRange &getDirtyMaterials() const;
+    inline bool areLightsDirty() const;
+    inline void setUploadDirty() const;
+    inline void clearUploadDirty() const;
+
+    // Reset environment to default instances / materials. Starts a new
+    // randomization episode.
     void reset();
 
+    // Randomization is keyed by (seed, stream, episode), the stream is
+    // assigned in environment creation order
+    inline uint32_t getRandomStream() const;
+    inline uint32_t getEpisode() const;
+
 private:
+    // Copy on write: each group of per environment state references the
+    // scene's EnvironmentInit until first modified, so creation and reset
+    // don't copy anything
+    void makeInstancesUnique();
+    void makeMaterialsUnique();
+    void makeIDsUnique();
+    void makeLightIDsUnique();
+
+    void updateInstanceGroups();
+
+    // No validation or copy on write, callers handle both
+    void writeInstanceTransform(uint32_t inst_id,
+                                const InstanceTransform &txfm);
+
+    // Default instance IDs are the identity mapping
+    inline uint32_t instanceIndex(uint32_t inst_id) const;
+    inline uint32_t numInstanceIDs() const;
+
+    // Aborts with caller in the message unless inst_id refers to a live
+    // instance
+    void checkInstanceID(uint32_t inst_id, const char *caller) const;
+
     EnvironmentImpl backend_;
     std::shared_ptr<Scene> scene_;
 
     Camera camera_;
+    std::vector<Camera> extra_views_;
+    EnvironmentRenderSettings render_settings_;
+    uint32_t rng_stream_;
+    uint32_t episode_;
+    // From the creating Renderer's RenderConfig
+    uint64_t random_seed_;
+    bool randomize_materials_;
 
     std::vector<ObjectInstance> instances_;
     std::vector<uint32_t> instance_materials_;
     std::vector<InstanceTransform> transforms_;
     std::vector<InstanceFlags> instance_flags_;
+    std::vector<uint32_t> free_slots_;
+    bool default_instances_;
+    bool default_materials_;
 
+    // ~0u for deleted IDs until they're reused
     std::vector<uint32_t> index_map_;
     std::vector<uint32_t> reverse_id_map_;
     std::vector<uint32_t> free_ids_;
+    bool default_ids_;
+
+    std::vector<InstanceGroup> instance_groups_;
+    // Indexed by instance ID, ~0u when ungrouped
+    std::vector<uint32_t> group_membership_;
+    // Indexed by instance ID, position in the group's memberIDs
+    std::vector<uint32_t> group_member_idxs_;
 
     std::vector<uint32_t> free_light_ids_;
     std::vector<uint32_t> light_ids_;
     std::vector<uint32_t> light_reverse_ids_;
+    bool default_light_ids_;
 
     mutable bool dirty_;
+    mutable DirtyRange dirty_transforms_;
+    mutable DirtyRange dirty_materials_;
+    mutable bool dirty_lights_;
+
+friend class RenderBatch;
 };
 
 inline InstanceFlags & operator|=(InstanceFlags &a, InstanceFlags b)
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <algorithm>
+
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/constants.hpp>
 
 namespace RLpbr {
 
@@ -44,6 +47,49 @@ static inline glm::vec3 extractRightVector(
     return glm::normalize(glm::vec3(camera_to_world[0]));
 }
 
+// Orientation of a camera looking through one face of the surrounding cube
+static inline void cubemapFaceBasis(const glm::vec3 &view,
+                                    const glm::vec3 &up,
+                                    const glm::vec3 &right,
+                                    CubeFace face,
+                                    glm::vec3 &face_view,
+                                    glm::vec3 &face_up,
+                                    glm::vec3 &face_right)
+{
+    switch (face) {
+        case CubeFace::Right: {
+            face_view = right;
+            face_up = up;
+            face_right = -view;
+        } break;
+        case CubeFace::Left: {
+            face_view = -right;
+            face_up = up;
+            face_right = view;
+        } break;
+        case CubeFace::Up: {
+            face_view = up;
+            face_up = -view;
+            face_right = right;
+        } break;
+        case CubeFace::Down: {
+            face_view = -up;
+            face_up = view;
+            face_right = right;
+        } break;
+        case CubeFace::Forward: {
+            face_view = view;
+            face_up = up;
+            face_right = right;
+        } break;
+        case CubeFace::Back: {
+            face_view = -view;
+            face_up = up;
+            face_right = -right;
+        } break;
+    }
+}
+
 }
 
 static inline float convertFOV(float fov)
@@ -59,7 +105,9 @@ Camera::Camera(const glm::vec3 &eye, const glm::vec3 &target,
       up(up_vec),
       right(CameraHelper::computeRightVector(view, up)),
       tanFOV(convertFOV(vertical_fov)),
-      aspectRatio(aspect_ratio)
+      aspectRatio(aspect_ratio),
+      type(CameraType::Pinhole),
+      typeParam(0.f)
 {}
 
 Camera::Camera(const glm::mat4 &camera_to_world,
@@ -69,7 +117,9 @@ Camera::Camera(const glm::mat4 &camera_to_world,
       up(CameraHelper::extractUpVector(camera_to_world)),
       right(CameraHelper::extractRightVector(camera_to_world)),
       tanFOV(convertFOV(vertical_fov)),
-      aspectRatio(aspect_ratio)
+      aspectRatio(aspect_ratio),
+      type(CameraType::Pinhole),
+      typeParam(0.f)
 {}
 
 Camera::Camera(const glm::vec3 &position_vec,
@@ -83,7 +133,9 @@ Camera::Camera(const glm::vec3 &position_vec,
       up(up_vec),
       right(right_vec),
       tanFOV(convertFOV(vertical_fov)),
-      aspectRatio(aspect_ratio)
+      aspectRatio(aspect_ratio),
+      type(CameraType::Pinhole),
+      typeParam(0.f)
 {}
 
 void Camera::updateView(const glm::vec3 &eye, const glm::vec3 &target,
@@ -116,59 +168,133 @@ void Camera::updateView(const glm::vec3 &position_vec,
     right = right_vec;
 }
 
-uint32_t Environment::addInstance(uint32_t obj_idx,
-                                  const uint32_t *material_idxs,
-                                  uint32_t num_mat_indices,
-                                  const glm::vec3 &position,
-                                  const glm::quat &rotation,
-                                  bool dynamic,
-                                  bool kinematic)
+void Camera::setPinhole()
 {
-    setDirty();
-    // FIXME
-    (void)dynamic;
-    (void)kinematic;
+    type = CameraType::Pinhole;
+    typeParam = 0.f;
+}
 
-    glm::mat4 rot_matrix = glm::mat4_cast(rotation);
+void Camera::setEquirectangular()
+{
+    type = CameraType::Equirectangular;
+    typeParam = 0.f;
+}
 
-    glm::mat4 model_matrix = glm::translate(position) * rot_matrix;
-    glm::mat4 inv_model = glm::transpose(rot_matrix) *
-        glm::translate(-position);
+void Camera::setCubemapFace(CubeFace face)
+{
+    type = CameraType::CubemapFace;
+    typeParam = float(face);
+}
 
-    instances_.push_back({
-        obj_idx,
-        uint32_t(instance_materials_.size()),
-    });
+void Camera::setFisheye(float fov)
+{
+    type = CameraType::Fisheye;
+    typeParam = glm::radians(fov) / 2.f;
+}
 
-    for (int i = 0; i < (int)num_mat_indices; i++) {
-        instance_materials_.push_back(material_idxs[i]);
-    }
+void Camera::setOrthographic(float half_height)
+{
+    type = CameraType::Orthographic;
+    typeParam = half_height;
+}
 
-    transforms_.push_back({model_matrix, inv_model});
-    instance_flags_.push_back(InstanceFlags {});
+bool Camera::generateRay(const glm::vec2 &raster,
+                         const glm::uvec2 &resolution,
+                         glm::vec3 &ray_origin,
+                         glm::vec3 &ray_dir) const
+{
+    glm::vec2 screen = 2.f * raster / glm::vec2(resolution) - 1.f;
+    float aspect = float(resolution.x) / float(resolution.y);
+
+    // Raster y grows downwards
+    glm::vec3 down = -up;
+
+    ray_origin = position;
+
+    switch (type) {
+        case CameraType::Pinhole: {
+            ray_dir = right * aspect * tanFOV * screen.x +
+                down * tanFOV * screen.y + view;
+        } break;
+        case CameraType::Equirectangular: {
+            float phi = screen.x * glm::pi<float>();
+            float theta = screen.y * glm::half_pi<float>();
+
+            ray_dir = cosf(theta) * (sinf(phi) * right + cosf(phi) * view) +
+                sinf(theta) * down;
+        } break;
+        case CameraType::CubemapFace: {
+            glm::vec3 face_view, face_up, face_right;
+            CameraHelper::cubemapFaceBasis(view, up, right,
+                CubeFace(uint32_t(typeParam)),
+                face_view, face_up, face_right);
+
+            ray_dir = face_right * screen.x - face_up * screen.y + face_view;
+        } break;
+        case CameraType::Fisheye: {
+            glm::vec2 circle(screen.x * aspect, screen.y);
+            float radius = glm::length(circle);
+            if (radius > 1.f) {
+                ray_dir = view;
+                return false;
+            }
+
+            float theta = radius * typeParam;
+            glm::vec2 circle_dir =
+                radius > 0.f ? circle / radius : glm::vec2(0.f);
+
+            ray_dir = cosf(theta) * view + sinf(theta) *
+                (circle_dir.x * right + circle_dir.y * down);
+        } break;
+        case CameraType::Orthographic: {
+            ray_origin += right * aspect * typeParam * screen.x +
+                down * typeParam * screen.y;
+            ray_dir = view;
+        } break;
+    }
 
-    return instances_.size() - 1;
+    ray_dir = glm::normalize(ray_dir);
 
-    // FIXME
-#if 0
-    uint32_t instance_idx = instances_.size() - 1;
+    return true;
+}
 
-    uint32_t outer_id;
-    if (free_ids_.size() > 0) {
-        uint32_t free_id = free_ids_.back();
-        free_ids_.pop_back();
-        index_map_[free_id] = instance_idx;
+void DirtyRange::mark(uint32_t idx)
+{
+    mark(idx, idx + 1);
+}
 
-        outer_id = free_id;
+void DirtyRange::mark(uint32_t range_begin, uint32_t range_end)
+{
+    if (empty()) {
+        begin = range_begin;
+        end = range_end;
     } else {
-        index_map_.push_back(instance_idx);
-        outer_id = index_map_.size() - 1;
+        begin = std::min(begin, range_begin);
+        end = std::max(end, range_end);
     }
+}
 
-    reverse_id_map_.emplace_back(outer_id);
+void DirtyRange::clear()
+{
+    begin = 0;
+    end = 0;
+}
 
-    return outer_id;
-#endif
+bool DirtyRange::empty() const
+{
+    return begin >= end;
+}
+
+uint32_t Environment::addInstance(uint32_t obj_idx,
+                                  const uint32_t *material_idxs,
+                                  uint32_t num_mat_indices,
+                                  const glm::vec3 &position,
+                                  const glm::quat &rotation,
+                                  bool dynamic,
+                                  bool kinematic)
+{
+    return addInstance(obj_idx, material_idxs, num_mat_indices, position,
+                       rotation, glm::vec3(1.f), dynamic, kinematic);
 }
 
 void Environment::moveInstance(uint32_t inst_id, const glm::vec3 &delta)
@@ -183,15 +309,28 @@ void Environment::rotateInstance(uint32_t inst_id, const glm::quat &rot)
     (void)rot;
 }
 
+void Environment::setInstanceGroupTransform(uint32_t group_id,
+                                            const glm::vec3 &position,
+                                            const glm::quat &rotation)
+{
+    setInstanceGroupTransforms(&group_id, &position, &rotation, 1);
+}
+
 template <int N>
 void Environment::setInstanceMaterial(uint32_t inst_id,
                                       const std::array<uint32_t, N> &material_idxs)
 {
-    uint32_t idx = index_map_[inst_id];
-    uint32_t *mats = &instance_materials_[instances_[idx].materialOffset];
+    checkInstanceID(inst_id, "setInstanceMaterial");
+    makeMaterialsUnique();
+
+    uint32_t idx = instanceIndex(inst_id);
+    uint32_t mat_offset = getInstances()[idx].materialOffset;
+    uint32_t *mats = &instance_materials_[mat_offset];
     for (int i = 0; i < N; i++) {
         mats[i] = material_idxs[i];
     }
+
+    dirty_materials_.mark(mat_offset, mat_offset + N);
 }
 
 void Environment::setCameraView(const glm::vec3 &eye, const glm::vec3 &target,
@@ -228,44 +367,94 @@ EnvironmentBackend *Environment::getBackend()
     return backend_.getState();
 }
 
+uint32_t Environment::addView(const Camera &cam)
+{
+    extra_views_.push_back(cam);
+    return extra_views_.size();
+}
+
+void Environment::setView(uint32_t view_idx, const Camera &cam)
+{
+    if (view_idx == 0) {
+        camera_ = cam;
+    } else {
+        extra_views_[view_idx - 1] = cam;
+    }
+}
+
+const Camera &Environment::getView(uint32_t view_idx) const
+{
+    return view_idx == 0 ? camera_ : extra_views_[view_idx - 1];
+}
+
+uint32_t Environment::getNumViews() const
+{
+    return extra_views_.size() + 1;
+}
+
+void Environment::clearExtraViews()
+{
+    extra_views_.clear();
+}
+
+void Environment::setRenderSettings(const EnvironmentRenderSettings &settings)
+{
+    render_settings_ = settings;
+}
+
+EnvironmentRenderSettings Environment::getRenderSettings(
+    const EnvironmentRenderSettings &defaults) const
+{
+    auto resolve = [](uint32_t v, uint32_t default_v) {
+        return v == 0 ? default_v : v;
+    };
+
+    return EnvironmentRenderSettings {
+        resolve(render_settings_.imgWidth, defaults.imgWidth),
+        resolve(render_settings_.imgHeight, defaults.imgHeight),
+        resolve(render_settings_.spp, defaults.spp),
+        resolve(render_settings_.maxDepth, defaults.maxDepth),
+    };
+}
+
 const Camera &Environment::getCamera() const
 {
     return camera_;
 }
 
-const std::vector<ObjectInstance> &
-    Environment::getInstances() const
+uint32_t Environment::getNumInstances() const
 {
-    return instances_;
+    return getInstances().size();
 }
 
-const std::vector<uint32_t> &
-    Environment::getInstanceMaterials() const
+uint32_t Environment::getRandomStream() const
 {
-    return instance_materials_;
+    return rng_stream_;
 }
 
-std::vector<uint32_t> &
-    Environment::getInstanceMaterials()
+uint32_t Environment::getEpisode() const
 {
-    return instance_materials_;
+    return episode_;
 }
 
-const std::vector<InstanceTransform> &
-    Environment::getTransforms() const
+bool Environment::hasDefaultInstances() const
 {
-    return transforms_;
+    return default_instances_;
 }
 
-const std::vector<InstanceFlags> &
-    Environment::getInstanceFlags() const
+uint32_t Environment::instanceIndex(uint32_t inst_id) const
 {
-    return instance_flags_;
+    return default_ids_ ? inst_id : index_map_[inst_id];
 }
 
-uint32_t Environment::getNumInstances() const
+uint32_t Environment::numInstanceIDs() const
 {
-    return instances_.size();
+    return default_ids_ ? getNumInstances() : index_map_.size();
+}
+
+uint32_t Environment::getInstanceID(uint32_t inst_idx) const
+{
+    return default_ids_ ? inst_idx : reverse_id_map_[inst_idx];
 }
 
 bool Environment::isDirty() const
@@ -283,4 +472,33 @@ void Environment::clearDirty() const
     dirty_ = false;
 }
 
+const DirtyRange &Environment::getDirtyTransforms() const
+{
+    return dirty_transforms_;
+}
+
+const DirtyRange &Environment::getDirtyMaterials() const
+{
+    return dirty_materials_;
+}
+
+bool Environment::areLightsDirty() const
+{
+    return dirty_lights_;
+}
+
+void Environment::setUploadDirty() const
+{
+    dirty_transforms_.mark(0, getNumInstances());
+    dirty_materials_.mark(0, getInstanceMaterials().size());
+    dirty_lights_ = true;
+}
+
+void Environment::clearUploadDirty() const
+{
+    dirty_transforms_.clear();
+    dirty_materials_.clear();
+    dirty_lights_ = false;
+}
+
 }
@@ -12,12 +12,17 @@ struct PreprocessData;
 
 class ScenePreprocessor {
 public:
+    // chunk_size > 0 splits static geometry into chunks on a world space
+    // grid of that cell size, which renderers can stream independently
     ScenePreprocessor(std::string_view gltf_path,
                       const glm::mat4 &base_txfm,
                       std::optional<std::string_view> data_dir,
                       bool process_textures,
-                      bool build_sdfs);
+                      bool build_sdfs,
+                      float chunk_size = 0.f);
 
+    // Consumes the parsed scene to limit peak memory, so may only be
+    // called once per ScenePreprocessor
     void dump(std::string_view out_path);
 
 private:
@@ -3,7 +3,10 @@
 #include <rlpbr/fwd.hpp>
 #include <rlpbr/environment.hpp>
 #include <rlpbr/utils.hpp>
+
+#include <glm/gtc/quaternion.hpp>
 #include <memory>
+#include <vector>
 
 namespace RLpbr {
 
@@ -29,9 +32,39 @@ public:
 
     inline BatchBackend *getBackend() { return backend_.get(); }
 
+    // Environments covered by the current render call, see
+    // Renderer::render
+    inline bool isActive(uint32_t idx) const { return active_[idx]; }
+    inline bool allActive() const { return num_active_ == envs_.size(); }
+    inline uint32_t numActive() const { return num_active_; }
+    inline bool clearInactive() const { return clear_inactive_; }
+
+    void setActive(const uint32_t *env_idxs, uint32_t num_envs,
+                   bool clear_inactive);
+    void setAllActive();
+
+    // Batched updates across environments. All arrays are parallel and
+    // num_updates long. Inputs are validated up front, before any
+    // environment is modified.
+    void setCameraViews(const uint32_t *env_idxs,
+                        const glm::vec3 *positions,
+                        const glm::quat *rotations,
+                        uint32_t num_updates);
+
+    // scales may be null for unit scale
+    void setInstanceTransforms(const uint32_t *env_idxs,
+                               const uint32_t *inst_ids,
+                               const glm::vec3 *positions,
+                               const glm::quat *rotations,
+                               const glm::vec3 *scales,
+                               uint32_t num_updates);
+
 private:
     Handle backend_;
     DynArray<Environment> envs_;
+    std::vector<uint8_t> active_;
+    uint32_t num_active_;
+    bool clear_inactive_;
 };
 
 }
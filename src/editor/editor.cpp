@@ -102,13 +102,20 @@ static SceneProperties computeSceneProperties(
 void Editor::loadScene(const char *scene_name)
 {
     SceneLoadData load_data = SceneLoadData::loadFromDisk(scene_name, true);
+    if (load_data.geometryBlocks.size() > 1) {
+        cerr << "Editor does not support scenes with multiple geometry blocks"
+             << endl;
+        abort();
+    }
+
     const vector<char> &loaded_gpu_data = *get_if<vector<char>>(&load_data.data);
     vector<char> cpu_data(loaded_gpu_data);
 
     PackedVertex *verts = (PackedVertex *)cpu_data.data();
     assert((uintptr_t)verts % std::alignment_of_v<PackedVertex> == 0);
     uint32_t *indices =
-        (uint32_t *)(cpu_data.data() + load_data.hdr.indexOffset);
+        (uint32_t *)(cpu_data.data() +
+                     load_data.geometryBlocks[0].indexOffset);
 
     auto render_data = renderer_.loadScene(move(load_data));
 
@@ -1238,7 +1238,7 @@ void Renderer::render(Scene *raw_scene, const EditorCam &cam,
     dev.dt.cmdBindDescriptorSets(draw_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
                                  default_pipeline_.layout, 1, 1,
                                  &scene_set_, 0, nullptr);
-    dev.dt.cmdBindIndexBuffer(draw_cmd, scene->data.buffer,
+    dev.dt.cmdBindIndexBuffer(draw_cmd, scene->geometryBuffers[0].buffer,
                               scene->indexOffset, VK_INDEX_TYPE_UINT32);
 
     VkRenderPassBeginInfo render_pass_info;
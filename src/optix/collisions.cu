@@ -352,7 +352,7 @@ static __global__ void generateContacts(const PackedPhysicsEnv &env)
 
     for (int tri_idx = threadIdx.x; tri_idx < (int)dyn_obj.numTriangles;
          tri_idx += CollisionConfig::narrowTBP) {
-        uint32_t base_index = dyn_obj.indexOffset + 3 * tri_idx;
+        uint64_t base_index = dyn_obj.indexOffset + 3 * tri_idx;
         glm::vec3 tri[] {
             transformPoint(to_other, unpackPosition(
                 env.vertexBuffer[env.indexBuffer[base_index]])),
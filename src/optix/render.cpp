@@ -9,6 +9,7 @@
 #include <optix_function_table_definition.h>
 #include <optix_stubs.h>
 
+#include <chrono>
 #include <iostream>
 
 using namespace std;
@@ -536,6 +537,8 @@ OptixBackend::OptixBackend(const RenderConfig &cfg, bool validate)
       active_idx_(0),
       frame_counter_(0),
       frame_mask_(getNumFrames(cfg) == 2 ? 1 : 0),
+      last_upload_bytes_(0),
+      last_stall_ms_(0.f),
       streams_([&cfg]() {
           cudaStream_t strm = makeStream();
 
@@ -569,6 +572,19 @@ OptixBackend::OptixBackend(const RenderConfig &cfg, bool validate)
         abort();
     }
 
+    if (cfg.outputChannels != OutputChannels(0) &&
+        cfg.outputChannels != OutputChannels::ColorHalf) {
+        cerr << "Only ColorHalf output is supported by the optix backend"
+             << endl;
+        abort();
+    }
+
+    if (cfg.flags & RenderFlags::HostOutputs) {
+        cerr << "Host outputs are only supported by the vulkan backend"
+             << endl;
+        abort();
+    }
+
     for (int i = 0; i < (int)getNumFrames(cfg); i++) {
         render_state_.shaderBuffers[i].launchInput->precomputed =
             bsdf_luts_.deviceHandles;
@@ -672,6 +688,12 @@ void OptixBackend::render(RenderBatch &batch)
     const Environment *envs = batch.getEnvironments();
     //physics_->simulate(envs);
 
+    if (!batch.allActive()) {
+        cerr << "Partial batches are only supported by the vulkan backend"
+             << endl;
+        abort();
+    }
+
     ShaderBuffers &buffers = render_state_.shaderBuffers[active_idx_];
     PackedInstance *instance_buffer = buffers.instanceBuffer;
     PackedTransforms *transform_buffer = buffers.transformBuffer;
@@ -680,6 +702,34 @@ void OptixBackend::render(RenderBatch &batch)
 
     for (int batch_idx = 0; batch_idx < (int)batch_size_; batch_idx++) {
         const Environment &env = envs[batch_idx];
+
+        // All fields zero means no overrides
+        EnvironmentRenderSettings settings = env.getRenderSettings({});
+        if (settings.imgWidth != 0 || settings.imgHeight != 0 ||
+            settings.spp != 0 || settings.maxDepth != 0) {
+            cerr << "Per environment render settings are only supported by "
+                "the vulkan backend" << endl;
+            abort();
+        }
+
+        if (env.getNumViews() > 1) {
+            cerr << "Multiple views are only supported by the vulkan backend"
+                 << endl;
+            abort();
+        }
+
+        if (env.getScene()->objectLibrary) {
+            cerr << "Object libraries are only supported by the vulkan "
+                "backend" << endl;
+            abort();
+        }
+
+        if (env.getCamera().type != CameraType::Pinhole) {
+            cerr << "Non pinhole cameras are only supported by the vulkan "
+                "backend" << endl;
+            abort();
+        }
+
         if (env.isDirty()) {
             OptixEnvironment *env_backend = (OptixEnvironment *)env.getBackend();
             env_backend->queueTLASRebuild(env, ctx_, streams_[active_idx_]);
@@ -691,6 +741,14 @@ void OptixBackend::render(RenderBatch &batch)
                     &instance_material_buffer, &light_buffer);
     }
 
+    // Buffers are double buffered, so everything is rewritten every frame
+    last_upload_bytes_ =
+        sizeof(PackedInstance) * (instance_buffer - buffers.instanceBuffer) +
+        sizeof(PackedTransforms) * (transform_buffer - buffers.transformBuffer) +
+        sizeof(uint32_t) *
+            (instance_material_buffer - buffers.instanceMaterialBuffer) +
+        sizeof(PackedEnv) * batch_size_;
+
     buffers.launchInput->baseBatchOffset = batch_size_ * active_idx_;
     buffers.launchInput->baseFrameCounter = frame_counter_;
 
@@ -707,7 +765,22 @@ void OptixBackend::render(RenderBatch &batch)
 
 void OptixBackend::waitForBatch(RenderBatch &)
 {
+    auto start = chrono::steady_clock::now();
     REQ_CUDA(cudaStreamSynchronize(streams_[0]));
+    auto end = chrono::steady_clock::now();
+
+    last_stall_ms_ = chrono::duration<float, milli>(end - start).count();
+}
+
+bool OptixBackend::isBatchReady(RenderBatch &)
+{
+    cudaError_t res = cudaStreamQuery(streams_[0]);
+    if (res == cudaErrorNotReady) {
+        return false;
+    }
+    REQ_CUDA(res);
+
+    return true;
 }
 
 half *OptixBackend::getOutputPointer(RenderBatch &)
@@ -723,5 +796,31 @@ AuxiliaryOutputs OptixBackend::getAuxiliaryOutputs(RenderBatch &)
     };
 }
 
+ChannelOutputs OptixBackend::getChannelOutputs(RenderBatch &)
+{
+    return {};
+}
+
+void OptixBackend::resetEnvironments(RenderBatch &batch)
+{
+    Environment *envs = batch.getEnvironments();
+    for (uint32_t batch_idx = 0; batch_idx < batch_size_; batch_idx++) {
+        envs[batch_idx].reset();
+    }
+}
+
+BatchStatistics OptixBackend::getBatchStatistics(RenderBatch &)
+{
+    return {
+        last_upload_bytes_,
+        0,
+        0,
+        0,
+        0,
+        0,
+        last_stall_ms_,
+    };
+}
+
 }
 }
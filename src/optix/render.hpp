@@ -64,9 +64,17 @@ public:
 
     void waitForBatch(RenderBatch &batch);
 
+    bool isBatchReady(RenderBatch &batch);
+
     half *getOutputPointer(RenderBatch &batch);
     AuxiliaryOutputs getAuxiliaryOutputs(RenderBatch &batch);
 
+    ChannelOutputs getChannelOutputs(RenderBatch &batch);
+
+    BatchStatistics getBatchStatistics(RenderBatch &batch);
+
+    void resetEnvironments(RenderBatch &batch);
+
 private:
     OptixDeviceContext ctx_;
     const uint32_t batch_size_;
@@ -74,6 +82,8 @@ private:
     uint32_t active_idx_;
     uint32_t frame_counter_;
     const uint32_t frame_mask_;
+    uint64_t last_upload_bytes_;
+    float last_stall_ms_;
     std::array<cudaStream_t, 2> streams_;
     cudaStream_t tlas_strm_;
     RenderState render_state_;
@@ -80,7 +80,9 @@ void TLAS::build(
         assignInstanceTransform(cur_inst, txfm.mat);
         cur_inst.instanceId = 0;
         cur_inst.sbtOffset = 0;
-        if (instance_flags[inst_id] & InstanceFlags::Transparent) {
+        if (instance_flags[inst_id] & InstanceFlags::Deleted) {
+            cur_inst.visibilityMask = 0;
+        } else if (instance_flags[inst_id] & InstanceFlags::Transparent) {
             cur_inst.visibilityMask = 2;
         } else {
             cur_inst.visibilityMask = 1;
@@ -458,6 +460,14 @@ static LoadedTextures loadTextures(const TextureInfo &texture_info,
 
 shared_ptr<Scene> OptixLoader::loadScene(SceneLoadData &&load_info)
 {
+    // FIXME: the OptiX shaders assume a single vertex / index buffer
+    if (load_info.geometryBlocks.size() > 1) {
+        cerr << "OptiX backend does not support scenes with multiple "
+             << "geometry blocks" << endl;
+        abort();
+    }
+    const GeometryBlock &geometry_block = load_info.geometryBlocks[0];
+
     auto textures = loadTextures(load_info.textureInfo, stream_,
                                  max_texture_resolution_, texture_mgr_);
 
@@ -526,7 +536,7 @@ shared_ptr<Scene> OptixLoader::loadScene(SceneLoadData &&load_info)
     const DevicePackedVertex *base_vertex_ptr =
         (const DevicePackedVertex *)scene_storage;
     const uint32_t *base_index_ptr = 
-        (const uint32_t *)(scene_storage + load_info.hdr.indexOffset);
+        (const uint32_t *)(scene_storage + geometry_block.indexOffset);
 
     static_assert(sizeof(PackedVertex) == sizeof(Vertex));
 
@@ -547,7 +557,7 @@ shared_ptr<Scene> OptixLoader::loadScene(SceneLoadData &&load_info)
                 (CUdeviceptr)(base_index_ptr + mesh_info.indexOffset);
             auto &tri_info = geometry_info.triangleArray;
             tri_info.vertexBuffers = &scene_storage_dev;
-            tri_info.numVertices = load_info.hdr.numVertices;
+            tri_info.numVertices = geometry_block.numVertices;
             tri_info.vertexFormat = OPTIX_VERTEX_FORMAT_FLOAT3;
             tri_info.vertexStrideInBytes = sizeof(Vertex);
             tri_info.indexBuffer = index_ptr;
@@ -298,7 +298,7 @@ __forceinline__ void setAuxiliaries(uint32_t base_offset, float3 normal,
 __forceinline__ MeshInfo unpackMeshInfo(const PackedMeshInfo &packed)
 {
     return MeshInfo {
-        packed.data.x,
+        packed.data[0].x,
     };
 }
 
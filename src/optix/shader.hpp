@@ -25,7 +25,7 @@ struct PackedMaterial {
 };
 
 struct PackedMeshInfo {
-    uint4 data;
+    uint4 data[2];
 };
 
 struct PackedInstance {
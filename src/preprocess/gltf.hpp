@@ -88,6 +88,8 @@ struct GLTFMaterial {
     glm::vec3 anisoDir;
     glm::vec3 baseEmittance;
     bool thinwalled;
+    AlphaMode alphaMode;
+    float alphaCutoff;
 };
 
 struct GLTFPrimitive {
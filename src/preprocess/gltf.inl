@@ -376,6 +376,26 @@ GLTFScene gltfLoad(filesystem::path gltf_path) noexcept
             uint32_t emissive_idx = jsonGetOr(
                 material["emissiveTexture"]["index"], tex_missing);
 
+            string_view alpha_mode_name;
+            auto alpha_mode_err = material["alphaMode"].get(alpha_mode_name);
+            if (alpha_mode_err) {
+                alpha_mode_name = "OPAQUE";
+            }
+
+            AlphaMode alpha_mode;
+            if (alpha_mode_name == "OPAQUE") {
+                alpha_mode = AlphaMode::Opaque;
+            } else if (alpha_mode_name == "MASK") {
+                alpha_mode = AlphaMode::Masked;
+            } else if (alpha_mode_name == "BLEND") {
+                alpha_mode = AlphaMode::Blended;
+            } else {
+                cerr << "Unknown alphaMode " << alpha_mode_name << endl;
+                abort();
+            }
+
+            float alpha_cutoff = jsonGetOr(material["alphaCutoff"], 0.5f);
+
             string_view material_name_view;
             string material_name;
             auto name_err = material["name"].get(material_name_view);
@@ -411,6 +431,8 @@ GLTFScene gltfLoad(filesystem::path gltf_path) noexcept
                 aniso_dir,
                 base_emittance,
                 thinwalled,
+                alpha_mode,
+                alpha_cutoff,
             });
         }
 
@@ -728,6 +750,8 @@ vector<MaterialType> gltfParseMaterials(const GLTFScene &scene,
             aniso_rotation,
             gltf_mat.baseEmittance,
             gltf_mat.thinwalled,
+            gltf_mat.alphaMode,
+            gltf_mat.alphaCutoff,
         });
     }
 
@@ -1,6 +1,7 @@
 #include "import.hpp"
 #include "gltf.hpp"
 #include "habitat_json.hpp"
+#include "ply.hpp"
 
 #include <iostream>
 
@@ -24,6 +25,13 @@ static bool isHabitatJSON(string_view habitat_path)
     return suffix == "json";
 }
 
+static bool isPLY(string_view ply_path)
+{
+    auto suffix = ply_path.substr(ply_path.rfind('.') + 1);
+
+    return suffix == "ply";
+}
+
 template <typename VertexType, typename MaterialType>
 SceneDescription<VertexType, MaterialType>
 SceneDescription<VertexType, MaterialType>::parseScene(
@@ -40,6 +48,11 @@ SceneDescription<VertexType, MaterialType>::parseScene(
             base_txfm, texture_cb);
     }
 
+    if (isPLY(scene_path)) {
+        return parsePLY<VertexType, MaterialType>(scene_path,
+            base_txfm, texture_cb);
+    }
+
     cerr << "Unsupported input format" << endl;
     abort();
 }
@@ -89,6 +102,7 @@ SceneDescription<VertexType, MaterialType>::mergeScene(
 
 #include "gltf.inl"
 #include "habitat_json.inl"
+#include "ply.inl"
 
 namespace RLpbr {
 namespace SceneImport {
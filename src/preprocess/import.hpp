@@ -46,6 +46,11 @@ struct Material {
     float anisoRotation;
     glm::vec3 baseEmittance;
     bool thinwalled;
+    // As declared by the source format. Lowered by the preprocessor when
+    // the base color texture turns out to be more opaque.
+    AlphaMode alphaMode;
+    // Masked alpha threshold
+    float alphaCutoff;
 };
 
 struct InstanceProperties {
@@ -418,21 +418,28 @@ ProcessedPhysicsState ProcessedPhysicsState::make(
     vector<SDF> sdfs;
     vector<PhysicsObject> physics_objects;
 
+    // Indices are relative to their object's first vertex
+    uint64_t vertex_offset = 0;
     for (uint32_t obj_id = 0; obj_id < geometry.objectInfos.size();
          obj_id++) {
         const auto &obj_info = geometry.objectInfos[obj_id];
-        uint32_t index_offset =
+        uint64_t index_offset =
             geometry.meshInfos[obj_info.meshIndex].indexOffset;
         uint32_t num_triangles = 0;
+        uint64_t num_vertices = 0;
         for (int mesh_idx = 0; mesh_idx < (int)obj_info.numMeshes;
              mesh_idx++) {
-            num_triangles +=
-                geometry.meshInfos[obj_info.meshIndex + mesh_idx].numTriangles;
+            const auto &mesh_info =
+                geometry.meshInfos[obj_info.meshIndex + mesh_idx];
+            num_triangles += mesh_info.numTriangles;
+            num_vertices += mesh_info.numVertices;
         }
 
-        auto physics_info = PhysicsMeshInfo::make(geometry.vertices.data(),
+        auto physics_info = PhysicsMeshInfo::make(
+            geometry.vertices.data() + vertex_offset,
             geometry.indices.data() + index_offset,
             num_triangles * 3, skip_sdfs);
+        vertex_offset += num_vertices;
 
         sdfs.emplace_back(move(physics_info.sdf));
         uint32_t sdf_id = sdfs.size() - 1;
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "import.hpp"
+
+#include <rlpbr_core/scene.hpp>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace RLpbr {
+namespace SceneImport {
+
+namespace PLY {
+
+enum class Format {
+    ASCII,
+    BinaryLittleEndian,
+    BinaryBigEndian,
+};
+
+enum class PropertyType {
+    Int8,
+    UInt8,
+    Int16,
+    UInt16,
+    Int32,
+    UInt32,
+    Float32,
+    Float64,
+};
+
+struct Property {
+    std::string name;
+    PropertyType type;
+    bool isList;
+    PropertyType listCountType;
+};
+
+struct Element {
+    std::string name;
+    uint64_t count;
+    std::vector<Property> properties;
+};
+
+struct Header {
+    Format format;
+    std::vector<Element> elements;
+    std::string textureFile;
+    uint64_t dataOffset;
+};
+
+}
+
+PLY::Header plyParseHeader(std::string_view header_text,
+                           std::string_view scene_path);
+
+template <typename VertexType, typename MaterialType>
+SceneDescription<VertexType, MaterialType> parsePLY(
+    std::filesystem::path scene_path, const glm::mat4 &base_txfm,
+    const TextureCallback &texture_cb);
+
+}
+}
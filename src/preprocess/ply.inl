@@ -0,0 +1,1025 @@
+#include "ply.hpp"
+
+#include <rlpbr_core/utils.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+using namespace std;
+
+namespace RLpbr {
+namespace SceneImport {
+
+namespace PLY {
+
+class MappedFile {
+public:
+    MappedFile(const filesystem::path &path)
+        : data_(nullptr),
+          num_bytes_(0)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            cerr << "PLY loading '" << path << "' failed: cannot open file"
+                 << endl;
+            abort();
+        }
+
+        struct stat stat_buf;
+        if (fstat(fd, &stat_buf) != 0) {
+            cerr << "PLY loading '" << path << "' failed: cannot stat file"
+                 << endl;
+            abort();
+        }
+        num_bytes_ = stat_buf.st_size;
+
+        void *mapped = mmap(nullptr, num_bytes_, PROT_READ, MAP_PRIVATE,
+                            fd, 0);
+        close(fd);
+
+        if (mapped == MAP_FAILED) {
+            cerr << "PLY loading '" << path << "' failed: mmap failed"
+                 << endl;
+            abort();
+        }
+
+        // Attribute conversion touches the whole file from many threads
+        madvise(mapped, num_bytes_, MADV_WILLNEED);
+
+        data_ = reinterpret_cast<const uint8_t *>(mapped);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        munmap(const_cast<uint8_t *>(data_), num_bytes_);
+    }
+
+    const uint8_t *data() const { return data_; }
+    uint64_t size() const { return num_bytes_; }
+
+private:
+    const uint8_t *data_;
+    uint64_t num_bytes_;
+};
+
+static uint32_t propertySize(PropertyType type)
+{
+    switch (type) {
+        case PropertyType::Int8:
+        case PropertyType::UInt8:
+            return 1;
+        case PropertyType::Int16:
+        case PropertyType::UInt16:
+            return 2;
+        case PropertyType::Int32:
+        case PropertyType::UInt32:
+        case PropertyType::Float32:
+            return 4;
+        case PropertyType::Float64:
+            return 8;
+    }
+
+    unreachable();
+}
+
+template <typename T>
+static T readBinary(const uint8_t *ptr, bool swap)
+{
+    T v;
+    if (swap) {
+        uint8_t swapped[sizeof(T)];
+        for (int i = 0; i < (int)sizeof(T); i++) {
+            swapped[i] = ptr[sizeof(T) - 1 - i];
+        }
+        memcpy(&v, swapped, sizeof(T));
+    } else {
+        memcpy(&v, ptr, sizeof(T));
+    }
+
+    return v;
+}
+
+static double readBinaryValue(const uint8_t *ptr, PropertyType type,
+                              bool swap)
+{
+    switch (type) {
+        case PropertyType::Int8:
+            return readBinary<int8_t>(ptr, swap);
+        case PropertyType::UInt8:
+            return readBinary<uint8_t>(ptr, swap);
+        case PropertyType::Int16:
+            return readBinary<int16_t>(ptr, swap);
+        case PropertyType::UInt16:
+            return readBinary<uint16_t>(ptr, swap);
+        case PropertyType::Int32:
+            return readBinary<int32_t>(ptr, swap);
+        case PropertyType::UInt32:
+            return readBinary<uint32_t>(ptr, swap);
+        case PropertyType::Float32:
+            return readBinary<float>(ptr, swap);
+        case PropertyType::Float64:
+            return readBinary<double>(ptr, swap);
+    }
+
+    unreachable();
+}
+
+static bool isASCIISpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Reads a single whitespace separated value from [ptr, end). The mapped
+// file isn't null terminated, so the token is copied out before conversion
+static const char *readASCIIValue(const char *ptr, const char *end,
+                                  double *out)
+{
+    while (ptr < end && isASCIISpace(*ptr)) {
+        ptr++;
+    }
+
+    char token[64];
+    int token_len = 0;
+    while (ptr < end && !isASCIISpace(*ptr) &&
+           token_len < (int)sizeof(token) - 1) {
+        token[token_len++] = *ptr++;
+    }
+    token[token_len] = '\0';
+
+    *out = token_len > 0 ? strtod(token, nullptr) : 0.0;
+
+    return ptr;
+}
+
+// Splits [0, num_items) across worker threads. Small inputs
+// stay on the calling thread.
+template <typename Fn>
+static void parallelFor(uint64_t num_items, uint64_t min_items_per_thread,
+                        Fn &&fn)
+{
+    uint64_t max_threads = max(thread::hardware_concurrency(), 1u);
+    uint64_t num_threads = min(max_threads,
+        (num_items + min_items_per_thread - 1) / min_items_per_thread);
+
+    if (num_threads <= 1) {
+        fn(uint64_t(0), num_items);
+        return;
+    }
+
+    uint64_t items_per_thread = (num_items + num_threads - 1) / num_threads;
+
+    vector<thread> workers;
+    workers.reserve(num_threads);
+    for (uint64_t i = 0; i < num_threads; i++) {
+        uint64_t begin = i * items_per_thread;
+        uint64_t end = min(begin + items_per_thread, num_items);
+        if (begin >= end) {
+            break;
+        }
+
+        workers.emplace_back([&fn, begin, end]() {
+            fn(begin, end);
+        });
+    }
+
+    for (auto &t : workers) {
+        t.join();
+    }
+}
+
+// Records the start of each of the next num_lines non empty lines.
+// line_starts[num_lines] marks the end of the final line.
+static const char *indexLines(const char *ptr, const char *end,
+                              uint64_t num_lines,
+                              vector<const char *> &line_starts,
+                              string_view scene_path)
+{
+    line_starts.clear();
+    line_starts.reserve(num_lines + 1);
+
+    while (line_starts.size() < num_lines) {
+        if (ptr >= end) {
+            cerr << "PLY loading '" << scene_path
+                 << "' failed: unexpected end of file" << endl;
+            abort();
+        }
+
+        const char *newline = reinterpret_cast<const char *>(
+            memchr(ptr, '\n', end - ptr));
+        const char *line_end = newline == nullptr ? end : newline;
+
+        bool empty = true;
+        for (const char *c = ptr; c < line_end; c++) {
+            if (!isASCIISpace(*c)) {
+                empty = false;
+                break;
+            }
+        }
+
+        if (!empty) {
+            line_starts.push_back(ptr);
+        }
+
+        ptr = newline == nullptr ? end : newline + 1;
+    }
+    line_starts.push_back(ptr);
+
+    return ptr;
+}
+
+static int32_t findProperty(const Element &elem,
+                            initializer_list<string_view> names)
+{
+    for (int32_t prop_idx = 0; prop_idx < (int32_t)elem.properties.size();
+         prop_idx++) {
+        for (string_view name : names) {
+            if (elem.properties[prop_idx].name == name) {
+                return prop_idx;
+            }
+        }
+    }
+
+    return -1;
+}
+
+static uint64_t binaryRecordSize(const Element &elem)
+{
+    uint64_t num_bytes = 0;
+    for (const Property &prop : elem.properties) {
+        num_bytes += propertySize(prop.type);
+    }
+
+    return num_bytes;
+}
+
+static bool hasListProperty(const Element &elem)
+{
+    for (const Property &prop : elem.properties) {
+        if (prop.isList) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Walks one variable sized binary record, passing the list at list_idx
+// to on_list as (pointer to first entry, number of entries)
+template <typename Fn>
+static const uint8_t *walkBinaryRecord(const uint8_t *ptr,
+                                       const uint8_t *end,
+                                       const Element &elem,
+                                       int32_t list_idx,
+                                       bool swap,
+                                       string_view scene_path,
+                                       Fn &&on_list)
+{
+    for (int32_t prop_idx = 0; prop_idx < (int32_t)elem.properties.size();
+         prop_idx++) {
+        const Property &prop = elem.properties[prop_idx];
+        uint64_t num_bytes = propertySize(prop.type);
+
+        if (prop.isList) {
+            uint32_t count_bytes = propertySize(prop.listCountType);
+            if (ptr + count_bytes > end) {
+                cerr << "PLY loading '" << scene_path
+                     << "' failed: unexpected end of file" << endl;
+                abort();
+            }
+
+            uint64_t count =
+                uint64_t(readBinaryValue(ptr, prop.listCountType, swap));
+            ptr += count_bytes;
+
+            if (prop_idx == list_idx) {
+                on_list(ptr, count);
+            }
+
+            num_bytes *= count;
+        }
+
+        if (ptr + num_bytes > end) {
+            cerr << "PLY loading '" << scene_path
+                 << "' failed: unexpected end of file" << endl;
+            abort();
+        }
+        ptr += num_bytes;
+    }
+
+    return ptr;
+}
+
+// Parses one ASCII record, storing the list at list_idx in list_values
+static void parseASCIIRecord(const char *ptr, const char *end,
+                             const Element &elem,
+                             int32_t list_idx,
+                             vector<uint32_t> &list_values)
+{
+    list_values.clear();
+
+    for (int32_t prop_idx = 0; prop_idx < (int32_t)elem.properties.size();
+         prop_idx++) {
+        const Property &prop = elem.properties[prop_idx];
+        double v;
+        ptr = readASCIIValue(ptr, end, &v);
+
+        if (!prop.isList) {
+            continue;
+        }
+
+        uint64_t count = uint64_t(v);
+        for (uint64_t i = 0; i < count; i++) {
+            ptr = readASCIIValue(ptr, end, &v);
+
+            if (prop_idx == list_idx) {
+                list_values.push_back(uint32_t(v));
+            }
+        }
+    }
+}
+
+static uint64_t numFanTriangles(uint64_t polygon_size)
+{
+    return polygon_size >= 3 ? polygon_size - 2 : 0;
+}
+
+template <typename Fn>
+static uint32_t *emitTriangleFan(uint32_t *out, uint64_t polygon_size,
+                                 Fn &&fetch)
+{
+    if (polygon_size < 3) {
+        return out;
+    }
+
+    uint32_t first = fetch(0);
+    uint32_t prev = fetch(1);
+    for (uint64_t i = 2; i < polygon_size; i++) {
+        uint32_t cur = fetch(i);
+        *out++ = first;
+        *out++ = prev;
+        *out++ = cur;
+        prev = cur;
+    }
+
+    return out;
+}
+
+}
+
+PLY::Header plyParseHeader(string_view header_text, string_view scene_path)
+{
+    using namespace PLY;
+
+    auto parseError = [&](string_view msg) {
+        cerr << "PLY loading '" << scene_path << "' failed: "
+             << msg << endl;
+        abort();
+    };
+
+    auto parseType = [&](string_view type_name) {
+        if (type_name == "char" || type_name == "int8") {
+            return PropertyType::Int8;
+        } else if (type_name == "uchar" || type_name == "uint8") {
+            return PropertyType::UInt8;
+        } else if (type_name == "short" || type_name == "int16") {
+            return PropertyType::Int16;
+        } else if (type_name == "ushort" || type_name == "uint16") {
+            return PropertyType::UInt16;
+        } else if (type_name == "int" || type_name == "int32") {
+            return PropertyType::Int32;
+        } else if (type_name == "uint" || type_name == "uint32") {
+            return PropertyType::UInt32;
+        } else if (type_name == "float" || type_name == "float32") {
+            return PropertyType::Float32;
+        } else if (type_name == "double" || type_name == "float64") {
+            return PropertyType::Float64;
+        }
+
+        parseError("unknown property type");
+        unreachable();
+    };
+
+    Header header {};
+    bool format_found = false;
+
+    vector<string_view> tokens;
+    size_t line_start = 0;
+    bool first_line = true;
+    while (line_start < header_text.size()) {
+        size_t line_end = header_text.find('\n', line_start);
+        if (line_end == string_view::npos) {
+            line_end = header_text.size();
+        }
+
+        string_view line = header_text.substr(line_start,
+                                              line_end - line_start);
+        line_start = line_end + 1;
+
+        tokens.clear();
+        size_t token_start = 0;
+        while (token_start < line.size()) {
+            while (token_start < line.size() &&
+                   isASCIISpace(line[token_start])) {
+                token_start++;
+            }
+
+            size_t token_end = token_start;
+            while (token_end < line.size() &&
+                   !isASCIISpace(line[token_end])) {
+                token_end++;
+            }
+
+            if (token_end > token_start) {
+                tokens.push_back(
+                    line.substr(token_start, token_end - token_start));
+            }
+            token_start = token_end;
+        }
+
+        if (first_line) {
+            if (tokens.size() != 1 || tokens[0] != "ply") {
+                parseError("missing ply magic");
+            }
+            first_line = false;
+            continue;
+        }
+
+        if (tokens.empty()) {
+            continue;
+        }
+
+        if (tokens[0] == "format") {
+            if (tokens.size() < 2) {
+                parseError("invalid format line");
+            }
+
+            if (tokens[1] == "ascii") {
+                header.format = Format::ASCII;
+            } else if (tokens[1] == "binary_little_endian") {
+                header.format = Format::BinaryLittleEndian;
+            } else if (tokens[1] == "binary_big_endian") {
+                header.format = Format::BinaryBigEndian;
+            } else {
+                parseError("unknown format");
+            }
+            format_found = true;
+        } else if (tokens[0] == "comment") {
+            // MeshLab / ScanNet convention for textured scans
+            if (tokens.size() >= 3 && tokens[1] == "TextureFile") {
+                header.textureFile = tokens[2];
+            }
+        } else if (tokens[0] == "element") {
+            if (tokens.size() != 3) {
+                parseError("invalid element line");
+            }
+
+            header.elements.push_back({
+                string(tokens[1]),
+                strtoull(string(tokens[2]).c_str(), nullptr, 10),
+                {},
+            });
+        } else if (tokens[0] == "property") {
+            if (header.elements.empty()) {
+                parseError("property before element");
+            }
+
+            auto &props = header.elements.back().properties;
+            if (tokens.size() == 5 && tokens[1] == "list") {
+                props.push_back({
+                    string(tokens[4]),
+                    parseType(tokens[3]),
+                    true,
+                    parseType(tokens[2]),
+                });
+            } else if (tokens.size() == 3) {
+                props.push_back({
+                    string(tokens[2]),
+                    parseType(tokens[1]),
+                    false,
+                    PropertyType::UInt8,
+                });
+            } else {
+                parseError("invalid property line");
+            }
+        }
+    }
+
+    if (!format_found) {
+        parseError("missing format");
+    }
+
+    return header;
+}
+
+template <typename VertexType>
+static const char *plyReadVertices(const PLY::Header &header,
+                                   const PLY::Element &elem,
+                                   const char *ptr,
+                                   const char *end,
+                                   const glm::mat4 &base_txfm,
+                                   string_view scene_path,
+                                   vector<VertexType> &vertices,
+                                   bool &has_normals)
+{
+    using namespace PLY;
+
+    int32_t x_idx = findProperty(elem, {"x"});
+    int32_t y_idx = findProperty(elem, {"y"});
+    int32_t z_idx = findProperty(elem, {"z"});
+    int32_t nx_idx = findProperty(elem, {"nx"});
+    int32_t ny_idx = findProperty(elem, {"ny"});
+    int32_t nz_idx = findProperty(elem, {"nz"});
+    int32_t u_idx = findProperty(elem, {"u", "s", "texture_u", "texture_s"});
+    int32_t v_idx = findProperty(elem, {"v", "t", "texture_v", "texture_t"});
+    int32_t r_idx = findProperty(elem, {"red", "r"});
+
+    if (x_idx == -1 || y_idx == -1 || z_idx == -1) {
+        cerr << "PLY loading '" << scene_path
+             << "' failed: vertices missing position" << endl;
+        abort();
+    }
+
+    if (hasListProperty(elem)) {
+        cerr << "PLY loading '" << scene_path
+             << "' failed: list properties on vertices not supported"
+             << endl;
+        abort();
+    }
+
+    has_normals = nx_idx != -1 && ny_idx != -1 && nz_idx != -1;
+    bool has_uvs = u_idx != -1 && v_idx != -1;
+
+    // The vertex format has no color attribute
+    if (r_idx != -1) {
+        cerr << "PLY loading '" << scene_path
+             << "': ignoring vertex colors" << endl;
+    }
+
+    glm::mat3 normal_txfm = glm::inverseTranspose(glm::mat3(base_txfm));
+
+    constexpr bool has_position = HasPosition<VertexType>::value;
+    constexpr bool has_normal = HasNormal<VertexType>::value;
+    constexpr bool has_uv = HasUV<VertexType>::value;
+
+    auto sanitize = [](float v) {
+        return (isnan(v) || isinf(v)) ? 0.f : v;
+    };
+
+    auto convertVertex = [&](auto &&fetch) {
+        VertexType vert {};
+
+        if constexpr (has_position) {
+            glm::vec3 pos(sanitize(fetch(x_idx)),
+                          sanitize(fetch(y_idx)),
+                          sanitize(fetch(z_idx)));
+            vert.position = base_txfm * glm::vec4(pos, 1.f);
+        }
+
+        if constexpr (has_normal) {
+            if (has_normals) {
+                glm::vec3 n(sanitize(fetch(nx_idx)),
+                            sanitize(fetch(ny_idx)),
+                            sanitize(fetch(nz_idx)));
+                vert.normal = normal_txfm * n;
+            }
+        }
+
+        if constexpr (has_uv) {
+            if (has_uvs) {
+                // PLY texture coordinates have a bottom left origin
+                vert.uv = glm::vec2(sanitize(fetch(u_idx)),
+                                    1.f - sanitize(fetch(v_idx)));
+            }
+        }
+
+        return vert;
+    };
+
+    constexpr uint64_t min_vertices_per_thread = 1 << 16;
+
+    vertices.resize(elem.count);
+
+    if (header.format == Format::ASCII) {
+        vector<const char *> lines;
+        const char *next = indexLines(ptr, end, elem.count, lines,
+                                      scene_path);
+
+        uint32_t num_props = elem.properties.size();
+        parallelFor(elem.count, min_vertices_per_thread,
+                    [&](uint64_t begin, uint64_t end_idx) {
+            vector<double> values(num_props);
+            for (uint64_t vert_idx = begin; vert_idx < end_idx; vert_idx++) {
+                const char *line = lines[vert_idx];
+                const char *line_end = lines[vert_idx + 1];
+                for (uint32_t prop_idx = 0; prop_idx < num_props;
+                     prop_idx++) {
+                    line = readASCIIValue(line, line_end, &values[prop_idx]);
+                }
+
+                vertices[vert_idx] = convertVertex([&](int32_t prop_idx) {
+                    return float(values[prop_idx]);
+                });
+            }
+        });
+
+        return next;
+    }
+
+    bool swap = header.format == Format::BinaryBigEndian;
+    uint64_t stride = binaryRecordSize(elem);
+    uint64_t num_bytes = stride * elem.count;
+    if (num_bytes > uint64_t(end - ptr)) {
+        cerr << "PLY loading '" << scene_path
+             << "' failed: unexpected end of file" << endl;
+        abort();
+    }
+
+    vector<uint64_t> offsets;
+    offsets.reserve(elem.properties.size());
+    uint64_t cur_offset = 0;
+    for (const Property &prop : elem.properties) {
+        offsets.push_back(cur_offset);
+        cur_offset += propertySize(prop.type);
+    }
+
+    const uint8_t *base = reinterpret_cast<const uint8_t *>(ptr);
+    parallelFor(elem.count, min_vertices_per_thread,
+                [&](uint64_t begin, uint64_t end_idx) {
+        for (uint64_t vert_idx = begin; vert_idx < end_idx; vert_idx++) {
+            const uint8_t *record = base + vert_idx * stride;
+
+            vertices[vert_idx] = convertVertex([&](int32_t prop_idx) {
+                return float(readBinaryValue(record + offsets[prop_idx],
+                    elem.properties[prop_idx].type, swap));
+            });
+        }
+    });
+
+    return ptr + num_bytes;
+}
+
+// Faces are split into fixed size chunks so triangle output offsets can be
+// computed up front, then each chunk is triangulated independently
+static const char *plyReadFaces(const PLY::Header &header,
+                                const PLY::Element &elem,
+                                const char *ptr,
+                                const char *end,
+                                string_view scene_path,
+                                vector<uint32_t> &indices)
+{
+    using namespace PLY;
+
+    int32_t list_idx = findProperty(elem, {"vertex_indices", "vertex_index"});
+    if (list_idx == -1 || !elem.properties[list_idx].isList) {
+        cerr << "PLY loading '" << scene_path
+             << "' failed: faces missing vertex index list" << endl;
+        abort();
+    }
+    PropertyType index_type = elem.properties[list_idx].type;
+    uint32_t index_bytes = propertySize(index_type);
+
+    constexpr uint64_t faces_per_chunk = 1 << 16;
+    uint64_t num_chunks = (elem.count + faces_per_chunk - 1) / faces_per_chunk;
+
+    // Triangle offset of each chunk, filled with counts then prefix summed
+    vector<uint64_t> chunk_tri_offsets(num_chunks + 1, 0);
+
+    auto finalizeOffsets = [&]() {
+        uint64_t total_tris = 0;
+        for (uint64_t chunk_idx = 0; chunk_idx < num_chunks; chunk_idx++) {
+            uint64_t num_tris = chunk_tri_offsets[chunk_idx];
+            chunk_tri_offsets[chunk_idx] = total_tris;
+            total_tris += num_tris;
+        }
+        chunk_tri_offsets[num_chunks] = total_tris;
+
+        if (total_tris * 3 > uint64_t(~0u)) {
+            cerr << "PLY loading '" << scene_path
+                 << "' failed: too many triangles" << endl;
+            abort();
+        }
+
+        indices.resize(total_tris * 3);
+    };
+
+    if (header.format == Format::ASCII) {
+        vector<const char *> lines;
+        const char *next = indexLines(ptr, end, elem.count, lines,
+                                      scene_path);
+
+        auto chunkRange = [&](uint64_t chunk_idx) {
+            uint64_t begin = chunk_idx * faces_per_chunk;
+            return make_pair(begin, min(begin + faces_per_chunk, elem.count));
+        };
+
+        parallelFor(num_chunks, 1, [&](uint64_t begin, uint64_t end_idx) {
+            vector<uint32_t> polygon;
+            for (uint64_t chunk_idx = begin; chunk_idx < end_idx;
+                 chunk_idx++) {
+                auto [face_begin, face_end] = chunkRange(chunk_idx);
+                uint64_t num_tris = 0;
+                for (uint64_t face_idx = face_begin; face_idx < face_end;
+                     face_idx++) {
+                    parseASCIIRecord(lines[face_idx], lines[face_idx + 1],
+                                     elem, list_idx, polygon);
+                    num_tris += numFanTriangles(polygon.size());
+                }
+                chunk_tri_offsets[chunk_idx] = num_tris;
+            }
+        });
+
+        finalizeOffsets();
+
+        parallelFor(num_chunks, 1, [&](uint64_t begin, uint64_t end_idx) {
+            vector<uint32_t> polygon;
+            for (uint64_t chunk_idx = begin; chunk_idx < end_idx;
+                 chunk_idx++) {
+                auto [face_begin, face_end] = chunkRange(chunk_idx);
+                uint32_t *out =
+                    indices.data() + chunk_tri_offsets[chunk_idx] * 3;
+                for (uint64_t face_idx = face_begin; face_idx < face_end;
+                     face_idx++) {
+                    parseASCIIRecord(lines[face_idx], lines[face_idx + 1],
+                                     elem, list_idx, polygon);
+                    out = emitTriangleFan(out, polygon.size(),
+                        [&](uint64_t i) { return polygon[i]; });
+                }
+            }
+        });
+
+        return next;
+    }
+
+    bool swap = header.format == Format::BinaryBigEndian;
+    const uint8_t *cur = reinterpret_cast<const uint8_t *>(ptr);
+    const uint8_t *data_end = reinterpret_cast<const uint8_t *>(end);
+
+    // Binary face records are variable sized, so one sequential pass is
+    // needed to find where each chunk starts
+    vector<const uint8_t *> chunk_starts(num_chunks);
+    for (uint64_t face_idx = 0; face_idx < elem.count; face_idx++) {
+        uint64_t chunk_idx = face_idx / faces_per_chunk;
+        if (face_idx % faces_per_chunk == 0) {
+            chunk_starts[chunk_idx] = cur;
+        }
+
+        cur = walkBinaryRecord(cur, data_end, elem, list_idx, swap,
+                               scene_path,
+                               [&](const uint8_t *, uint64_t count) {
+            chunk_tri_offsets[chunk_idx] += numFanTriangles(count);
+        });
+    }
+
+    finalizeOffsets();
+
+    parallelFor(num_chunks, 1, [&](uint64_t begin, uint64_t end_idx) {
+        for (uint64_t chunk_idx = begin; chunk_idx < end_idx; chunk_idx++) {
+            uint64_t face_begin = chunk_idx * faces_per_chunk;
+            uint64_t face_end = min(face_begin + faces_per_chunk, elem.count);
+
+            const uint8_t *record = chunk_starts[chunk_idx];
+            uint32_t *out =
+                indices.data() + chunk_tri_offsets[chunk_idx] * 3;
+
+            for (uint64_t face_idx = face_begin; face_idx < face_end;
+                 face_idx++) {
+                record = walkBinaryRecord(record, data_end, elem, list_idx,
+                    swap, scene_path,
+                    [&](const uint8_t *list_ptr, uint64_t count) {
+                        out = emitTriangleFan(out, count, [&](uint64_t i) {
+                            return uint32_t(readBinaryValue(
+                                list_ptr + i * index_bytes, index_type, swap));
+                        });
+                    });
+            }
+        }
+    });
+
+    return reinterpret_cast<const char *>(cur);
+}
+
+static const char *plySkipElement(const PLY::Header &header,
+                                  const PLY::Element &elem,
+                                  const char *ptr,
+                                  const char *end,
+                                  string_view scene_path)
+{
+    using namespace PLY;
+
+    if (header.format == Format::ASCII) {
+        vector<const char *> lines;
+        return indexLines(ptr, end, elem.count, lines, scene_path);
+    }
+
+    if (!hasListProperty(elem)) {
+        uint64_t num_bytes = binaryRecordSize(elem) * elem.count;
+        if (num_bytes > uint64_t(end - ptr)) {
+            cerr << "PLY loading '" << scene_path
+                 << "' failed: unexpected end of file" << endl;
+            abort();
+        }
+
+        return ptr + num_bytes;
+    }
+
+    bool swap = header.format == Format::BinaryBigEndian;
+    const uint8_t *cur = reinterpret_cast<const uint8_t *>(ptr);
+    const uint8_t *data_end = reinterpret_cast<const uint8_t *>(end);
+    for (uint64_t i = 0; i < elem.count; i++) {
+        cur = walkBinaryRecord(cur, data_end, elem, -1, swap, scene_path,
+                               [](const uint8_t *, uint64_t) {});
+    }
+
+    return reinterpret_cast<const char *>(cur);
+}
+
+template <typename VertexType>
+static void plyComputeNormals(vector<VertexType> &vertices,
+                              const vector<uint32_t> &indices)
+{
+    for (auto &vert : vertices) {
+        vert.normal = glm::vec3(0.f);
+    }
+
+    // Unnormalized cross products weight by triangle area
+    for (uint64_t i = 0; i + 2 < indices.size(); i += 3) {
+        uint32_t a_idx = indices[i];
+        uint32_t b_idx = indices[i + 1];
+        uint32_t c_idx = indices[i + 2];
+
+        glm::vec3 a = vertices[a_idx].position;
+        glm::vec3 b = vertices[b_idx].position;
+        glm::vec3 c = vertices[c_idx].position;
+
+        glm::vec3 n = glm::cross(b - a, c - a);
+        vertices[a_idx].normal += n;
+        vertices[b_idx].normal += n;
+        vertices[c_idx].normal += n;
+    }
+
+    for (auto &vert : vertices) {
+        float len = glm::length(vert.normal);
+        vert.normal = len > 0.f ? vert.normal / len : glm::vec3(0.f, 1.f, 0.f);
+    }
+}
+
+template <typename VertexType, typename MaterialType>
+SceneDescription<VertexType, MaterialType> parsePLY(
+    filesystem::path scene_path, const glm::mat4 &base_txfm,
+    const TextureCallback &texture_cb)
+{
+    using namespace PLY;
+
+    MappedFile file(scene_path);
+    string_view file_view(reinterpret_cast<const char *>(file.data()),
+                          file.size());
+
+    size_t header_end = file_view.find("end_header");
+    size_t data_start = header_end == string_view::npos ?
+        string_view::npos : file_view.find('\n', header_end);
+    if (data_start == string_view::npos) {
+        cerr << "PLY loading '" << scene_path
+             << "' failed: missing end_header" << endl;
+        abort();
+    }
+    data_start += 1;
+
+    Header header = plyParseHeader(file_view.substr(0, header_end),
+                                   scene_path.string());
+
+    const char *cur = file_view.data() + data_start;
+    const char *end = file_view.data() + file_view.size();
+
+    vector<VertexType> vertices;
+    vector<uint32_t> indices;
+    bool has_normals = false;
+    bool found_vertices = false;
+    bool found_faces = false;
+
+    for (const Element &elem : header.elements) {
+        if (elem.name == "vertex") {
+            cur = plyReadVertices(header, elem, cur, end, base_txfm,
+                                  scene_path.string(), vertices, has_normals);
+            found_vertices = true;
+        } else if (elem.name == "face") {
+            cur = plyReadFaces(header, elem, cur, end, scene_path.string(),
+                               indices);
+            found_faces = true;
+        } else {
+            cur = plySkipElement(header, elem, cur, end, scene_path.string());
+        }
+    }
+
+    if (!found_vertices || !found_faces) {
+        cerr << "PLY loading '" << scene_path
+             << "' failed: vertex and face elements required" << endl;
+        abort();
+    }
+
+    for (uint64_t i = 0; i < indices.size(); i++) {
+        if (indices[i] >= vertices.size()) {
+            cerr << "PLY loading '" << scene_path << "' failed: face "
+                 << i / 3 << " references vertex " << indices[i]
+                 << " but only " << vertices.size() << " vertices exist"
+                 << endl;
+            abort();
+        }
+    }
+
+    if constexpr (HasNormal<VertexType>::value) {
+        if (!has_normals) {
+            plyComputeNormals(vertices, indices);
+        }
+    }
+
+    string scene_name = scene_path.stem();
+
+    string base_texture = "";
+    if (!header.textureFile.empty()) {
+        filesystem::path texture_path =
+            scene_path.parent_path() / header.textureFile;
+
+        MappedFile texture_file(texture_path);
+
+        base_texture = scene_name + "_" + texture_path.stem().string();
+        texture_cb(base_texture, texutil::TextureType::FourChannelSRGB,
+                   texture_file.data(), texture_file.size());
+    }
+
+    vector<MaterialType> materials;
+    materials.push_back({
+        scene_name,
+        base_texture,
+        "",
+        "",
+        "",
+        "",
+        "",
+        "",
+        "",
+        glm::vec3(1.f),
+        0.f,
+        glm::vec3(1.f),
+        1.f,
+        0.f,
+        1.f,
+        1.5f,
+        0.f,
+        0.f,
+        glm::vec3(1.f),
+        INFINITY,
+        0.f,
+        0.f,
+        glm::vec3(0.f),
+        true,
+        AlphaMode::Opaque,
+        0.5f,
+    });
+
+    Object<VertexType> obj {
+        scene_name,
+        {},
+    };
+    obj.meshes.push_back({
+        move(vertices),
+        move(indices),
+    });
+
+    vector<Object<VertexType>> objects;
+    objects.emplace_back(move(obj));
+
+    // base_txfm is already baked into the vertices
+    vector<InstanceProperties> instances;
+    instances.push_back({
+        scene_name,
+        0,
+        { 0 },
+        glm::vec3(0.f),
+        glm::quat(1.f, 0.f, 0.f, 0.f),
+        glm::vec3(1.f),
+        false,
+        false,
+    });
+
+    return SceneDescription<VertexType, MaterialType> {
+        move(objects),
+        move(materials),
+        move(instances),
+        {},
+    };
+}
+
+}
+}
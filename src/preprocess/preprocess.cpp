@@ -2,12 +2,14 @@
 #include <rlpbr/preprocess.hpp>
 #include <rlpbr_core/utils.hpp>
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <fstream>
 #include <vector>
-#include <unordered_set>
+#include <unordered_map>
 #include <thread>
+#include <tuple>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
@@ -22,6 +24,9 @@
 #include <meshoptimizer.h>
 #include <mikktspace.h>
 
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
 #include "import.hpp"
 #include "physics.hpp"
 #include "physics.inl"
@@ -38,19 +43,139 @@ struct PreprocessData {
     SceneDescription<Vertex, Material> desc;
     string dataDir;
     bool buildSDFs;
+    float chunkSize;
+    bool dumped;
+};
+
+struct TextureProcessingResults {
+    // Alpha classification of each processed 4 channel texture
+    unordered_map<string, AlphaMode> alphaModes;
+    // Texture name => name of an earlier texture with identical contents
+    unordered_map<string, string> duplicates;
 };
 
 struct TextureRequest {
     TextureRequest(DynArray<uint8_t> &&d, texutil::TextureType t,
-                   filesystem::path &&p)
-        : data(move(d)), type(t), outPath(move(p))
+                   filesystem::path &&p, string &&n)
+        : data(move(d)), type(t), outPath(move(p)), name(move(n))
     {}
 
     DynArray<uint8_t> data;
     texutil::TextureType type;
     filesystem::path outPath;
+    string name;
 };
 
+// Alpha values this close to 0 / 255 are treated as fully transparent /
+// opaque, to tolerate compression noise in masked textures
+static constexpr uint8_t alpha_classify_tolerance = 4;
+
+static AlphaMode classifyTextureAlpha(const uint8_t *data, uint64_t num_bytes)
+{
+    int width, height, num_channels;
+    uint8_t *pixels = stbi_load_from_memory(data, num_bytes,
+        &width, &height, &num_channels, 4);
+
+    if (pixels == nullptr) {
+        cerr << "Warning: failed to decode texture for alpha analysis" << endl;
+        return AlphaMode::Blended;
+    }
+
+    AlphaMode mode = AlphaMode::Opaque;
+    if (num_channels == 2 || num_channels == 4) {
+        uint64_t num_pixels = uint64_t(width) * uint64_t(height);
+        for (uint64_t i = 0; i < num_pixels; i++) {
+            uint8_t alpha = pixels[i * 4 + 3];
+
+            if (alpha >= 255 - alpha_classify_tolerance) {
+                continue;
+            } else if (alpha <= alpha_classify_tolerance) {
+                mode = AlphaMode::Masked;
+            } else {
+                mode = AlphaMode::Blended;
+                break;
+            }
+        }
+    }
+
+    stbi_image_free(pixels);
+
+    return mode;
+}
+
+// MurmurHash3 x64_128, strong enough for content to be identified by
+// hash and size alone
+static pair<uint64_t, uint64_t> hashContent(const uint8_t *data,
+                                            uint64_t num_bytes)
+{
+    constexpr uint64_t c1 = 0x87c37b91114253d5ull;
+    constexpr uint64_t c2 = 0x4cf5ad432745937full;
+
+    auto rotl = [](uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    };
+
+    auto fmix = [](uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdull;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ull;
+        k ^= k >> 33;
+        return k;
+    };
+
+    uint64_t h1 = 0, h2 = 0;
+
+    uint64_t num_blocks = num_bytes / 16;
+    for (uint64_t i = 0; i < num_blocks; i++) {
+        uint64_t k1, k2;
+        memcpy(&k1, data + i * 16, sizeof(uint64_t));
+        memcpy(&k2, data + i * 16 + 8, sizeof(uint64_t));
+
+        k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    const uint8_t *tail = data + num_blocks * 16;
+    uint64_t k1 = 0, k2 = 0;
+    switch (num_bytes & 15) {
+        case 15: k2 ^= uint64_t(tail[14]) << 48; [[fallthrough]];
+        case 14: k2 ^= uint64_t(tail[13]) << 40; [[fallthrough]];
+        case 13: k2 ^= uint64_t(tail[12]) << 32; [[fallthrough]];
+        case 12: k2 ^= uint64_t(tail[11]) << 24; [[fallthrough]];
+        case 11: k2 ^= uint64_t(tail[10]) << 16; [[fallthrough]];
+        case 10: k2 ^= uint64_t(tail[9]) << 8; [[fallthrough]];
+        case 9:
+            k2 ^= uint64_t(tail[8]);
+            k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+            [[fallthrough]];
+        case 8: k1 ^= uint64_t(tail[7]) << 56; [[fallthrough]];
+        case 7: k1 ^= uint64_t(tail[6]) << 48; [[fallthrough]];
+        case 6: k1 ^= uint64_t(tail[5]) << 40; [[fallthrough]];
+        case 5: k1 ^= uint64_t(tail[4]) << 32; [[fallthrough]];
+        case 4: k1 ^= uint64_t(tail[3]) << 24; [[fallthrough]];
+        case 3: k1 ^= uint64_t(tail[2]) << 16; [[fallthrough]];
+        case 2: k1 ^= uint64_t(tail[1]) << 8; [[fallthrough]];
+        case 1:
+            k1 ^= uint64_t(tail[0]);
+            k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= num_bytes;
+    h2 ^= num_bytes;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix(h1);
+    h2 = fmix(h2);
+    h1 += h2;
+    h2 += h1;
+
+    return { h1, h2 };
+}
+
 class TextureProcessor {
 public:
     TextureProcessor(const char *output_dir)
@@ -74,6 +199,14 @@ public:
     }
 
     ~TextureProcessor()
+    {
+        if (workers_.size() > 0) {
+            finish();
+        }
+    }
+
+    // Drains the queue and returns per texture results, keyed by name
+    TextureProcessingResults finish()
     {
         {
             unique_lock<mutex> lock(mutex_);
@@ -84,6 +217,12 @@ public:
         for (auto &t : workers_) {
             t.join();
         }
+        workers_.clear();
+
+        return {
+            move(alpha_modes_),
+            move(duplicates_),
+        };
     }
 
     void queueTexture(string_view texture_name,
@@ -91,6 +230,27 @@ public:
                       const uint8_t *data,
                       uint64_t num_bytes)
     {
+        // Identical images are frequently embedded under different names
+        // when merging multiple glTFs. Only the first copy is processed.
+        // Only called from the parsing thread, so no lock is needed here.
+        // Source bytes aren't retained, so matches go by a 128 bit hash.
+        auto [hash_lo, hash_hi] = hashContent(data, num_bytes);
+        ContentKey content_key {
+            hash_lo,
+            hash_hi,
+            num_bytes,
+            type,
+        };
+
+        auto [iter, inserted] =
+            unique_contents_.emplace(content_key, texture_name);
+        if (!inserted) {
+            if (iter->second != texture_name) {
+                duplicates_.emplace(texture_name, iter->second);
+            }
+            return;
+        }
+
         auto out_path = output_dir_ / texture_name;
         out_path += ".tex";
 
@@ -104,7 +264,8 @@ public:
                 queue_wait_.wait(lock);
             } 
 
-            requests_.emplace_back(move(data_stage), type, move(out_path));
+            requests_.emplace_back(move(data_stage), type, move(out_path),
+                                   string(texture_name));
         }
 
         worker_wait_.notify_one();
@@ -141,6 +302,14 @@ public:
                 return;
             }
 
+            if (request->type == texutil::TextureType::FourChannelSRGB) {
+                AlphaMode alpha_mode = classifyTextureAlpha(
+                    request->data.data(), request->data.size());
+
+                unique_lock<mutex> lock(mutex_);
+                alpha_modes_.emplace(move(request->name), alpha_mode);
+            }
+
             texutil::generateMips(request->outPath.c_str(),
                                   request->type,
                                   request->data.data(),
@@ -158,6 +327,31 @@ private:
 
     vector<thread> workers_;
     vector<TextureRequest> requests_;
+    unordered_map<string, AlphaMode> alpha_modes_;
+
+    struct ContentKey {
+        uint64_t hashLo;
+        uint64_t hashHi;
+        uint64_t numBytes;
+        texutil::TextureType type;
+
+        bool operator==(const ContentKey &o) const
+        {
+            return hashLo == o.hashLo && hashHi == o.hashHi &&
+                numBytes == o.numBytes && type == o.type;
+        }
+    };
+
+    struct ContentKeyHash {
+        size_t operator()(const ContentKey &key) const
+        {
+            return key.hashLo;
+        }
+    };
+
+    // Content => name of the first texture with that content
+    unordered_map<ContentKey, string, ContentKeyHash> unique_contents_;
+    unordered_map<string, string> duplicates_;
 };
 
 
@@ -180,7 +374,8 @@ static PreprocessData parseSceneData(string_view scene_path,
                                      const glm::mat4 &base_txfm,
                                      optional<string_view> data_dir,
                                      bool process_textures,
-                                     bool build_sdfs)
+                                     bool build_sdfs,
+                                     float chunk_size)
 {
     string serialized_data_dir;
     if (!data_dir.has_value()) {
@@ -198,10 +393,63 @@ static PreprocessData parseSceneData(string_view scene_path,
     auto scene_desc = SceneDescription<Vertex, Material>::parseScene(
         scene_path, base_txfm, texture_cb);
 
+    auto texture_results = tex_processor.finish();
+
+    auto dedupTexture = [&](string &tex_name) {
+        auto iter = texture_results.duplicates.find(tex_name);
+        if (iter != texture_results.duplicates.end()) {
+            tex_name = iter->second;
+        }
+    };
+
+    for (Material &material : scene_desc.materials) {
+        dedupTexture(material.baseColorTexture);
+        dedupTexture(material.metallicRoughnessTexture);
+        dedupTexture(material.specularTexture);
+        dedupTexture(material.normalMapTexture);
+        dedupTexture(material.emittanceTexture);
+        dedupTexture(material.transmissionTexture);
+        dedupTexture(material.clearcoatTexture);
+        dedupTexture(material.anisoTexture);
+    }
+
+    if (texture_results.duplicates.size() > 0) {
+        cout << "Removed " << texture_results.duplicates.size()
+             << " duplicate textures" << endl;
+    }
+
+    // Materials keep their declared mode unless the base texture is more
+    // opaque. Base textures that weren't analyzed (external or unprocessed
+    // textures) keep the declared mode.
+    uint32_t num_unknown_alpha = 0;
+    for (Material &material : scene_desc.materials) {
+        if (material.baseColorTexture.empty()) {
+            material.alphaMode = AlphaMode::Opaque;
+            continue;
+        }
+
+        auto iter =
+            texture_results.alphaModes.find(material.baseColorTexture);
+        if (iter == texture_results.alphaModes.end()) {
+            if (material.alphaMode != AlphaMode::Opaque) {
+                num_unknown_alpha++;
+            }
+        } else {
+            material.alphaMode = min(material.alphaMode, iter->second);
+        }
+    }
+
+    if (num_unknown_alpha > 0) {
+        cout << num_unknown_alpha << " materials with unanalyzed base "
+             << "textures keep their declared alpha mode" << endl;
+    }
+
     return PreprocessData {
         move(scene_desc),
         serialized_data_dir,
         build_sdfs,
+        chunk_size,
+        false,
     };
 }
 
@@ -209,9 +457,10 @@ ScenePreprocessor::ScenePreprocessor(string_view gltf_path,
                                      const glm::mat4 &base_txfm,
                                      optional<string_view> data_dir,
                                      bool process_textures,
-                                     bool build_sdfs)
+                                     bool build_sdfs,
+                                     float chunk_size)
     : scene_data_(new PreprocessData(parseSceneData(gltf_path,
-        base_txfm, data_dir, process_textures, build_sdfs)))
+        base_txfm, data_dir, process_textures, build_sdfs, chunk_size)))
 {}
 
 template <typename VertexType>
@@ -490,82 +739,24 @@ processObject(const Object<VertexType> &orig_obj)
 
 template <typename VertexType, typename MaterialType>
 static tuple<ProcessedGeometry<PackedVertex>,
-            vector<unordered_map<glm::vec3, uint32_t>>,
+            vector<uint32_t>,
             vector<vector<uint32_t>>>
-processGeometry(const vector<Object<VertexType>> &orig_objects,
-                const vector<unordered_set<glm::vec3>> &obj_scales)
+processGeometry(vector<Object<VertexType>> &&orig_objects)
 {
-    vector<Object<PackedVertex>> processed_objects;
     // For each processed object, a list of the object's removed mesh indices
     vector<vector<uint32_t>> removed_meshes;
 
-    vector<unordered_map<glm::vec3, uint32_t>> obj_id_remap(orig_objects.size());
-    {
-        vector<Object<VertexType>> scaled_objects;
-
-        // Map from scaled object to orig + scale
-        vector<pair<uint32_t, glm::vec3>> reverse_scale_map;
-
-        // Bake scales
-        for (int obj_idx = 0; obj_idx < (int)orig_objects.size(); obj_idx++) {
-            const auto &scales = obj_scales[obj_idx];
-            auto &obj = orig_objects[obj_idx];
-
-            if (scales.empty()) { // This is a not currently instanced object
-                scaled_objects.emplace_back(move(obj));
-                reverse_scale_map.emplace_back(obj_idx, glm::vec3(1.f));
-            } else {
-                int scale_idx = 0;
-                for (const glm::vec3 &scale : scales) {
-                    Object<VertexType> scaled_obj;
-                    scaled_obj.name = obj.name + "_" + to_string(scale_idx);
-                    for (const auto &mesh : obj.meshes) {
-                        Mesh<VertexType> scaled_mesh;
-                        for (const VertexType &vert : mesh.vertices) {
-                            VertexType new_vert = vert;
-                            new_vert.position *= scale;
-                            new_vert.normal *= 1.f / scale;
-                            new_vert.normal = normalize(new_vert.normal);
-                            scaled_mesh.vertices.push_back(new_vert);
-                        }
-                        scaled_mesh.indices = mesh.indices;
-
-                        scaled_obj.meshes.emplace_back(move(scaled_mesh));
-                    }
-                    scaled_objects.emplace_back(move(scaled_obj));
-                    reverse_scale_map.emplace_back(obj_idx, scale);
-
-                    scale_idx++;
-                }
-            }
-        }
-
-        // Process objects, potentially culling degenerate objects
-        vector<pair<uint32_t, glm::vec3>> culled_reverse_map;
-        culled_reverse_map.reserve(reverse_scale_map.size());
-
-        for (int scaled_idx = 0; scaled_idx < (int)scaled_objects.size();
-             scaled_idx++) {
-            const auto &orig_obj = scaled_objects[scaled_idx];
-            auto processed = processObject<VertexType>(orig_obj);
-
-            if (processed.has_value()) {
-                auto &[obj, removed] = *processed;
-                processed_objects.emplace_back(move(obj));
-                removed_meshes.emplace_back(move(removed));
-
-                const auto &[orig_id, scale] = reverse_scale_map[scaled_idx];
-                culled_reverse_map.emplace_back(orig_id, scale);
-            } 
-        }
-        assert(processed_objects.size() > 0);
-
-        // Build obj_id_remap
-        for (int processed_idx = 0;
-             processed_idx < (int)processed_objects.size();
-             processed_idx++) {
-            const auto &[orig_id, scale] = culled_reverse_map[processed_idx];
-            obj_id_remap[orig_id].emplace(scale, processed_idx);
+    // Original object index => processed object index, ~0u if culled.
+    // Instance scale is kept in the instance transform rather than baked
+    // into per-scale copies of the geometry
+    vector<uint32_t> obj_id_remap(orig_objects.size(), ~0u);
+
+    // Processing never adds indices, so the source index count bounds the
+    // final index buffer
+    uint64_t max_num_indices = 0;
+    for (const auto &obj : orig_objects) {
+        for (const auto &mesh : obj.meshes) {
+            max_num_indices += mesh.indices.size();
         }
     }
 
@@ -574,26 +765,51 @@ processGeometry(const vector<Object<VertexType>> &orig_objects,
     vector<MeshInfo> mesh_infos;
     vector<ObjectInfo> obj_infos;
     vector<string> obj_names;
+    indices.reserve(max_num_indices);
+
+    // Objects are streamed into the combined buffers one at a time, and
+    // both the source and processed copies are released immediately, so
+    // only a single object is ever held twice
+    for (int obj_idx = 0; obj_idx < (int)orig_objects.size(); obj_idx++) {
+        auto processed = processObject<VertexType>(orig_objects[obj_idx]);
+        orig_objects[obj_idx] = Object<VertexType>();
+
+        // Cull degenerate objects
+        if (!processed.has_value()) continue;
+
+        auto &[obj, removed] = *processed;
+        obj_id_remap[obj_idx] = obj_infos.size();
+        removed_meshes.emplace_back(move(removed));
 
-    for (auto &obj : processed_objects) {
         uint32_t mesh_offset = mesh_infos.size();
+        uint64_t obj_vertex_offset = vertices.size();
         for (auto &mesh : obj.meshes) {
+            // Indices are relative to the object's first vertex until
+            // partitionGeometry, so only objects are limited to 2^32
+            uint64_t mesh_vertex_offset = vertices.size() - obj_vertex_offset;
+            if (mesh_vertex_offset + mesh.vertices.size() > uint64_t(~0u)) {
+                cerr << "Object " << obj.name << " has too many vertices"
+                     << endl;
+                abort();
+            }
+
             mesh_infos.push_back(MeshInfo {
-                uint32_t(indices.size()),
+                uint64_t(indices.size()),
                 uint32_t(mesh.indices.size() / 3),
-                uint32_t(mesh.vertices.size())
+                uint32_t(mesh.vertices.size()),
+                AlphaMode::Opaque,
+                0,
+                0,
             });
 
-            // Rewrite indices to refer to the global vertex array
-            // (Note this only really matters for RT to allow gl_CustomIndexEXT
-            // to simply hold the base index of a mesh)
             for (uint32_t idx : mesh.indices) {
-                indices.push_back(idx + vertices.size());
+                indices.push_back(idx + mesh_vertex_offset);
             }
 
-            for (const auto &vert : mesh.vertices) {
-                vertices.push_back(vert);
-            }
+            vertices.insert(vertices.end(), mesh.vertices.begin(),
+                            mesh.vertices.end());
+
+            mesh = Mesh<PackedVertex>();
         }
 
         obj_infos.push_back({
@@ -617,9 +833,42 @@ processGeometry(const vector<Object<VertexType>> &orig_objects,
     };
 }
 
+// Objects' vertices are stored contiguously in object order, so each
+// object's base vertex is the running total of its predecessors' vertices
+static vector<uint64_t> objectVertexOffsets(
+    const ProcessedGeometry<PackedVertex> &geo)
+{
+    vector<uint64_t> offsets;
+    offsets.reserve(geo.objectInfos.size());
+
+    uint64_t cur_offset = 0;
+    for (const ObjectInfo &obj : geo.objectInfos) {
+        offsets.push_back(cur_offset);
+        for (uint32_t mesh_idx = obj.meshIndex;
+             mesh_idx < obj.meshIndex + obj.numMeshes; mesh_idx++) {
+            cur_offset += geo.meshInfos[mesh_idx].numVertices;
+        }
+    }
+
+    return offsets;
+}
+
 template <typename VertexType, typename MaterialType>
-SceneDescription<VertexType, MaterialType> mergeStaticInstances(
-    const SceneDescription<VertexType, MaterialType> &orig_desc)
+struct MergedScene {
+    SceneDescription<VertexType, MaterialType> desc;
+    // Static geometry merged per chunk cell. Kept apart from desc so chunks
+    // can be placed after everything else in the scene.
+    SceneDescription<VertexType, MaterialType> chunkDesc;
+    // Chunk of each chunkDesc object
+    vector<uint32_t> chunkIDs;
+};
+
+// chunk_size > 0 merges static instances per grid cell of that size
+// instead of into a single object
+template <typename VertexType, typename MaterialType>
+MergedScene<VertexType, MaterialType> mergeStaticInstances(
+    SceneDescription<VertexType, MaterialType> &&orig_desc,
+    float chunk_size)
 {
     using SceneDesc = SceneDescription<VertexType, MaterialType>;
     constexpr int duplication_threshold = 4;
@@ -627,6 +876,13 @@ SceneDescription<VertexType, MaterialType> mergeStaticInstances(
     SceneDesc static_transparent_desc;
     SceneDesc new_desc;
 
+    struct ChunkCell {
+        SceneDesc opaque;
+        SceneDesc transparent;
+    };
+    vector<ChunkCell> chunk_cells;
+    unordered_map<glm::i32vec3, uint32_t> chunk_cell_ids;
+
     vector<uint32_t> static_object_usage(orig_desc.objects.size());
 
     for (const auto &inst : orig_desc.defaultInstances) {
@@ -635,33 +891,93 @@ SceneDescription<VertexType, MaterialType> mergeStaticInstances(
         } 
     }
 
-    vector<uint32_t> obj_remap(orig_desc.objects.size(), ~0u);
-    vector<bool> obj_merged(orig_desc.objects.size(), false);
+    auto isMerged = [&](const InstanceProperties &inst) {
+        return !inst.dynamic &&
+            static_object_usage[inst.objectIndex] < duplication_threshold;
+    };
+
+    // Instances are binned by the world space center of their bounds
+    auto chunkCell = [&](const InstanceProperties &inst) {
+        glm::vec3 obj_min(INFINITY);
+        glm::vec3 obj_max(-INFINITY);
+        for (const auto &mesh : orig_desc.objects[inst.objectIndex].meshes) {
+            for (const auto &vert : mesh.vertices) {
+                obj_min = glm::min(obj_min, vert.position);
+                obj_max = glm::max(obj_max, vert.position);
+            }
+        }
+
+        if (obj_min.x > obj_max.x) {
+            return glm::i32vec3(0);
+        }
+
+        glm::mat4 txfm = glm::translate(inst.position) *
+            glm::mat4_cast(inst.rotation) * glm::scale(inst.scale);
+        glm::vec3 center = txfm * glm::vec4((obj_min + obj_max) / 2.f, 1.f);
+
+        return glm::i32vec3(glm::floor(center / chunk_size));
+    };
 
+    // Every merged instance bakes its own copy of the object, everything
+    // else shares one copy. Only the final user moves the source object.
+    vector<uint32_t> remaining_uses(orig_desc.objects.size(), 0);
+    vector<bool> needs_shared(orig_desc.objects.size(), false);
     for (const auto &inst : orig_desc.defaultInstances) {
-        if (!inst.dynamic &&
-            static_object_usage[inst.objectIndex] < duplication_threshold) {
-            if (inst.transparent) {
-                static_transparent_desc.objects.push_back(
-                    orig_desc.objects[inst.objectIndex]);
-                static_transparent_desc.defaultInstances.push_back(inst);
-                static_transparent_desc.defaultInstances.back().objectIndex =
-                    static_transparent_desc.objects.size() - 1;
+        if (isMerged(inst)) {
+            remaining_uses[inst.objectIndex]++;
+        } else {
+            needs_shared[inst.objectIndex] = true;
+        }
+    }
+
+    for (int obj_idx = 0; obj_idx < (int)orig_desc.objects.size();
+         obj_idx++) {
+        if (needs_shared[obj_idx] || remaining_uses[obj_idx] == 0) {
+            remaining_uses[obj_idx]++;
+        }
+    }
+
+    auto takeObject = [&](uint32_t obj_idx) {
+        if (--remaining_uses[obj_idx] == 0) {
+            return move(orig_desc.objects[obj_idx]);
+        } else {
+            return Object<VertexType>(orig_desc.objects[obj_idx]);
+        }
+    };
+
+    vector<uint32_t> obj_remap(orig_desc.objects.size(), ~0u);
+
+    for (auto &inst : orig_desc.defaultInstances) {
+        if (isMerged(inst)) {
+            SceneDesc *merge_desc;
+            if (chunk_size > 0.f) {
+                auto [cell_iter, new_cell] = chunk_cell_ids.emplace(
+                    chunkCell(inst), chunk_cells.size());
+                if (new_cell) {
+                    chunk_cells.emplace_back();
+                }
+
+                ChunkCell &cell = chunk_cells[cell_iter->second];
+                merge_desc = inst.transparent ? &cell.transparent :
+                    &cell.opaque;
             } else {
-                static_desc.objects.push_back(orig_desc.objects[inst.objectIndex]);
-                static_desc.defaultInstances.push_back(inst);
-                static_desc.defaultInstances.back().objectIndex =
-                    static_desc.objects.size() - 1;
+                merge_desc = inst.transparent ? &static_transparent_desc :
+                    &static_desc;
             }
-            obj_merged[inst.objectIndex] = true;
+
+            merge_desc->objects.emplace_back(takeObject(inst.objectIndex));
+            merge_desc->defaultInstances.push_back(move(inst));
+            merge_desc->defaultInstances.back().objectIndex =
+                merge_desc->objects.size() - 1;
         } else {
-            uint32_t remapped = obj_remap[inst.objectIndex];
-            new_desc.defaultInstances.push_back(inst);
+            uint32_t orig_obj_idx = inst.objectIndex;
+            uint32_t remapped = obj_remap[orig_obj_idx];
+            new_desc.defaultInstances.push_back(move(inst));
             if (remapped == ~0u) {
-                new_desc.objects.push_back(orig_desc.objects[inst.objectIndex]);
+                new_desc.objects.emplace_back(takeObject(orig_obj_idx));
                 uint32_t new_idx = new_desc.objects.size() - 1;
                 new_desc.defaultInstances.back().objectIndex = new_idx;
-                obj_remap[inst.objectIndex] = new_idx;
+                obj_remap[orig_obj_idx] = new_idx;
             } else {
                 new_desc.defaultInstances.back().objectIndex = remapped;
             }
@@ -671,50 +987,73 @@ SceneDescription<VertexType, MaterialType> mergeStaticInstances(
     // Include non instanced objects
     for (int orig_obj_idx = 0; orig_obj_idx < (int)orig_desc.objects.size();
          orig_obj_idx++) {
-        if (obj_remap[orig_obj_idx] == ~0u && !obj_merged[orig_obj_idx]) {
-            new_desc.objects.push_back(orig_desc.objects[orig_obj_idx]);
+        if (remaining_uses[orig_obj_idx] > 0) {
+            new_desc.objects.emplace_back(takeObject(orig_obj_idx));
         }
     }
+    orig_desc.objects.clear();
+
+    auto appendMerged = [](SceneDesc &&merge_desc, const string &name,
+                           bool transparent, SceneDesc &dst) {
+        if (merge_desc.defaultInstances.size() == 0) {
+            return false;
+        }
 
-    if (static_desc.defaultInstances.size() > 0) {
-        auto [static_obj, static_mat_ids] = SceneDesc::mergeScene(static_desc, 0);
-        static_obj.name = "static_opaque_merged";
+        auto [merged_obj, merged_mat_ids] =
+            SceneDesc::mergeScene(move(merge_desc), 0);
+        merged_obj.name = name;
 
-        new_desc.objects.emplace_back(move(static_obj));
-        new_desc.defaultInstances.push_back({
-            "static_opaque_merged",
-            uint32_t(new_desc.objects.size() - 1),
-            move(static_mat_ids),
+        dst.objects.emplace_back(move(merged_obj));
+        dst.defaultInstances.push_back({
+            name,
+            uint32_t(dst.objects.size() - 1),
+            move(merged_mat_ids),
             glm::vec3(0.f),
             glm::quat(1.f, 0.f, 0.f, 0.f),
             glm::vec3(1.f),
             false,
-            false,
+            transparent,
         });
-    }
 
-    if (static_transparent_desc.defaultInstances.size() > 0) {
-        auto [static_transparent_obj, static_transparent_mat_ids] =
-            SceneDesc::mergeScene(static_transparent_desc, 0);
-        static_transparent_obj.name = "static_transparent_merged";
+        return true;
+    };
 
-        new_desc.objects.emplace_back(move(static_transparent_obj));
-        new_desc.defaultInstances.push_back({
-            "static_transparent_merged",
-            uint32_t(new_desc.objects.size() - 1),
-            move(static_transparent_mat_ids),
-            glm::vec3(0.f),
-            glm::quat(1.f, 0.f, 0.f, 0.f),
-            glm::vec3(1.f),
-            false,
-            true,
-        });
+    appendMerged(move(static_desc), "static_opaque_merged", false,
+                 new_desc);
+    appendMerged(move(static_transparent_desc), "static_transparent_merged",
+                 true, new_desc);
+
+    SceneDesc chunk_desc;
+    vector<uint32_t> chunk_ids;
+    for (uint32_t chunk_idx = 0; chunk_idx < chunk_cells.size();
+         chunk_idx++) {
+        ChunkCell &cell = chunk_cells[chunk_idx];
+        string name = "static_chunk_" + to_string(chunk_idx);
+
+        if (appendMerged(move(cell.opaque), name + "_opaque", false,
+                         chunk_desc)) {
+            chunk_ids.push_back(chunk_idx);
+        }
+
+        if (appendMerged(move(cell.transparent), name + "_transparent", true,
+                         chunk_desc)) {
+            chunk_ids.push_back(chunk_idx);
+        }
+    }
+
+    if (chunk_cells.size() > 0) {
+        cout << "Static geometry split into " << chunk_cells.size()
+             << " chunks" << endl;
     }
 
-    new_desc.materials = orig_desc.materials;
-    new_desc.defaultLights = orig_desc.defaultLights;
+    new_desc.materials = move(orig_desc.materials);
+    new_desc.defaultLights = move(orig_desc.defaultLights);
 
-    return new_desc;
+    return MergedScene<VertexType, MaterialType> {
+        move(new_desc),
+        move(chunk_desc),
+        move(chunk_ids),
+    };
 }
 
 static vector<LightProperties> processLights(
@@ -752,6 +1091,8 @@ static vector<LightProperties> processLights(
         0.f,
         glm::vec3(100.f, 90.f, 90.f),
         false,
+        AlphaMode::Opaque,
+        0.5f,
     });
 
     auto addLight = [&](glm::vec3 *verts, glm::vec3 translate) {
@@ -780,19 +1121,23 @@ static vector<LightProperties> processLights(
              glm::vec2(0.f),
          });
 
-         uint32_t idx_offset = geo.indices.size();
-         geo.indices.push_back(geo.vertices.size() - 3);
-         geo.indices.push_back(geo.vertices.size() - 1);
-         geo.indices.push_back(geo.vertices.size() - 2);
+         // Each light is its own object, so its indices start at 0
+         uint64_t idx_offset = geo.indices.size();
+         geo.indices.push_back(1);
+         geo.indices.push_back(3);
+         geo.indices.push_back(2);
 
-         geo.indices.push_back(geo.vertices.size() - 3);
-         geo.indices.push_back(geo.vertices.size() - 2);
-         geo.indices.push_back(geo.vertices.size() - 4);
+         geo.indices.push_back(1);
+         geo.indices.push_back(2);
+         geo.indices.push_back(0);
 
          geo.meshInfos.push_back(MeshInfo {
              idx_offset,
              2,
              4,
+             AlphaMode::Opaque,
+             0,
+             0,
          });
 
          string name = 
@@ -819,6 +1164,7 @@ static vector<LightProperties> processLights(
          tri_light.type = LightType::Triangle;
          tri_light.triIdxOffset = idx_offset;
          tri_light.triMatIdx = materials.size() - 1;
+         tri_light.triBlockIdx = 0;
 
          lights.push_back(tri_light);
 
@@ -1023,42 +1369,29 @@ struct ProcessedScene {
     ProcessedGeometry<PackedVertex> geometry;
     vector<InstanceProperties> instances;
     AABB bbox;
+    // Appended to the scene by appendChunks once lights have been added
+    ProcessedGeometry<PackedVertex> chunkGeometry;
+    vector<InstanceProperties> chunkInstances;
+    vector<uint32_t> chunkIDs;
 };
 
-template <typename VertexType, typename MaterialType>
-static ProcessedScene
-processScene(const SceneDescription<VertexType, MaterialType> &orig_desc)
+static void remapInstances(
+    const vector<InstanceProperties> &instances,
+    const vector<uint32_t> &obj_remap,
+    const vector<vector<uint32_t>> &removed_meshes,
+    vector<InstanceProperties> &new_insts)
 {
-    SceneDescription<VertexType, MaterialType> desc =
-        mergeStaticInstances(orig_desc);
-    
-    vector<unordered_set<glm::vec3>> obj_scales(desc.objects.size());
-
-    for (const auto &inst : desc.defaultInstances) {
-        obj_scales[inst.objectIndex].emplace(inst.scale);
-    }
-
-    auto [geometry, obj_remap, removed_meshes] =
-        processGeometry<VertexType, MaterialType>(desc.objects, obj_scales);
-
-    vector<InstanceProperties> new_insts;
-    for (const auto &inst : desc.defaultInstances) {
-        if (obj_remap[inst.objectIndex].empty()) continue;
-
-        auto iter = obj_remap[inst.objectIndex].find(inst.scale);
-        string new_name = inst.name;
-        if (inst.scale != glm::vec3(1.f)) {
-            new_name += "_" + to_string(inst.scale.x) + "_" +
-                to_string(inst.scale.y) + "_" + to_string(inst.scale.z);
-        }
+    for (const auto &inst : instances) {
+        uint32_t new_obj_idx = obj_remap[inst.objectIndex];
+        if (new_obj_idx == ~0u) continue;
 
         InstanceProperties new_inst {
-            move(new_name),
-            iter->second,
+            inst.name,
+            new_obj_idx,
             {},
             inst.position,
             inst.rotation,
-            glm::vec3(1.f),
+            inst.scale,
             inst.dynamic,
             inst.transparent,
         };
@@ -1084,6 +1417,48 @@ processScene(const SceneDescription<VertexType, MaterialType> &orig_desc)
 
         new_insts.emplace_back(new_inst);
     }
+}
+
+template <typename VertexType, typename MaterialType>
+static ProcessedScene
+processScene(SceneDescription<VertexType, MaterialType> &&orig_desc,
+             float chunk_size)
+{
+    auto [desc, chunk_desc, chunk_obj_ids] =
+        mergeStaticInstances(move(orig_desc), chunk_size);
+    
+    auto [geometry, obj_remap, removed_meshes] =
+        processGeometry<VertexType, MaterialType>(move(desc.objects));
+
+    vector<InstanceProperties> new_insts;
+    remapInstances(desc.defaultInstances, obj_remap, removed_meshes,
+                   new_insts);
+
+    ProcessedGeometry<PackedVertex> chunk_geometry {};
+    vector<InstanceProperties> chunk_insts;
+    vector<uint32_t> chunk_ids;
+    if (chunk_desc.objects.size() > 0) {
+        auto [processed_chunks, chunk_remap, chunk_removed_meshes] =
+            processGeometry<VertexType, MaterialType>(
+                move(chunk_desc.objects));
+
+        remapInstances(chunk_desc.defaultInstances, chunk_remap,
+                       chunk_removed_meshes, chunk_insts);
+
+        for (uint32_t obj_idx = 0; obj_idx < chunk_remap.size(); obj_idx++) {
+            if (chunk_remap[obj_idx] != ~0u) {
+                chunk_ids.push_back(chunk_obj_ids[obj_idx]);
+            }
+        }
+
+        chunk_geometry = move(processed_chunks);
+    }
+
+    if (geometry.objectInfos.size() + chunk_geometry.objectInfos.size() ==
+            0) {
+        cerr << "Scene has no geometry" << endl;
+        abort();
+    }
 
     AABB bbox {
         glm::vec3(INFINITY, INFINITY, INFINITY),
@@ -1095,50 +1470,141 @@ processScene(const SceneDescription<VertexType, MaterialType> &orig_desc)
         bbox.pMax = glm::max(bbox.pMax, point);
     };
 
-    for (int inst_idx = 0; inst_idx < (int)new_insts.size(); inst_idx++) {
-        const InstanceProperties &inst = new_insts[inst_idx];
+    auto addInstanceBounds = [&](const ProcessedGeometry<PackedVertex> &geo,
+                                 const vector<InstanceProperties> &insts) {
+        vector<uint64_t> obj_vertex_offsets = objectVertexOffsets(geo);
 
-        const ObjectInfo &obj = geometry.objectInfos[inst.objectIndex];
-        for (int mesh_offset = 0; mesh_offset < (int)obj.numMeshes;
-             mesh_offset++) {
-            uint32_t mesh_idx = obj.meshIndex + mesh_offset;
-            const MeshInfo &mesh = geometry.meshInfos[mesh_idx];
+        for (int inst_idx = 0; inst_idx < (int)insts.size(); inst_idx++) {
+            const InstanceProperties &inst = insts[inst_idx];
+
+            const ObjectInfo &obj = geo.objectInfos[inst.objectIndex];
+            const PackedVertex *obj_vertices =
+                geo.vertices.data() + obj_vertex_offsets[inst.objectIndex];
+            for (int mesh_offset = 0; mesh_offset < (int)obj.numMeshes;
+                 mesh_offset++) {
+                uint32_t mesh_idx = obj.meshIndex + mesh_offset;
+                const MeshInfo &mesh = geo.meshInfos[mesh_idx];
 
-            for (int tri_idx = 0; tri_idx < (int)mesh.numTriangles;
-                 tri_idx++) {
-                uint32_t base_idx = tri_idx * 3 + mesh.indexOffset;
+                for (int tri_idx = 0; tri_idx < (int)mesh.numTriangles;
+                     tri_idx++) {
+                    uint64_t base_idx = tri_idx * 3 + mesh.indexOffset;
 
-                glm::u32vec3 tri_indices(geometry.indices[base_idx],
-                                         geometry.indices[base_idx + 1],
-                                         geometry.indices[base_idx + 2]);
+                    glm::u32vec3 tri_indices(geo.indices[base_idx],
+                                             geo.indices[base_idx + 1],
+                                             geo.indices[base_idx + 2]);
 
-                auto a = geometry.vertices[tri_indices.x].position;
-                auto b = geometry.vertices[tri_indices.y].position;
-                auto c = geometry.vertices[tri_indices.z].position;
+                    auto a = obj_vertices[tri_indices.x].position;
+                    auto b = obj_vertices[tri_indices.y].position;
+                    auto c = obj_vertices[tri_indices.z].position;
 
-                // FIXME remove redundant calculation
-                glm::mat4 rot_mat = glm::mat4_cast(inst.rotation);
-                glm::mat4 txfm = glm::translate(inst.position) *
-                    rot_mat;
+                    // FIXME remove redundant calculation
+                    glm::mat4 rot_mat = glm::mat4_cast(inst.rotation);
+                    glm::mat4 txfm = glm::translate(inst.position) *
+                        rot_mat * glm::scale(inst.scale);
 
-                a = txfm * glm::vec4(a, 1.f);
-                b = txfm * glm::vec4(b, 1.f);
-                c = txfm * glm::vec4(c, 1.f);
+                    a = txfm * glm::vec4(a, 1.f);
+                    b = txfm * glm::vec4(b, 1.f);
+                    c = txfm * glm::vec4(c, 1.f);
 
-                updateBounds(a);
-                updateBounds(b);
-                updateBounds(c);
+                    updateBounds(a);
+                    updateBounds(b);
+                    updateBounds(c);
+                }
             }
         }
-    }
+    };
+
+    addInstanceBounds(geometry, new_insts);
+    addInstanceBounds(chunk_geometry, chunk_insts);
 
     return {
         move(geometry),
         move(new_insts),
         bbox,
+        move(chunk_geometry),
+        move(chunk_insts),
+        move(chunk_ids),
     };
 }
 
+// Moves the chunk geometry to the end of the scene, after any lights
+// added since processScene. Block ranges are filled in by
+// partitionGeometry.
+static vector<SceneChunk> appendChunks(
+    ProcessedGeometry<PackedVertex> &geo,
+    vector<InstanceProperties> &instances,
+    ProcessedGeometry<PackedVertex> &&chunk_geo,
+    vector<InstanceProperties> &&chunk_instances,
+    const vector<uint32_t> &chunk_ids)
+{
+    uint64_t base_index = geo.indices.size();
+    uint32_t base_mesh = geo.meshInfos.size();
+    uint32_t base_object = geo.objectInfos.size();
+
+    vector<uint64_t> obj_vertex_offsets = objectVertexOffsets(chunk_geo);
+
+    vector<SceneChunk> chunks;
+    for (uint32_t obj_idx = 0; obj_idx < chunk_geo.objectInfos.size();
+         obj_idx++) {
+        if (obj_idx == 0 || chunk_ids[obj_idx] != chunk_ids[obj_idx - 1]) {
+            chunks.push_back({
+                {
+                    glm::vec3(INFINITY, INFINITY, INFINITY),
+                    glm::vec3(-INFINITY, -INFINITY, -INFINITY),
+                },
+                base_object + obj_idx,
+                0,
+                0,
+                0,
+            });
+        }
+
+        SceneChunk &chunk = chunks.back();
+        chunk.numObjects++;
+
+        // Chunk instances use the identity transform
+        const ObjectInfo &obj = chunk_geo.objectInfos[obj_idx];
+        const PackedVertex *obj_vertices =
+            chunk_geo.vertices.data() + obj_vertex_offsets[obj_idx];
+        for (uint32_t mesh_idx = obj.meshIndex;
+             mesh_idx < obj.meshIndex + obj.numMeshes; mesh_idx++) {
+            const MeshInfo &mesh = chunk_geo.meshInfos[mesh_idx];
+            for (uint64_t i = 0; i < uint64_t(mesh.numTriangles) * 3; i++) {
+                const glm::vec3 &pos = obj_vertices[
+                    chunk_geo.indices[mesh.indexOffset + i]].position;
+                chunk.bounds.pMin = glm::min(chunk.bounds.pMin, pos);
+                chunk.bounds.pMax = glm::max(chunk.bounds.pMax, pos);
+            }
+        }
+    }
+
+    geo.indices.insert(geo.indices.end(), chunk_geo.indices.begin(),
+                       chunk_geo.indices.end());
+    geo.vertices.insert(geo.vertices.end(), chunk_geo.vertices.begin(),
+                        chunk_geo.vertices.end());
+
+    for (MeshInfo mesh : chunk_geo.meshInfos) {
+        mesh.indexOffset += base_index;
+        geo.meshInfos.push_back(mesh);
+    }
+
+    for (ObjectInfo obj : chunk_geo.objectInfos) {
+        obj.meshIndex += base_mesh;
+        geo.objectInfos.push_back(obj);
+    }
+
+    for (string &name : chunk_geo.objectNames) {
+        geo.objectNames.emplace_back(move(name));
+    }
+
+    for (InstanceProperties &inst : chunk_instances) {
+        inst.objectIndex += base_object;
+        instances.emplace_back(move(inst));
+    }
+
+    return chunks;
+}
+
 static MaterialMetadata stageMaterials(const vector<Material> &materials,
                                        const string &texture_dir)
 {
@@ -1163,13 +1629,15 @@ static MaterialMetadata stageMaterials(const vector<Material> &materials,
     vector<string> transmission_textures;
     vector<string> clearcoat_textures;
     vector<string> aniso_textures;
-    unordered_map<string, size_t> tracker;
+    // Separate per list, the same texture can be used in multiple slots
+    unordered_map<const vector<string> *,
+                  unordered_map<string, size_t>> trackers;
 
     auto mapTexName = [&](const string &orig_tex, vector<string> &tex_list) {
         string new_name = orig_tex.substr(0, orig_tex.rfind(".")) +
             string(".tex");
         auto [iter, inserted] =
-            tracker.emplace(new_name, tex_list.size());
+            trackers[&tex_list].emplace(new_name, tex_list.size());
 
         if (inserted) {
             tex_list.emplace_back(new_name);
@@ -1246,14 +1714,26 @@ static MaterialMetadata stageMaterials(const vector<Material> &materials,
             mat_flags |= uint16_t(MaterialFlags::ThinWalled);
         }
 
+        if (material.alphaMode == AlphaMode::Masked) {
+            mat_flags |= uint16_t(MaterialFlags::AlphaMasked);
+        } else if (material.alphaMode == AlphaMode::Blended) {
+            mat_flags |= uint16_t(MaterialFlags::AlphaBlended);
+        }
+
         float offset_ior = material.ior - 1;
         uint8_t packed_ior = uint8_t(roundf(offset_ior * 170.f));
 
+        // Simple materials use the default 0.5 cutoff
+        uint8_t packed_cutoff = glm::packUnorm1x8(material.alphaCutoff);
+        bool custom_cutoff = material.alphaMode == AlphaMode::Masked &&
+            packed_cutoff != glm::packUnorm1x8(0.5f);
+
         if (material.clearcoat != 0.f ||
             material.attenuationColor != glm::vec3(0.f) ||
             material.attenuationDistance != 0.f ||
             material.anisoScale != 0.f ||
-            material.baseEmittance != glm::vec3(0.f)) {
+            material.baseEmittance != glm::vec3(0.f) ||
+            custom_cutoff) {
             mat_flags |= uint16_t(MaterialFlags::Complex);
         }
 
@@ -1274,6 +1754,7 @@ static MaterialMetadata stageMaterials(const vector<Material> &materials,
             packNonlinearUnormVec3(material.attenuationColor),
             glm::packUnorm1x8(material.anisoScale),
             glm::packUnorm1x8(material.anisoRotation),
+            packed_cutoff,
             glm::packHalf1x16(material.attenuationDistance),
             glm::u16vec3(
                 glm::packHalf1x16(material.baseEmittance.r),
@@ -1310,10 +1791,269 @@ static MaterialMetadata stageMaterials(const vector<Material> &materials,
     };
 }
 
+// A mesh is only as opaque as the least opaque material any default instance
+// assigns to it. Meshes never referenced by a default instance may get
+// arbitrary materials at runtime, so they keep full alpha handling.
+static void classifyMeshAlpha(ProcessedGeometry<PackedVertex> &geo,
+                              const vector<InstanceProperties> &insts,
+                              const vector<Material> &materials)
+{
+    vector<bool> mesh_referenced(geo.meshInfos.size(), false);
+    for (MeshInfo &mesh : geo.meshInfos) {
+        mesh.alphaMode = AlphaMode::Opaque;
+    }
+
+    for (const InstanceProperties &inst : insts) {
+        const ObjectInfo &obj = geo.objectInfos[inst.objectIndex];
+
+        for (int mesh_offset = 0; mesh_offset < (int)obj.numMeshes;
+             mesh_offset++) {
+            uint32_t mesh_idx = obj.meshIndex + mesh_offset;
+            MeshInfo &mesh = geo.meshInfos[mesh_idx];
+            mesh_referenced[mesh_idx] = true;
+
+            AlphaMode mat_mode = AlphaMode::Blended;
+            if (mesh_offset < (int)inst.materials.size()) {
+                mat_mode = materials[inst.materials[mesh_offset]].alphaMode;
+            }
+
+            mesh.alphaMode = max(mesh.alphaMode, mat_mode);
+        }
+    }
+
+    uint32_t num_opaque = 0;
+    for (int mesh_idx = 0; mesh_idx < (int)geo.meshInfos.size(); mesh_idx++) {
+        MeshInfo &mesh = geo.meshInfos[mesh_idx];
+        if (!mesh_referenced[mesh_idx]) {
+            mesh.alphaMode = AlphaMode::Blended;
+        }
+
+        if (mesh.alphaMode == AlphaMode::Opaque) {
+            num_opaque++;
+        }
+    }
+
+    cout << num_opaque << " / " << geo.meshInfos.size()
+         << " meshes fully opaque" << endl;
+}
+
+struct GeometryRange {
+    uint64_t vertexStart;
+    uint64_t numVertices;
+    uint64_t indexStart;
+    uint64_t numIndices;
+};
+
+// Splits geometry into blocks that fit in a single device buffer, rewriting
+// object relative indices and mesh index offsets to be block relative.
+// Meshes never straddle blocks; a mesh over the size limit gets a block to
+// itself. Must run after anything that still expects object relative
+// indices (physics).
+// Every chunk starts a new block, and the blocks of each chunk are
+// recorded in it.
+static vector<GeometryRange> partitionGeometry(
+    ProcessedGeometry<PackedVertex> &geo,
+    vector<LightProperties> &lights,
+    vector<SceneChunk> &chunks)
+{
+    constexpr uint64_t max_block_vertices = uint64_t(~0u) + 1;
+    constexpr uint64_t vertex_bytes = sizeof(PackedVertex);
+    constexpr uint64_t index_bytes = sizeof(uint32_t);
+
+    vector<uint64_t> orig_index_offsets;
+    orig_index_offsets.reserve(geo.meshInfos.size());
+
+    vector<uint8_t> starts_object(geo.meshInfos.size(), 0);
+    for (const ObjectInfo &obj : geo.objectInfos) {
+        starts_object[obj.meshIndex] = 1;
+    }
+
+    vector<uint8_t> starts_chunk(geo.meshInfos.size(), 0);
+    for (const SceneChunk &chunk : chunks) {
+        starts_chunk[geo.objectInfos[chunk.objectOffset].meshIndex] = 1;
+    }
+
+    vector<GeometryRange> blocks;
+    GeometryRange cur_block {0, 0, 0, 0};
+
+    uint64_t cur_vertex_offset = 0;
+    uint64_t obj_vertex_offset = 0;
+    for (uint32_t mesh_idx = 0; mesh_idx < geo.meshInfos.size();
+         mesh_idx++) {
+        MeshInfo &mesh = geo.meshInfos[mesh_idx];
+        if (starts_object[mesh_idx]) {
+            obj_vertex_offset = cur_vertex_offset;
+        }
+
+        uint64_t num_mesh_indices = uint64_t(mesh.numTriangles) * 3;
+
+        uint64_t cur_bytes = cur_block.numVertices * vertex_bytes +
+            cur_block.numIndices * index_bytes;
+        uint64_t mesh_bytes = uint64_t(mesh.numVertices) * vertex_bytes +
+            num_mesh_indices * index_bytes;
+
+        bool block_full =
+            cur_block.numVertices + mesh.numVertices > max_block_vertices ||
+            cur_bytes + mesh_bytes > GeometryBlockConfig::maxBlockBytes;
+
+        if ((block_full || starts_chunk[mesh_idx]) &&
+                cur_block.numVertices > 0) {
+            blocks.push_back(cur_block);
+            cur_block = {
+                cur_vertex_offset,
+                0,
+                mesh.indexOffset,
+                0,
+            };
+        }
+
+        // Objects may straddle blocks, but each mesh only references its
+        // own vertices, so the rebased indices always fit the block
+        for (uint64_t i = 0; i < num_mesh_indices; i++) {
+            uint32_t &idx = geo.indices[mesh.indexOffset + i];
+            idx = uint32_t(obj_vertex_offset + idx - cur_block.vertexStart);
+        }
+
+        orig_index_offsets.push_back(mesh.indexOffset);
+
+        mesh.indexOffset -= cur_block.indexStart;
+        mesh.blockIndex = blocks.size();
+
+        cur_block.numVertices += mesh.numVertices;
+        cur_block.numIndices += num_mesh_indices;
+        cur_vertex_offset += mesh.numVertices;
+    }
+    blocks.push_back(cur_block);
+
+    // The scene metadata shares the final block's buffer, so it can't
+    // belong to a chunk
+    if (chunks.size() > 0) {
+        blocks.push_back({
+            cur_vertex_offset,
+            0,
+            geo.indices.size(),
+            0,
+        });
+    }
+
+    for (SceneChunk &chunk : chunks) {
+        const ObjectInfo &first_obj = geo.objectInfos[chunk.objectOffset];
+        const ObjectInfo &last_obj =
+            geo.objectInfos[chunk.objectOffset + chunk.numObjects - 1];
+
+        chunk.blockOffset = geo.meshInfos[first_obj.meshIndex].blockIndex;
+        chunk.numBlocks = geo.meshInfos[last_obj.meshIndex +
+            last_obj.numMeshes - 1].blockIndex - chunk.blockOffset + 1;
+    }
+
+    for (LightProperties &light : lights) {
+        if (light.type != LightType::Triangle) continue;
+
+        auto iter = upper_bound(orig_index_offsets.begin(),
+                                orig_index_offsets.end(),
+                                uint64_t(light.triIdxOffset));
+        const MeshInfo &mesh =
+            geo.meshInfos[iter - orig_index_offsets.begin() - 1];
+
+        light.triIdxOffset = light.triIdxOffset - *(iter - 1) +
+            mesh.indexOffset;
+        light.triBlockIdx = mesh.blockIndex;
+    }
+
+    if (blocks.size() > 1) {
+        cout << "Geometry split into " << blocks.size() << " blocks" << endl;
+    }
+
+    return blocks;
+}
+
+static string materialTextureKey(const Material &material)
+{
+    string key;
+
+    auto appendName = [&](const string &name) {
+        key.append(name);
+        key.push_back('\0');
+    };
+
+    appendName(material.baseColorTexture);
+    appendName(material.metallicRoughnessTexture);
+    appendName(material.specularTexture);
+    appendName(material.normalMapTexture);
+    appendName(material.emittanceTexture);
+    appendName(material.transmissionTexture);
+    appendName(material.clearcoatTexture);
+    appendName(material.anisoTexture);
+
+    return key;
+}
+
+// Compares values rather than bytes, so 0 and -0 match and NaNs never do
+static bool sameMaterialParams(const Material &a, const Material &b)
+{
+    return a.baseColor == b.baseColor &&
+        a.baseTransmission == b.baseTransmission &&
+        a.baseSpecular == b.baseSpecular &&
+        a.specularScale == b.specularScale &&
+        a.baseMetallic == b.baseMetallic &&
+        a.baseRoughness == b.baseRoughness &&
+        a.ior == b.ior &&
+        a.clearcoat == b.clearcoat &&
+        a.clearcoatRoughness == b.clearcoatRoughness &&
+        a.attenuationColor == b.attenuationColor &&
+        a.attenuationDistance == b.attenuationDistance &&
+        a.anisoScale == b.anisoScale &&
+        a.anisoRotation == b.anisoRotation &&
+        a.baseEmittance == b.baseEmittance &&
+        a.thinwalled == b.thinwalled &&
+        a.alphaMode == b.alphaMode &&
+        a.alphaCutoff == b.alphaCutoff;
+}
+
+// Collapses materials that only differ by name. Returns the
+// original => deduplicated index remapping.
+static vector<uint32_t> dedupMaterials(vector<Material> &materials)
+{
+    // Materials sharing textures, as indices into new_materials
+    unordered_map<string, vector<uint32_t>> texture_groups;
+    vector<Material> new_materials;
+    vector<uint32_t> remap;
+    remap.reserve(materials.size());
+
+    for (Material &material : materials) {
+        vector<uint32_t> &candidates =
+            texture_groups[materialTextureKey(material)];
+
+        auto match = find_if(candidates.begin(), candidates.end(),
+            [&](uint32_t mat_idx) {
+                return sameMaterialParams(new_materials[mat_idx], material);
+            });
+
+        if (match != candidates.end()) {
+            remap.push_back(*match);
+            continue;
+        }
+
+        candidates.push_back(new_materials.size());
+        remap.push_back(new_materials.size());
+        new_materials.emplace_back(move(material));
+    }
+
+    if (new_materials.size() < materials.size()) {
+        cout << "Removed " << materials.size() - new_materials.size()
+             << " duplicate materials" << endl;
+    }
+
+    materials = move(new_materials);
+
+    return remap;
+}
+
 static void dumpIDMap(string_view scene_path_base,
                       const ProcessedGeometry<PackedVertex> &geo,
                       const vector<InstanceProperties> &insts,
-                      const vector<Material> &materials)
+                      const vector<string> &material_names,
+                      const vector<uint32_t> &material_remap)
 {
     ofstream out(string(scene_path_base) + "_ids.json");
     string_view tab = "    ";
@@ -1342,11 +2082,12 @@ static void dumpIDMap(string_view scene_path_base,
 
     out << tab << "},\n";
 
+    // All original names are kept, duplicates map to the shared index
     out << tab << "\"materials\": {\n";
-    for (int mat_idx = 0; mat_idx < (int)materials.size(); mat_idx++) {
-        out << tab << tab << "\"" << materials[mat_idx].name <<
-            "\": " << mat_idx;
-        if (mat_idx != (int)materials.size() - 1) {
+    for (int mat_idx = 0; mat_idx < (int)material_names.size(); mat_idx++) {
+        out << tab << tab << "\"" << material_names[mat_idx] <<
+            "\": " << material_remap[mat_idx];
+        if (mat_idx != (int)material_names.size() - 1) {
             out << ",";
         }
         out << "\n";
@@ -1359,17 +2100,55 @@ static void dumpIDMap(string_view scene_path_base,
 
 void ScenePreprocessor::dump(string_view out_path_name)
 {
-    auto [processed_geometry, processed_instances, default_bbox] =
-        processScene(scene_data_->desc);
+    // The source scene is consumed here: meshes are released as soon as
+    // they have been appended to the combined geometry buffers
+    if (scene_data_->dumped) {
+        cerr << "ScenePreprocessor::dump can only be called once" << endl;
+        abort();
+    }
+    scene_data_->dumped = true;
 
     vector<Material> materials = scene_data_->desc.materials;
+    vector<LightProperties> default_lights = scene_data_->desc.defaultLights;
+
+    auto [processed_geometry, processed_instances, default_bbox,
+          chunk_geometry, chunk_instances, chunk_ids] =
+        processScene(move(scene_data_->desc), scene_data_->chunkSize);
 
     auto lights_path =
         filesystem::path(out_path_name).replace_extension("lights");
-    auto processed_lights = processLights(scene_data_->desc.defaultLights,
+    auto processed_lights = processLights(default_lights,
         processed_geometry, processed_instances, materials, default_bbox,
         lights_path);
 
+    vector<SceneChunk> chunks = appendChunks(processed_geometry,
+        processed_instances, move(chunk_geometry), move(chunk_instances),
+        chunk_ids);
+
+    vector<string> material_names;
+    material_names.reserve(materials.size());
+    for (const Material &material : materials) {
+        material_names.push_back(material.name);
+    }
+
+    vector<uint32_t> material_remap = dedupMaterials(materials);
+
+    for (InstanceProperties &inst : processed_instances) {
+        for (uint32_t &mat_idx : inst.materials) {
+            mat_idx = material_remap[mat_idx];
+        }
+    }
+
+    for (LightProperties &light : processed_lights) {
+        if (light.type == LightType::Triangle) {
+            light.triMatIdx = material_remap[light.triMatIdx];
+        } else if (light.type == LightType::Sphere) {
+            light.sphereMatIdx = material_remap[light.sphereMatIdx];
+        }
+    }
+
+    classifyMeshAlpha(processed_geometry, processed_instances, materials);
+
     auto processed_physics_state =
         ProcessedPhysicsState::make(processed_geometry, !scene_data_->buildSDFs);
 
@@ -1377,7 +2156,11 @@ void ScenePreprocessor::dump(string_view out_path_name)
     string basename = out_path;
     basename.resize(basename.rfind('.'));
 
-    dumpIDMap(basename, processed_geometry, processed_instances, materials);
+    dumpIDMap(basename, processed_geometry, processed_instances,
+              material_names, material_remap);
+
+    vector<GeometryRange> geometry_blocks =
+        partitionGeometry(processed_geometry, processed_lights, chunks);
 
     ofstream out(out_path, ios::binary);
     if (!out.is_open()) {
@@ -1404,53 +2187,76 @@ void ScenePreprocessor::dump(string_view out_path_name)
     };
 
     auto make_staging_header = [&](const auto &geometry,
+                                   const vector<GeometryRange> &block_ranges,
                                    const MaterialMetadata &material_metadata) {
 
         constexpr uint64_t vertex_size =
             sizeof(typename decltype(geometry.vertices)::value_type);
-        uint64_t vertex_bytes = vertex_size * geometry.vertices.size();
-        uint64_t index_bytes = sizeof(uint32_t) * geometry.indices.size();
 
         StagingHeader hdr;
         hdr.numMeshes = geometry.meshInfos.size();
         hdr.numObjects = geometry.objectInfos.size();
+        hdr.numMaterials = material_metadata.materialParams.size();
+        hdr.numBlocks = block_ranges.size();
         hdr.numVertices = geometry.vertices.size();
         hdr.numIndices = geometry.indices.size();
 
-        hdr.numMaterials = material_metadata.materialParams.size();
+        vector<GeometryBlock> blocks;
+        blocks.reserve(block_ranges.size());
 
-        hdr.indexOffset = align_offset(vertex_bytes);
-        hdr.meshOffset = align_offset(hdr.indexOffset + index_bytes);
+        uint64_t cur_offset = 0;
+        for (const GeometryRange &range : block_ranges) {
+            GeometryBlock block;
+            block.vertexOffset = cur_offset;
+            block.indexOffset = align_offset(
+                cur_offset + vertex_size * range.numVertices);
+            block.numVertices = range.numVertices;
+            block.numIndices = range.numIndices;
+
+            cur_offset = align_offset(
+                block.indexOffset + sizeof(uint32_t) * range.numIndices);
+
+            blocks.push_back(block);
+        }
+
+        hdr.meshOffset = cur_offset;
         hdr.objectOffset = align_offset(hdr.meshOffset + sizeof(MeshInfo) *
                                         hdr.numMeshes);
         hdr.materialOffset = align_offset(hdr.objectOffset +
             sizeof(ObjectInfo) * hdr.numObjects);
         hdr.physicsOffset = align_offset(hdr.materialOffset +
             sizeof(MaterialParams) * hdr.numMaterials);
+        hdr.blockAddrOffset = align_offset(hdr.physicsOffset +
+            sizeof(PhysicsObject) * hdr.numObjects);
 
         hdr.totalBytes =
-            hdr.physicsOffset + hdr.numObjects * sizeof(PhysicsObject);
+            hdr.blockAddrOffset + hdr.numBlocks * 2 * sizeof(uint64_t);
 
-        return hdr;
+        return make_pair(hdr, move(blocks));
     };
 
     auto write_staging = [&](const auto &geometry,
+                             const vector<GeometryRange> &block_ranges,
                              const MaterialMetadata &materials,
                              const ProcessedPhysicsState &physics_state,
                              const StagingHeader &hdr) {
         write_pad(256);
 
         auto stage_beginning = out.tellp();
-        // Write all vertices
+
         constexpr uint64_t vertex_size =
             sizeof(typename decltype(geometry.vertices)::value_type);
-        out.write(reinterpret_cast<const char *>(geometry.vertices.data()),
-                  vertex_size * geometry.vertices.size());
-
-        write_pad(256);
-        // Write all indices
-        out.write(reinterpret_cast<const char *>(geometry.indices.data()),
-                  geometry.indices.size() * sizeof(uint32_t));
+        for (const GeometryRange &range : block_ranges) {
+            write_pad(256);
+            out.write(reinterpret_cast<const char *>(
+                    geometry.vertices.data() + range.vertexStart),
+                vertex_size * range.numVertices);
+
+            write_pad(256);
+            out.write(reinterpret_cast<const char *>(
+                    geometry.indices.data() + range.indexStart),
+                sizeof(uint32_t) * range.numIndices);
+        }
 
         write_pad(256);
         out.write(reinterpret_cast<const char *>(geometry.meshInfos.data()),
@@ -1470,6 +2276,12 @@ void ScenePreprocessor::dump(string_view out_path_name)
         out.write(reinterpret_cast<const char *>(physics_state.objects.data()),
                   sizeof(PhysicsObject) * physics_state.objects.size());
 
+        write_pad(256);
+        for (int i = 0; i < (int)block_ranges.size(); i++) {
+            write(uint64_t(0));
+            write(uint64_t(0));
+        }
+
         assert(out.tellp() == int64_t(hdr.totalBytes + stage_beginning));
     };
 
@@ -1557,6 +2369,7 @@ void ScenePreprocessor::dump(string_view out_path_name)
                 dynamic_transforms.push_back({
                     inst_props.position,
                     inst_props.rotation,
+                    inst_props.scale,
                 });
             } else {
                 static_instances.push_back({
@@ -1567,9 +2380,11 @@ void ScenePreprocessor::dump(string_view out_path_name)
 
             glm::mat4 rot_mat = glm::mat4_cast(inst_props.rotation);
 
-            glm::mat4 txfm = glm::translate(inst_props.position) *  rot_mat;
+            glm::mat4 txfm = glm::translate(inst_props.position) *  rot_mat *
+                glm::scale(inst_props.scale);
 
-            glm::mat4 inv = glm::transpose(rot_mat) * 
+            glm::mat4 inv = glm::scale(1.f / inst_props.scale) *
+                glm::transpose(rot_mat) *
                 glm::translate(-inst_props.position);
 
             glm::mat4x3 reduced(txfm);
@@ -1631,6 +2446,12 @@ void ScenePreprocessor::dump(string_view out_path_name)
         }
     };
 
+    auto write_chunks = [&](const vector<SceneChunk> &chunk_table) {
+        write(uint32_t(chunk_table.size()));
+        out.write(reinterpret_cast<const char *>(chunk_table.data()),
+                  sizeof(SceneChunk) * chunk_table.size());
+    };
+
     auto write_objects = [&](const auto &geometry) {
         // Write mesh infos
         out.write(reinterpret_cast<const char *>(geometry.meshInfos.data()),
@@ -1651,8 +2472,12 @@ void ScenePreprocessor::dump(string_view out_path_name)
         auto material_metadata =
             stageMaterials(materials, data_dir);
 
-        StagingHeader hdr = make_staging_header(geometry, material_metadata);
+        auto [hdr, blocks] =
+            make_staging_header(geometry, geometry_blocks, material_metadata);
         write(hdr);
+        for (const GeometryBlock &block : blocks) {
+            write(block);
+        }
         write_pad();
 
         write_objects(geometry);
@@ -1665,12 +2490,14 @@ void ScenePreprocessor::dump(string_view out_path_name)
 
         write_sdfs(processed_physics_state, data_dir, scene_data_->buildSDFs);
 
-        write_staging(geometry, material_metadata, processed_physics_state,
-                      hdr);
+        write_chunks(chunks);
+
+        write_staging(geometry, geometry_blocks, material_metadata,
+                      processed_physics_state, hdr);
     };
 
-    // Header: magic
-    write(uint32_t(0x55555555));
+    // Header: magic, bumped whenever the serialized layout changes
+    write(uint32_t(0x55555556));
     write_scene(processed_geometry, processed_instances, default_bbox,
                 processed_lights, materials, scene_data_->dataDir);
     out.close();
@@ -1,5 +1,6 @@
 #include <rlpbr.hpp>
 #include <rlpbr_core/common.hpp>
+#include <rlpbr_core/rng.hpp>
 #include <rlpbr_core/scene.hpp>
 #include <rlpbr_core/utils.hpp>
 
@@ -9,9 +10,9 @@
 
 #include "vulkan/render.hpp"
 
+#include <algorithm>
 #include <functional>
 #include <iostream>
-#include <random>
 
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/transform.hpp>
@@ -20,16 +21,89 @@ using namespace std;
 
 namespace RLpbr {
 
+static InstanceTransform rigidTransform(const glm::vec3 &position,
+                                        const glm::quat &rotation)
+{
+    glm::mat4 rot_matrix = glm::mat4_cast(rotation);
+
+    return InstanceTransform {
+        glm::translate(position) * rot_matrix,
+        glm::transpose(rot_matrix) * glm::translate(-position),
+    };
+}
+
+// Written out directly rather than through generic mat4 products:
+// inv = scale(1 / s) * transpose(R) * translate(-p)
+static InstanceTransform scaledTransform(const glm::vec3 &position,
+                                         const glm::quat &rotation,
+                                         const glm::vec3 &scale)
+{
+    glm::mat3 rot = glm::mat3_cast(rotation);
+    glm::vec3 inv_scale = 1.f / scale;
+
+    InstanceTransform txfm;
+    txfm.mat[0] = rot[0] * scale.x;
+    txfm.mat[1] = rot[1] * scale.y;
+    txfm.mat[2] = rot[2] * scale.z;
+    txfm.mat[3] = position;
+
+    glm::mat3 inv_rot = glm::transpose(rot);
+    txfm.inv[0] = inv_rot[0] * inv_scale;
+    txfm.inv[1] = inv_rot[1] * inv_scale;
+    txfm.inv[2] = inv_rot[2] * inv_scale;
+    txfm.inv[3] = -(position.x * txfm.inv[0] + position.y * txfm.inv[1] +
+                    position.z * txfm.inv[2]);
+
+    return txfm;
+}
+
+// parent * child
+static InstanceTransform composeTransforms(const InstanceTransform &parent,
+                                           const InstanceTransform &child)
+{
+    return InstanceTransform {
+        glm::mat4(parent.mat) * glm::mat4(child.mat),
+        glm::mat4(child.inv) * glm::mat4(parent.inv),
+    };
+}
+
+// inverse(parent) * child, using the inverse stored with parent
+static InstanceTransform relativeTransform(const InstanceTransform &parent,
+                                           const InstanceTransform &child)
+{
+    return InstanceTransform {
+        glm::mat4(parent.inv) * glm::mat4(child.mat),
+        glm::mat4(child.inv) * glm::mat4(parent.mat),
+    };
+}
+
 AssetLoader::AssetLoader(LoaderImpl &&backend)
     : backend_(move(backend))
 {}
 
-shared_ptr<Scene> AssetLoader::loadScene(string_view scene_path)
+shared_ptr<Scene> AssetLoader::loadObjectLibrary(string_view library_path)
+{
+    shared_ptr<Scene> library = loadScene(library_path);
+
+    if (library->objectInfo.size() > ObjectInstance::libraryFlag) {
+        cerr << "loadObjectLibrary: too many objects in " << library_path
+             << endl;
+        abort();
+    }
+
+    return library;
+}
+
+shared_ptr<Scene> AssetLoader::loadScene(string_view scene_path,
+                                         const shared_ptr<Scene> &library)
 {
     SceneLoadData load_data =
         SceneLoadData::loadFromDisk(scene_path);
 
-    return backend_.loadScene(move(load_data));
+    shared_ptr<Scene> scene = backend_.loadScene(move(load_data));
+    scene->objectLibrary = library;
+
+    return scene;
 }
 
 
@@ -77,16 +151,20 @@ static RendererImpl makeBackend(const RenderConfig &cfg)
     abort();
 }
 
-static bool gRandomizeMaterials;
-
 Renderer::Renderer(const RenderConfig &cfg)
     : backend_(makeBackend(cfg)),
       aspect_ratio_(float(cfg.imgWidth) / float(cfg.imgHeight)),
-      batch_size_(cfg.batchSize)
-{
-    // hack hack hack
-    gRandomizeMaterials = cfg.flags & RenderFlags::RandomizeMaterials;
-}
+      batch_size_(cfg.batchSize),
+      default_settings_ {
+          cfg.imgWidth,
+          cfg.imgHeight,
+          cfg.spp,
+          cfg.maxDepth,
+      },
+      next_rng_stream_(0),
+      random_seed_(cfg.randomSeed),
+      randomize_materials_(cfg.flags & RenderFlags::RandomizeMaterials)
+{}
 
 AssetLoader Renderer::makeLoader()
 {
@@ -98,7 +176,8 @@ Environment Renderer::makeEnvironment(const shared_ptr<Scene> &scene)
     Camera cam(glm::vec3(0.f), glm::vec3(0.f, 0.f, 1.f),
                glm::vec3(0.f, 1.f, 0.f), 90.f, aspect_ratio_);
 
-    Environment env(backend_.makeEnvironment(scene, cam), scene, cam);
+    Environment env(backend_.makeEnvironment(scene, cam), scene, cam,
+                    next_rng_stream_++, random_seed_, randomize_materials_);
 
     return env;
 }
@@ -111,7 +190,9 @@ Environment Renderer::makeEnvironment(const shared_ptr<Scene> &scene,
     Camera cam(eye, target, up, vertical_fov,
                aspect_ratio == 0.f ? aspect_ratio_ : aspect_ratio);
 
-    return Environment(backend_.makeEnvironment(scene, cam), scene, cam);
+    return Environment(backend_.makeEnvironment(scene, cam), scene, cam,
+                       next_rng_stream_++, random_seed_,
+                       randomize_materials_);
 }
 
 Environment Renderer::makeEnvironment(const shared_ptr<Scene> &scene,
@@ -121,7 +202,9 @@ Environment Renderer::makeEnvironment(const shared_ptr<Scene> &scene,
     Camera cam(camera_to_world, vertical_fov, 
                aspect_ratio == 0.f ? aspect_ratio_ : aspect_ratio);
 
-    return Environment(backend_.makeEnvironment(scene, cam), scene, cam);
+    return Environment(backend_.makeEnvironment(scene, cam), scene, cam,
+                       next_rng_stream_++, random_seed_,
+                       randomize_materials_);
 }
 
 Environment Renderer::makeEnvironment(const std::shared_ptr<Scene> &scene,
@@ -134,7 +217,9 @@ Environment Renderer::makeEnvironment(const std::shared_ptr<Scene> &scene,
     Camera cam(pos, fwd, up, right, vertical_fov,
                aspect_ratio == 0.f ? aspect_ratio_ : aspect_ratio);
 
-    return Environment(backend_.makeEnvironment(scene, cam), scene, cam);
+    return Environment(backend_.makeEnvironment(scene, cam), scene, cam,
+                       next_rng_stream_++, random_seed_,
+                       randomize_materials_);
 }
 
 void Renderer::setActiveEnvironmentMaps(
@@ -145,8 +230,108 @@ void Renderer::setActiveEnvironmentMaps(
 
 RenderBatch::RenderBatch(Handle &&backend, uint32_t batch_size)
     : backend_(move(backend)),
-      envs_(batch_size)
+      envs_(batch_size),
+      active_(batch_size, 1),
+      num_active_(batch_size),
+      clear_inactive_(false)
+{
+}
+
+void RenderBatch::setActive(const uint32_t *env_idxs, uint32_t num_envs,
+                            bool clear_inactive)
+{
+    fill(active_.begin(), active_.end(), 0);
+    num_active_ = 0;
+
+    for (uint32_t i = 0; i < num_envs; i++) {
+        uint32_t env_idx = env_idxs[i];
+        if (env_idx >= envs_.size()) {
+            cerr << "Active environment " << i <<
+                ": invalid environment index " << env_idx << endl;
+            abort();
+        }
+
+        if (!active_[env_idx]) {
+            active_[env_idx] = 1;
+            num_active_++;
+        }
+    }
+
+    clear_inactive_ = clear_inactive;
+}
+
+void RenderBatch::setAllActive()
 {
+    fill(active_.begin(), active_.end(), 1);
+    num_active_ = envs_.size();
+    clear_inactive_ = false;
+}
+
+void RenderBatch::setCameraViews(const uint32_t *env_idxs,
+                                 const glm::vec3 *positions,
+                                 const glm::quat *rotations,
+                                 uint32_t num_updates)
+{
+    for (uint32_t i = 0; i < num_updates; i++) {
+        if (env_idxs[i] >= envs_.size()) {
+            cerr << "Camera update " << i << ": invalid environment index "
+                 << env_idxs[i] << endl;
+            abort();
+        }
+    }
+
+    // Same convention as Camera(camera_to_world): the camera looks down -Z
+    for (uint32_t i = 0; i < num_updates; i++) {
+        glm::mat3 rot = glm::mat3_cast(rotations[i]);
+
+        Camera &cam = envs_[env_idxs[i]].camera_;
+        cam.position = positions[i];
+        cam.view = -rot[2];
+        cam.up = rot[1];
+        cam.right = rot[0];
+    }
+}
+
+void RenderBatch::setInstanceTransforms(const uint32_t *env_idxs,
+                                        const uint32_t *inst_ids,
+                                        const glm::vec3 *positions,
+                                        const glm::quat *rotations,
+                                        const glm::vec3 *scales,
+                                        uint32_t num_updates)
+{
+    for (uint32_t i = 0; i < num_updates; i++) {
+        uint32_t env_idx = env_idxs[i];
+        if (env_idx >= envs_.size()) {
+            cerr << "Instance update " << i << ": invalid environment index "
+                 << env_idx << endl;
+            abort();
+        }
+
+        const Environment &env = envs_[env_idx];
+        if (inst_ids[i] >= env.numInstanceIDs() ||
+                env.instanceIndex(inst_ids[i]) == ~0u) {
+            cerr << "Instance update " << i << ": invalid instance ID "
+                 << inst_ids[i] << " in environment " << env_idx << endl;
+            abort();
+        }
+    }
+
+    // Each touched environment switches to its own instances once
+    vector<uint8_t> touched(envs_.size(), 0);
+    for (uint32_t i = 0; i < num_updates; i++) {
+        uint32_t env_idx = env_idxs[i];
+        if (!touched[env_idx]) {
+            envs_[env_idx].makeInstancesUnique();
+            envs_[env_idx].setDirty();
+            touched[env_idx] = 1;
+        }
+    }
+
+    for (uint32_t i = 0; i < num_updates; i++) {
+        envs_[env_idxs[i]].writeInstanceTransform(inst_ids[i],
+            scaledTransform(positions[i], rotations[i],
+                            scales ? scales[i] : glm::vec3(1.f)));
+    }
 }
 
 RenderBatch Renderer::makeRenderBatch()
@@ -156,6 +341,14 @@ RenderBatch Renderer::makeRenderBatch()
 
 void Renderer::render(RenderBatch &batch)
 {
+    batch.setAllActive();
+    backend_.render(batch);
+}
+
+void Renderer::render(RenderBatch &batch, const uint32_t *env_idxs,
+                      uint32_t num_envs, bool clear_inactive)
+{
+    batch.setActive(env_idxs, num_envs, clear_inactive);
     backend_.render(batch);
 }
 
@@ -164,6 +357,11 @@ void Renderer::waitForBatch(RenderBatch &batch)
     backend_.waitForBatch(batch);
 }
 
+bool Renderer::isBatchReady(RenderBatch &batch)
+{
+    return backend_.isBatchReady(batch);
+}
+
 half *Renderer::getOutputPointer(RenderBatch &batch) const
 {
     return backend_.getOutputPointer(batch);
@@ -174,84 +372,672 @@ AuxiliaryOutputs Renderer::getAuxiliaryOutputs(RenderBatch &batch) const
     return backend_.getAuxiliaryOutputs(batch);
 }
 
-static void randomizeMaterials(vector<uint32_t> &inst_materials, int num_materials)
+ChannelOutputs Renderer::getChannelOutputs(RenderBatch &batch) const
 {
-    if (gRandomizeMaterials) {
-        // FIXME: allow seeding, get rid of thread_local, need some kind of
-        // VulkanBackend thread context
-        static thread_local mt19937 rand_gen {random_device {}() + 5};
+    return backend_.getChannelOutputs(batch);
+}
 
-        uniform_int_distribution<> rand_dist(0, num_materials - 1);
+BatchStatistics Renderer::getBatchStatistics(RenderBatch &batch) const
+{
+    return backend_.getBatchStatistics(batch);
+}
 
-        for (int i = 0; i < (int)inst_materials.size(); i++) {
-            inst_materials[i] = rand_dist(rand_gen);
-        }
+EnvironmentRenderSettings Renderer::getRenderSettings(
+    const Environment &env) const
+{
+    return env.getRenderSettings(default_settings_);
+}
+
+uint64_t Renderer::getOutputOffset(RenderBatch &batch, uint32_t env_idx,
+                                   uint32_t view_idx) const
+{
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < env_idx; i++) {
+        const Environment &env = batch.getEnvironment(i);
+        EnvironmentRenderSettings settings = getRenderSettings(env);
+        offset += uint64_t(settings.imgWidth) * settings.imgHeight *
+            env.getNumViews();
+    }
+
+    EnvironmentRenderSettings settings =
+        getRenderSettings(batch.getEnvironment(env_idx));
+
+    return offset +
+        uint64_t(settings.imgWidth) * settings.imgHeight * view_idx;
+}
+
+void Renderer::resetEnvironments(RenderBatch &batch)
+{
+    backend_.resetEnvironments(batch);
+}
+
+static void randomizeMaterials(vector<uint32_t> &inst_materials,
+                               uint32_t num_materials,
+                               uint64_t random_seed,
+                               uint32_t rng_stream,
+                               uint32_t episode)
+{
+    CounterRNG rng(random_seed, rng_stream, episode,
+                   RandomSubsequence::Materials);
+
+    for (uint32_t &mat_idx : inst_materials) {
+        mat_idx = rng.nextBounded(num_materials);
     }
 }
 
 Environment::Environment(EnvironmentImpl &&backend,
                          const shared_ptr<Scene> &scene,
-                         const Camera &cam)
+                         const Camera &cam,
+                         uint32_t rng_stream,
+                         uint64_t random_seed,
+                         bool randomize_materials)
     : backend_(move(backend)),
       scene_(scene),
       camera_(cam),
-      instances_(scene_->envInit.defaultInstances),
-      instance_materials_(scene->envInit.defaultInstanceMaterials),
-      transforms_(scene_->envInit.defaultTransforms),
-      instance_flags_(scene_->envInit.defaultInstanceFlags),
-      index_map_(scene_->envInit.indexMap),
-      reverse_id_map_(scene_->envInit.reverseIDMap),
+      extra_views_(),
+      render_settings_ {},
+      rng_stream_(rng_stream),
+      episode_(0),
+      random_seed_(random_seed),
+      randomize_materials_(randomize_materials),
+      instances_(),
+      instance_materials_(),
+      transforms_(),
+      instance_flags_(),
+      free_slots_(),
+      default_instances_(true),
+      default_materials_(true),
+      index_map_(),
+      reverse_id_map_(),
       free_ids_(),
+      default_ids_(true),
+      instance_groups_(),
+      group_membership_(),
+      group_member_idxs_(),
       free_light_ids_(),
-      light_ids_(scene_->envInit.lightIDs),
-      light_reverse_ids_(scene_->envInit.lightReverseIDs),
-      dirty_(true)
+      light_ids_(),
+      light_reverse_ids_(),
+      default_light_ids_(true),
+      dirty_(true),
+      dirty_transforms_ {0, 0},
+      dirty_materials_ {0, 0},
+      dirty_lights_(true)
 {
     // FIXME use EnvironmentInit lights
  
-    randomizeMaterials(instance_materials_, scene_->numMaterials);
+    if (randomize_materials_) {
+        makeMaterialsUnique();
+        randomizeMaterials(instance_materials_, scene_->numMaterials,
+                           random_seed_, rng_stream_, episode_);
+    }
+
+    setUploadDirty();
 }
 
 void Environment::reset()
 {
-    instances_ = scene_->envInit.defaultInstances;
-    instance_materials_ = scene_->envInit.defaultInstanceMaterials;
-    transforms_ = scene_->envInit.defaultTransforms;
-    instance_flags_ = scene_->envInit.defaultInstanceFlags;
-    index_map_ = scene_->envInit.indexMap;
-    reverse_id_map_ = scene_->envInit.reverseIDMap;
+    // New episode, so randomization draws differ from the last one
+    episode_++;
+
+    // Go back to referencing the scene's defaults. Assigning {} rather than
+    // calling clear() releases the private copies' storage.
+    instances_ = {};
+    transforms_ = {};
+    instance_flags_ = {};
+    free_slots_.clear();
+    default_instances_ = true;
+
+    instance_materials_ = {};
+    default_materials_ = true;
+
+    index_map_ = {};
+    reverse_id_map_ = {};
     free_ids_.clear();
+    default_ids_ = true;
+
+    instance_groups_ = {};
+    group_membership_ = {};
+    group_member_idxs_ = {};
+
+    light_ids_ = {};
+    light_reverse_ids_ = {};
     free_light_ids_.clear();
-    light_ids_ = scene_->envInit.lightIDs;
-    light_reverse_ids_ = scene_->envInit.lightReverseIDs;
+    default_light_ids_ = true;
 
-    randomizeMaterials(instance_materials_, scene_->numMaterials);
+    if (randomize_materials_) {
+        makeMaterialsUnique();
+        randomizeMaterials(instance_materials_, scene_->numMaterials,
+                           random_seed_, rng_stream_, episode_);
+    }
 
     setDirty();
+    setUploadDirty();
+}
+
+// Resolves ObjectInstance::libraryFlag indices, nullptr if out of range
+static const ObjectInfo *lookupObject(const Scene &scene, uint32_t obj_idx)
+{
+    const Scene *src = &scene;
+    if (obj_idx & ObjectInstance::libraryFlag) {
+        src = scene.objectLibrary.get();
+        obj_idx &= ~ObjectInstance::libraryFlag;
+    }
+
+    if (!src || obj_idx >= src->objectInfo.size()) {
+        return nullptr;
+    }
+
+    return &src->objectInfo[obj_idx];
+}
+
+uint32_t Environment::addInstance(uint32_t obj_idx,
+                                  const uint32_t *material_idxs,
+                                  uint32_t num_mat_indices,
+                                  const glm::vec3 &position,
+                                  const glm::quat &rotation,
+                                  const glm::vec3 &scale,
+                                  bool dynamic,
+                                  bool kinematic)
+{
+    // FIXME
+    (void)dynamic;
+    (void)kinematic;
+
+    uint32_t inst_id;
+    addInstances(&obj_idx, material_idxs, &num_mat_indices, &position,
+                 &rotation, &scale, 1, &inst_id);
+
+    return inst_id;
 }
 
 void Environment::deleteInstance(uint32_t inst_id)
 {
-    // FIXME, deal with instance_materials_
-    uint32_t instance_idx = index_map_[inst_id];
-    if (instances_.size() > 1) {
-        // Keep contiguous
-        instances_[instance_idx] = instances_.back();
-        transforms_[instance_idx] = transforms_.back();
-        reverse_id_map_[instance_idx] = reverse_id_map_.back();
-        index_map_[reverse_id_map_[instance_idx]] = instance_idx;
+    deleteInstances(&inst_id, 1);
+}
+
+void Environment::addInstances(const uint32_t *obj_idxs,
+                               const uint32_t *material_idxs,
+                               const uint32_t *num_mat_indices,
+                               const glm::vec3 *positions,
+                               const glm::quat *rotations,
+                               const glm::vec3 *scales,
+                               uint32_t num_instances,
+                               uint32_t *inst_ids)
+{
+    for (uint32_t i = 0; i < num_instances; i++) {
+        if (!lookupObject(*scene_, obj_idxs[i])) {
+            cerr << "addInstances: invalid object index " << obj_idxs[i]
+                 << endl;
+            abort();
+        }
+    }
+
+    makeInstancesUnique();
+    makeMaterialsUnique();
+    makeIDsUnique();
+    setDirty();
+
+    if (num_instances > free_slots_.size()) {
+        uint32_t num_slots =
+            instances_.size() + num_instances - free_slots_.size();
+        instances_.reserve(num_slots);
+        transforms_.reserve(num_slots);
+        instance_flags_.reserve(num_slots);
+        reverse_id_map_.reserve(num_slots);
+    }
+
+    const uint32_t *cur_materials = material_idxs;
+    for (uint32_t i = 0; i < num_instances; i++) {
+        uint32_t obj_idx = obj_idxs[i];
+        const glm::vec3 &position = positions[i];
+        glm::vec3 scale = scales ? scales[i] : glm::vec3(1.f);
+
+        glm::mat4 rot_matrix = glm::mat4_cast(rotations[i]);
+
+        glm::mat4 model_matrix = glm::translate(position) * rot_matrix *
+            glm::scale(scale);
+        glm::mat4 inv_model = glm::scale(1.f / scale) *
+            glm::transpose(rot_matrix) * glm::translate(-position);
+
+        // Material blocks hold one entry per mesh of the object
+        uint32_t num_meshes = lookupObject(*scene_, obj_idx)->numMeshes;
+
+        uint32_t slot;
+        uint32_t mat_offset;
+        if (free_slots_.size() > 0) {
+            slot = free_slots_.back();
+            free_slots_.pop_back();
+
+            // Reuse the tombstone's material block if large enough, the
+            // old block is otherwise reclaimed by compaction
+            const ObjectInstance &old_inst = instances_[slot];
+            if (num_meshes <=
+                    lookupObject(*scene_, old_inst.objectIndex)->numMeshes) {
+                mat_offset = old_inst.materialOffset;
+            } else {
+                mat_offset = instance_materials_.size();
+                instance_materials_.resize(mat_offset + num_meshes);
+            }
+
+            instances_[slot] = { obj_idx, mat_offset };
+            transforms_[slot] = { model_matrix, inv_model };
+            instance_flags_[slot] = InstanceFlags {};
+        } else {
+            slot = instances_.size();
+            mat_offset = instance_materials_.size();
+            instance_materials_.resize(mat_offset + num_meshes);
+
+            instances_.push_back({ obj_idx, mat_offset });
+            transforms_.push_back({ model_matrix, inv_model });
+            instance_flags_.push_back(InstanceFlags {});
+            reverse_id_map_.push_back(0);
+        }
+
+        uint32_t num_copy = min(num_mat_indices[i], num_meshes);
+        copy(cur_materials, cur_materials + num_copy,
+             instance_materials_.begin() + mat_offset);
+        cur_materials += num_mat_indices[i];
+
+        dirty_materials_.mark(mat_offset, mat_offset + num_meshes);
+        dirty_transforms_.mark(slot);
+
+        uint32_t inst_id;
+        if (free_ids_.size() > 0) {
+            inst_id = free_ids_.back();
+            free_ids_.pop_back();
+            index_map_[inst_id] = slot;
+        } else {
+            index_map_.push_back(slot);
+            inst_id = index_map_.size() - 1;
+        }
+
+        reverse_id_map_[slot] = inst_id;
+        inst_ids[i] = inst_id;
+    }
+}
+
+void Environment::checkInstanceID(uint32_t inst_id, const char *caller) const
+{
+    if (inst_id >= numInstanceIDs() || instanceIndex(inst_id) == ~0u) {
+        cerr << caller << ": invalid instance ID " << inst_id << endl;
+        abort();
     }
-    instances_.pop_back();
-    transforms_.pop_back();
-    reverse_id_map_.pop_back();
+}
+
+void Environment::deleteInstances(const uint32_t *inst_ids,
+                                  uint32_t num_instances)
+{
+    for (uint32_t i = 0; i < num_instances; i++) {
+        checkInstanceID(inst_ids[i], "deleteInstances");
+    }
+
+    vector<uint32_t> sorted_ids(inst_ids, inst_ids + num_instances);
+    sort(sorted_ids.begin(), sorted_ids.end());
+    auto duplicate = adjacent_find(sorted_ids.begin(), sorted_ids.end());
+    if (duplicate != sorted_ids.end()) {
+        cerr << "deleteInstances: instance ID " << *duplicate
+             << " deleted twice" << endl;
+        abort();
+    }
+
+    makeInstancesUnique();
+    makeIDsUnique();
+    setDirty();
+
+    for (uint32_t i = 0; i < num_instances; i++) {
+        uint32_t inst_id = inst_ids[i];
+        uint32_t slot = index_map_[inst_id];
 
-    free_ids_.push_back(inst_id);
+        // Only the TLAS changes, transforms and materials stay in place
+        instance_flags_[slot] |= InstanceFlags::Deleted;
+
+        removeFromInstanceGroup(inst_id);
+
+        index_map_[inst_id] = ~0u;
+        free_slots_.push_back(slot);
+        free_ids_.push_back(inst_id);
+    }
+
+    if (free_slots_.size() * 2 > instances_.size()) {
+        compactInstances();
+    }
+}
+
+void Environment::compactInstances()
+{
+    if (free_slots_.size() == 0) {
+        return;
+    }
+
+    makeMaterialsUnique();
+
+    vector<uint32_t> compacted_materials;
+    compacted_materials.reserve(instance_materials_.size());
+
+    uint32_t num_live = 0;
+    for (uint32_t slot = 0; slot < instances_.size(); slot++) {
+        if (instance_flags_[slot] & InstanceFlags::Deleted) {
+            continue;
+        }
+
+        ObjectInstance inst = instances_[slot];
+        uint32_t num_meshes =
+            lookupObject(*scene_, inst.objectIndex)->numMeshes;
+        auto mats_begin = instance_materials_.begin() + inst.materialOffset;
+
+        inst.materialOffset = compacted_materials.size();
+        compacted_materials.insert(compacted_materials.end(), mats_begin,
+                                   mats_begin + num_meshes);
+
+        uint32_t inst_id = reverse_id_map_[slot];
+
+        instances_[num_live] = inst;
+        transforms_[num_live] = transforms_[slot];
+        instance_flags_[num_live] = instance_flags_[slot];
+        reverse_id_map_[num_live] = inst_id;
+        index_map_[inst_id] = num_live;
+
+        num_live++;
+    }
+
+    instances_.resize(num_live);
+    transforms_.resize(num_live);
+    instance_flags_.resize(num_live);
+    reverse_id_map_.resize(num_live);
+    instance_materials_ = move(compacted_materials);
+    free_slots_.clear();
+
+    setDirty();
+    setUploadDirty();
+}
+
+uint32_t Environment::addInstanceGroup(const glm::vec3 &position,
+                                       const glm::quat &rotation,
+                                       uint32_t parent_group)
+{
+    if (parent_group != ~0u && (parent_group >= instance_groups_.size() ||
+            instance_groups_[parent_group].removed)) {
+        cerr << "addInstanceGroup: invalid parent group " << parent_group
+             << endl;
+        abort();
+    }
+
+    InstanceTransform local = rigidTransform(position, rotation);
+    InstanceTransform world = parent_group == ~0u ? local :
+        composeTransforms(instance_groups_[parent_group].world, local);
+
+    instance_groups_.push_back(InstanceGroup {
+        local,
+        world,
+        parent_group,
+        {},
+        {},
+        false,
+        false,
+    });
+
+    return instance_groups_.size() - 1;
+}
+
+void Environment::removeInstanceGroup(uint32_t group_id)
+{
+    if (group_id >= instance_groups_.size() ||
+            instance_groups_[group_id].removed) {
+        cerr << "removeInstanceGroup: invalid group " << group_id << endl;
+        abort();
+    }
+
+    InstanceGroup &group = instance_groups_[group_id];
+
+    for (uint32_t inst_id : group.memberIDs) {
+        group_membership_[inst_id] = ~0u;
+    }
+
+    // Children become top level groups
+    for (InstanceGroup &child : instance_groups_) {
+        if (!child.removed && child.parent == group_id) {
+            child.local = child.world;
+            child.parent = ~0u;
+        }
+    }
+
+    group.memberIDs = {};
+    group.memberTransforms = {};
+    group.removed = true;
+}
+
+void Environment::addToInstanceGroup(uint32_t group_id, uint32_t inst_id)
+{
+    if (group_id >= instance_groups_.size() ||
+            instance_groups_[group_id].removed) {
+        cerr << "addToInstanceGroup: invalid group " << group_id << endl;
+        abort();
+    }
+
+    checkInstanceID(inst_id, "addToInstanceGroup");
+
+    if (group_membership_.size() <= inst_id) {
+        group_membership_.resize(numInstanceIDs(), ~0u);
+        group_member_idxs_.resize(numInstanceIDs(), ~0u);
+    }
+
+    removeFromInstanceGroup(inst_id);
+
+    InstanceGroup &group = instance_groups_[group_id];
+    const InstanceTransform &inst_txfm =
+        getTransforms()[instanceIndex(inst_id)];
+
+    group_member_idxs_[inst_id] = group.memberIDs.size();
+    group.memberIDs.push_back(inst_id);
+    group.memberTransforms.push_back(
+        relativeTransform(group.world, inst_txfm));
+    group_membership_[inst_id] = group_id;
+}
+
+void Environment::removeFromInstanceGroup(uint32_t inst_id)
+{
+    checkInstanceID(inst_id, "removeFromInstanceGroup");
+
+    if (inst_id >= group_membership_.size() ||
+            group_membership_[inst_id] == ~0u) {
+        return;
+    }
+
+    InstanceGroup &group = instance_groups_[group_membership_[inst_id]];
+    group_membership_[inst_id] = ~0u;
+
+    uint32_t member_idx = group_member_idxs_[inst_id];
+
+    group.memberIDs[member_idx] = group.memberIDs.back();
+    group_member_idxs_[group.memberIDs[member_idx]] = member_idx;
+    group.memberIDs.pop_back();
+    group.memberTransforms[member_idx] = group.memberTransforms.back();
+    group.memberTransforms.pop_back();
+}
+
+void Environment::setInstanceGroupTransforms(const uint32_t *group_ids,
+                                             const glm::vec3 *positions,
+                                             const glm::quat *rotations,
+                                             uint32_t num_groups)
+{
+    for (uint32_t i = 0; i < num_groups; i++) {
+        uint32_t group_id = group_ids[i];
+        if (group_id >= instance_groups_.size() ||
+                instance_groups_[group_id].removed) {
+            cerr << "setInstanceGroupTransforms: invalid group " << group_id
+                 << endl;
+            abort();
+        }
+
+        InstanceGroup &group = instance_groups_[group_id];
+        group.local = rigidTransform(positions[i], rotations[i]);
+        group.dirty = true;
+    }
+
+    updateInstanceGroups();
+}
+
+void Environment::updateInstanceGroups()
+{
+    makeInstancesUnique();
+    setDirty();
+
+    // Parents are created before their children, so one pass in creation
+    // order propagates through the whole hierarchy
+    for (InstanceGroup &group : instance_groups_) {
+        if (group.removed) {
+            continue;
+        }
+
+        if (group.parent != ~0u && instance_groups_[group.parent].dirty) {
+            group.dirty = true;
+        }
+
+        if (!group.dirty) {
+            continue;
+        }
+
+        group.world = group.parent == ~0u ? group.local :
+            composeTransforms(instance_groups_[group.parent].world,
+                              group.local);
+
+        for (uint32_t i = 0; i < group.memberIDs.size(); i++) {
+            uint32_t slot = instanceIndex(group.memberIDs[i]);
+
+            transforms_[slot] =
+                composeTransforms(group.world, group.memberTransforms[i]);
+            dirty_transforms_.mark(slot);
+        }
+    }
+
+    for (InstanceGroup &group : instance_groups_) {
+        group.dirty = false;
+    }
+}
+
+void Environment::setInstanceTransform(uint32_t inst_id,
+                                       const glm::vec3 &position,
+                                       const glm::quat &rotation,
+                                       const glm::vec3 &scale)
+{
+    checkInstanceID(inst_id, "setInstanceTransform");
+
+    makeInstancesUnique();
+    setDirty();
+
+    writeInstanceTransform(inst_id,
+                           scaledTransform(position, rotation, scale));
+}
+
+void Environment::writeInstanceTransform(uint32_t inst_id,
+                                         const InstanceTransform &txfm)
+{
+    uint32_t slot = instanceIndex(inst_id);
+    transforms_[slot] = txfm;
+    dirty_transforms_.mark(slot);
+
+    // Otherwise the next group update would move it back
+    if (inst_id < group_membership_.size() &&
+            group_membership_[inst_id] != ~0u) {
+        InstanceGroup &group = instance_groups_[group_membership_[inst_id]];
+
+        group.memberTransforms[group_member_idxs_[inst_id]] =
+            relativeTransform(group.world, txfm);
+    }
+}
+
+const InstanceTransform &Environment::getInstanceTransform(
+    uint32_t inst_id) const
+{
+    checkInstanceID(inst_id, "getInstanceTransform");
+
+    return getTransforms()[instanceIndex(inst_id)];
+}
+
+const vector<ObjectInstance> &Environment::getInstances() const
+{
+    return default_instances_ ? scene_->envInit.defaultInstances : instances_;
+}
+
+const vector<uint32_t> &Environment::getInstanceMaterials() const
+{
+    return default_materials_ ?
+        scene_->envInit.defaultInstanceMaterials : instance_materials_;
+}
+
+// Callers may write through the returned reference
+vector<uint32_t> &Environment::getInstanceMaterials()
+{
+    makeMaterialsUnique();
+    dirty_materials_.mark(0, instance_materials_.size());
+    return instance_materials_;
+}
+
+const vector<InstanceTransform> &Environment::getTransforms() const
+{
+    return default_instances_ ? scene_->envInit.defaultTransforms : transforms_;
+}
+
+const vector<InstanceFlags> &Environment::getInstanceFlags() const
+{
+    return default_instances_ ?
+        scene_->envInit.defaultInstanceFlags : instance_flags_;
+}
+
+void Environment::makeInstancesUnique()
+{
+    if (!default_instances_) {
+        return;
+    }
+
+    instances_ = scene_->envInit.defaultInstances;
+    transforms_ = scene_->envInit.defaultTransforms;
+    instance_flags_ = scene_->envInit.defaultInstanceFlags;
+    default_instances_ = false;
+
+    // Switching away from the shared TLAS and transforms
+    setDirty();
+    dirty_transforms_.mark(0, transforms_.size());
+}
+
+void Environment::makeMaterialsUnique()
+{
+    if (!default_materials_) {
+        return;
+    }
+
+    instance_materials_ = scene_->envInit.defaultInstanceMaterials;
+    default_materials_ = false;
+}
+
+void Environment::makeIDsUnique()
+{
+    if (!default_ids_) {
+        return;
+    }
+
+    index_map_ = scene_->envInit.indexMap;
+    reverse_id_map_ = scene_->envInit.reverseIDMap;
+    default_ids_ = false;
+}
+
+void Environment::makeLightIDsUnique()
+{
+    if (!default_light_ids_) {
+        return;
+    }
+
+    light_ids_ = scene_->envInit.lightIDs;
+    light_reverse_ids_ = scene_->envInit.lightReverseIDs;
+    default_light_ids_ = false;
 }
 
 uint32_t Environment::addLight(const glm::vec3 &position,
                                const glm::vec3 &color)
 {
+    makeLightIDsUnique();
     backend_.addLight(position, color);
+    dirty_lights_ = true;
     uint32_t light_idx = light_reverse_ids_.size();
 
     uint32_t light_id;
@@ -272,8 +1058,10 @@ uint32_t Environment::addLight(const glm::vec3 &position,
 
 void Environment::removeLight(uint32_t light_id)
 {
+    makeLightIDsUnique();
     uint32_t light_idx = light_ids_[light_id];
     backend_.removeLight(light_idx);
+    dirty_lights_ = true;
 
     if (light_reverse_ids_.size() > 1) {
         light_reverse_ids_[light_idx] = light_reverse_ids_.back();
@@ -338,6 +1126,11 @@ void RendererImpl::waitForBatch(RenderBatch &batch)
     invoke(wait_ptr_, state_, batch);
 }
 
+bool RendererImpl::isBatchReady(RenderBatch &batch)
+{
+    return invoke(is_ready_ptr_, state_, batch);
+}
+
 half *RendererImpl::getOutputPointer(RenderBatch &batch) const
 {
     return invoke(get_output_ptr_, state_, batch);
@@ -348,6 +1141,21 @@ AuxiliaryOutputs RendererImpl::getAuxiliaryOutputs(RenderBatch &batch) const
     return invoke(get_aux_ptr_, state_, batch);
 }
 
+ChannelOutputs RendererImpl::getChannelOutputs(RenderBatch &batch) const
+{
+    return invoke(get_channels_ptr_, state_, batch);
+}
+
+BatchStatistics RendererImpl::getBatchStatistics(RenderBatch &batch) const
+{
+    return invoke(get_stats_ptr_, state_, batch);
+}
+
+void RendererImpl::resetEnvironments(RenderBatch &batch)
+{
+    invoke(reset_envs_ptr_, state_, batch);
+}
+
 void BatchDeleter::operator()(BatchBackend *ptr) const
 {
     deletePtr(state, ptr);
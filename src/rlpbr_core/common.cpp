@@ -97,8 +97,12 @@ RendererImpl::RendererImpl(DestroyType destroy_ptr,
                            MakeBatchType make_batch_ptr,
                            RenderType render_ptr,
                            WaitType wait_ptr,
+                           IsReadyType is_ready_ptr,
                            GetOutputType get_output_ptr,
                            GetAuxType get_aux_ptr,
+                           GetChannelsType get_channels_ptr,
+                           GetStatsType get_stats_ptr,
+                           ResetEnvsType reset_envs_ptr,
                            RenderBackend *state)
     : destroy_ptr_(destroy_ptr),
       make_loader_ptr_(make_loader_ptr),
@@ -107,8 +111,12 @@ RendererImpl::RendererImpl(DestroyType destroy_ptr,
       make_batch_ptr_(make_batch_ptr),
       render_ptr_(render_ptr),
       wait_ptr_(wait_ptr),
+      is_ready_ptr_(is_ready_ptr),
       get_output_ptr_(get_output_ptr),
       get_aux_ptr_(get_aux_ptr),
+      get_channels_ptr_(get_channels_ptr),
+      get_stats_ptr_(get_stats_ptr),
+      reset_envs_ptr_(reset_envs_ptr),
       state_(state)
 {}
 
@@ -119,8 +127,12 @@ RendererImpl::RendererImpl(RendererImpl &&o)
       set_env_maps_ptr_(o.set_env_maps_ptr_),
       render_ptr_(o.render_ptr_),
       wait_ptr_(o.wait_ptr_),
+      is_ready_ptr_(o.is_ready_ptr_),
       get_output_ptr_(o.get_output_ptr_),
       get_aux_ptr_(o.get_aux_ptr_),
+      get_channels_ptr_(o.get_channels_ptr_),
+      get_stats_ptr_(o.get_stats_ptr_),
+      reset_envs_ptr_(o.reset_envs_ptr_),
       state_(o.state_)
 {
     o.state_ = nullptr;
@@ -144,8 +156,12 @@ RendererImpl & RendererImpl::operator=(RendererImpl &&o)
     make_env_ptr_ = o.make_env_ptr_;
     render_ptr_ = o.render_ptr_;
     wait_ptr_ = o.wait_ptr_;
+    is_ready_ptr_ = o.is_ready_ptr_;
     get_output_ptr_ = o.get_output_ptr_;
     get_aux_ptr_ = o.get_aux_ptr_;
+    get_channels_ptr_ = o.get_channels_ptr_;
+    get_stats_ptr_ = o.get_stats_ptr_;
+    reset_envs_ptr_ = o.reset_envs_ptr_;
     state_ = o.state_;
 
     o.state_ = nullptr;
@@ -40,9 +40,10 @@ void destroyEnvironment(EnvironmentBackend *ptr)
 }
 
 template <typename EnvType>
-EnvironmentImpl makeEnvironmentImpl(EnvironmentBackend *ptr)
+EnvironmentImpl makeEnvironmentImpl(EnvironmentBackend *ptr,
+    EnvironmentImpl::DestroyType destroy_ptr = destroyEnvironment<EnvType>)
 {
-    return EnvironmentImpl(destroyEnvironment<EnvType>,
+    return EnvironmentImpl(destroy_ptr,
         static_cast<EnvironmentImpl::AddLightType>(&EnvType::addLight),
         static_cast<EnvironmentImpl::RemoveLightType>(&EnvType::removeLight),
         ptr);
@@ -71,10 +72,18 @@ RendererImpl makeRendererImpl(RenderBackend *ptr)
             &RendererType::render),
         static_cast<RendererImpl::WaitType>(
             &RendererType::waitForBatch),
+        static_cast<RendererImpl::IsReadyType>(
+            &RendererType::isBatchReady),
         static_cast<RendererImpl::GetOutputType>(
             &RendererType::getOutputPointer),
         static_cast<RendererImpl::GetAuxType>(
             &RendererType::getAuxiliaryOutputs),
+        static_cast<RendererImpl::GetChannelsType>(
+            &RendererType::getChannelOutputs),
+        static_cast<RendererImpl::GetStatsType>(
+            &RendererType::getBatchStatistics),
+        static_cast<RendererImpl::ResetEnvsType>(
+            &RendererType::resetEnvironments),
         ptr);
 }
 
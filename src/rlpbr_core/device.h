@@ -12,6 +12,22 @@ SHADER_CONST int TextureConstantsClearcoatOffset     = 6;
 SHADER_CONST int TextureConstantsAnisoOffset         = 7;
 SHADER_CONST int TextureConstantsTexturesPerMaterial = 8;
 
+// CameraType "enum", matches RLpbr::CameraType
+SHADER_CONST uint32_t CameraTypePinhole         = 0;
+SHADER_CONST uint32_t CameraTypeEquirectangular = 1;
+SHADER_CONST uint32_t CameraTypeCubemapFace     = 2;
+SHADER_CONST uint32_t CameraTypeFisheye         = 3;
+SHADER_CONST uint32_t CameraTypeOrthographic    = 4;
+
+// AlphaMode "enum", matches RLpbr::AlphaMode
+SHADER_CONST uint32_t AlphaModeOpaque  = 0;
+SHADER_CONST uint32_t AlphaModeMasked  = 1;
+SHADER_CONST uint32_t AlphaModeBlended = 2;
+
+// Set in a TLAS instance's SBT record offset (mesh offset) for instances of
+// object library objects
+SHADER_CONST uint32_t MeshOffsetLibraryFlag = 1 << 23;
+
 // MaterialFlags "enum"
 SHADER_CONST uint32_t MaterialFlagsComplex                = 1 << 0;
 SHADER_CONST uint32_t MaterialFlagsThinWalled             = 1 << 1;
@@ -23,5 +39,7 @@ SHADER_CONST uint32_t MaterialFlagsHasEmittanceTexture    = 1 << 6;
 SHADER_CONST uint32_t MaterialFlagsHasTransmissionTexture = 1 << 7;
 SHADER_CONST uint32_t MaterialFlagsHasClearcoatTexture    = 1 << 8;
 SHADER_CONST uint32_t MaterialFlagsHasAnisotropicTexture  = 1 << 9;
+SHADER_CONST uint32_t MaterialFlagsAlphaMasked            = 1 << 10;
+SHADER_CONST uint32_t MaterialFlagsAlphaBlended           = 1 << 11;
 
 #endif
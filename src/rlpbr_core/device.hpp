@@ -34,6 +34,8 @@ enum class MaterialFlags : uint32_t {
     HasTransmissionTexture = Shader::MaterialFlagsHasTransmissionTexture,
     HasClearcoatTexture = Shader::MaterialFlagsHasClearcoatTexture,
     HasAnisotropicTexture = Shader::MaterialFlagsHasAnisotropicTexture,
+    AlphaMasked = Shader::MaterialFlagsAlphaMasked,
+    AlphaBlended = Shader::MaterialFlagsAlphaBlended,
 };
 
 }
@@ -34,7 +34,7 @@ struct alignas(16) PhysicsObject {
     glm::vec3 interia;
     glm::vec3 com;
     float mass;
-    uint32_t indexOffset;
+    uint64_t indexOffset;
     uint32_t numTriangles;
 };
 
@@ -46,6 +46,7 @@ struct PhysicsInstance {
 struct alignas(16) PhysicsTransform {
     glm::vec3 position;
     glm::quat rotation;
+    glm::vec3 scale;
 };
 
 struct PhysicsMetadata {
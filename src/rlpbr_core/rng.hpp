@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+
+namespace RLpbr {
+
+// Independent draw sequences for each kind of randomization
+enum class RandomSubsequence : uint32_t {
+    Materials,
+    Domain,
+};
+
+// Philox4x32-10 counter based RNG. Every draw is a pure function of
+// (seed, stream, episode, subsequence, draw index), so results don't depend
+// on which thread randomizes an environment or in what order.
+class CounterRNG {
+public:
+    CounterRNG(uint64_t seed, uint32_t stream, uint32_t episode,
+               RandomSubsequence subsequence)
+        : key_ { uint32_t(seed), uint32_t(seed >> 32) },
+          stream_(stream),
+          episode_(episode),
+          subsequence_(static_cast<uint32_t>(subsequence)),
+          draw_idx_(0),
+          block_ {}
+    {}
+
+    uint32_t nextUInt()
+    {
+        uint32_t lane = draw_idx_ & 3;
+        if (lane == 0) {
+            generateBlock(draw_idx_ >> 2);
+        }
+        draw_idx_++;
+
+        return block_[lane];
+    }
+
+    // Uniform in [0, 1)
+    float nextFloat()
+    {
+        return float(nextUInt() >> 8) * (1.f / 16777216.f);
+    }
+
+    // Uniform in [0, n)
+    uint32_t nextBounded(uint32_t n)
+    {
+        return uint32_t((uint64_t(nextUInt()) * n) >> 32);
+    }
+
+private:
+    static constexpr uint32_t mul0 = 0xD2511F53;
+    static constexpr uint32_t mul1 = 0xCD9E8D57;
+    static constexpr uint32_t weyl0 = 0x9E3779B9;
+    static constexpr uint32_t weyl1 = 0xBB67AE85;
+
+    void generateBlock(uint32_t block_idx)
+    {
+        uint32_t ctr[4] { block_idx, subsequence_, stream_, episode_ };
+        uint32_t k0 = key_[0];
+        uint32_t k1 = key_[1];
+
+        for (int round = 0; round < 10; round++) {
+            uint64_t prod0 = uint64_t(mul0) * ctr[0];
+            uint64_t prod1 = uint64_t(mul1) * ctr[2];
+
+            uint32_t hi0 = uint32_t(prod0 >> 32);
+            uint32_t lo0 = uint32_t(prod0);
+            uint32_t hi1 = uint32_t(prod1 >> 32);
+            uint32_t lo1 = uint32_t(prod1);
+
+            ctr[0] = hi1 ^ ctr[1] ^ k0;
+            ctr[1] = lo1;
+            ctr[2] = hi0 ^ ctr[3] ^ k1;
+            ctr[3] = lo0;
+
+            k0 += weyl0;
+            k1 += weyl1;
+        }
+
+        for (int i = 0; i < 4; i++) {
+            block_[i] = ctr[i];
+        }
+    }
+
+    uint32_t key_[2];
+    uint32_t stream_;
+    uint32_t episode_;
+    uint32_t subsequence_;
+    uint64_t draw_idx_;
+    uint32_t block_[4];
+};
+
+}
@@ -28,7 +28,7 @@ SceneLoadData SceneLoadData::loadFromDisk(string_view scene_path_name,
     };
 
     uint32_t magic = read_uint();
-    if (magic != 0x55555555) {
+    if (magic != 0x55555556) {
         cerr << "Invalid preprocessed scene" << endl;
         abort();
     }
@@ -44,6 +44,10 @@ SceneLoadData SceneLoadData::loadFromDisk(string_view scene_path_name,
     StagingHeader hdr;
     scene_file.read(reinterpret_cast<char *>(&hdr), sizeof(StagingHeader));
 
+    vector<GeometryBlock> geometry_blocks(hdr.numBlocks);
+    scene_file.read(reinterpret_cast<char *>(geometry_blocks.data()),
+                    sizeof(GeometryBlock) * hdr.numBlocks);
+
     alignSkip();
 
     vector<MeshInfo> mesh_infos(hdr.numMeshes);
@@ -54,6 +58,13 @@ SceneLoadData SceneLoadData::loadFromDisk(string_view scene_path_name,
     scene_file.read(reinterpret_cast<char *>(obj_infos.data()),
                     sizeof(ObjectInfo) * hdr.numObjects);
 
+    for (uint32_t obj_idx = 0; obj_idx < hdr.numObjects; obj_idx++) {
+        const ObjectInfo &obj = obj_infos[obj_idx];
+        for (uint32_t mesh_idx = 0; mesh_idx < obj.numMeshes; mesh_idx++) {
+            mesh_infos[obj.meshIndex + mesh_idx].objectIndex = obj_idx;
+        }
+    }
+
     uint32_t num_lights = read_uint();
     vector<LightProperties> light_props(num_lights);
     scene_file.read(reinterpret_cast<char *>(light_props.data()),
@@ -154,7 +165,13 @@ SceneLoadData SceneLoadData::loadFromDisk(string_view scene_path_name,
         name_buffer.clear();
     }
 
+    uint32_t num_chunks = read_uint();
+    vector<SceneChunk> chunks(num_chunks);
+    scene_file.read(reinterpret_cast<char *>(chunks.data()),
+                    sizeof(SceneChunk) * num_chunks);
+
     alignSkip();
+    uint64_t staging_offset = scene_file.tellg();
 
     auto loadRemainingData = [&]() {
         vector<char> file_data(hdr.totalBytes);
@@ -165,6 +182,7 @@ SceneLoadData SceneLoadData::loadFromDisk(string_view scene_path_name,
 
     return SceneLoadData {
         hdr,
+        move(geometry_blocks),
         move(mesh_infos),
         move(obj_infos),
         move(textures),
@@ -181,7 +199,9 @@ SceneLoadData SceneLoadData::loadFromDisk(string_view scene_path_name,
             move(dynamic_instances),
             move(dynamic_transforms),
         },
+        move(chunks),
         scene_path,
+        staging_offset,
         load_full_file ? 
             variant<ifstream, vector<char>>(loadRemainingData()) :
             variant<ifstream, vector<char>>(move(scene_file)),
@@ -205,10 +225,11 @@ EnvironmentInit::EnvironmentInit(const AABB &bbox,
       lightIDs(),
       lightReverseIDs()
 {
-    indexMap.reserve(instances.size());
-    reverseIDMap.reserve(instances.size());
+    uint32_t num_instances = defaultInstances.size();
+    indexMap.reserve(num_instances);
+    reverseIDMap.reserve(num_instances);
 
-    for (uint32_t cur_id = 0; cur_id < instances.size(); cur_id++) {
+    for (uint32_t cur_id = 0; cur_id < num_instances; cur_id++) {
         indexMap.emplace_back(cur_id);
         reverseIDMap.push_back(cur_id);
     }
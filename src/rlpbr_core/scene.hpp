@@ -11,6 +11,7 @@
 #include <filesystem>
 #include <fstream>
 #include <functional>
+#include <memory>
 #include <string_view>
 #include <variant>
 #include <vector>
@@ -46,6 +47,7 @@ struct alignas(16) MaterialParams {
     glm::u8vec3 attenuationColor;
     uint8_t anisoScale;
     uint8_t anisoRotation;
+    uint8_t alphaCutoff; // Only read for complex materials
     uint16_t attenuationDistance;
     glm::u16vec3 baseEmittance;
 };
@@ -67,8 +69,10 @@ struct LightProperties {
             float radius;
         };
         struct {
-            uint32_t triIdxOffset;
+            // Scene wide until geometry is partitioned, block relative after
+            uint64_t triIdxOffset;
             uint32_t triMatIdx;
+            uint32_t triBlockIdx;
         };
         struct {
             uint32_t portalIdxOffset;
@@ -103,10 +107,48 @@ struct ObjectInfo {
     uint32_t numMeshes;
 };
 
+// Coverage of the base color alpha channel, computed by the preprocessor.
+// Opaque meshes can skip all alpha handling during traversal.
+enum class AlphaMode : uint32_t {
+    Opaque = 0,
+    Masked = 1,
+    Blended = 2,
+};
+
 struct alignas(16) MeshInfo {
-    uint32_t indexOffset;
+    uint64_t indexOffset; // Relative to the start of the mesh's block
     uint32_t numTriangles;
     uint32_t numVertices;
+    AlphaMode alphaMode;
+    uint32_t blockIndex;
+    // Owning object, not serialized (filled in at load time)
+    uint32_t objectIndex;
+};
+
+// Geometry is split into blocks that are each uploaded to a separate
+// device buffer. Vertex indices are relative to the start of their block,
+// so a block never holds more than 2^32 vertices.
+struct GeometryBlockConfig {
+    static constexpr uint64_t maxBlockBytes = 1ull << 31;
+};
+
+struct GeometryBlock {
+    // Byte offsets into the staged scene data
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t numVertices;
+    uint64_t numIndices;
+};
+
+// Static geometry grouped by spatial cell in the preprocessor. Chunks are
+// the scene's final objects and own their geometry blocks outright, so
+// they can be streamed in and out independently of the rest of the scene.
+struct SceneChunk {
+    AABB bounds;
+    uint32_t objectOffset;
+    uint32_t numObjects;
+    uint32_t blockOffset;
+    uint32_t numBlocks;
 };
 
 struct TextureInfo {
@@ -141,29 +183,36 @@ struct MaterialMetadata {
 struct StagingHeader {
     uint32_t numMeshes;
     uint32_t numObjects;
-    uint32_t numVertices;
-    uint32_t numIndices;
     uint32_t numMaterials;
+    uint32_t numBlocks;
+    uint64_t numVertices;
+    uint64_t numIndices;
 
-    uint64_t indexOffset;
     uint64_t meshOffset;
     uint64_t objectOffset;
     uint64_t materialOffset;
 
     uint64_t physicsOffset;
+
+    // Per block device addresses, filled in by the loader
+    uint64_t blockAddrOffset;
     
     uint64_t totalBytes;
 };
 
 struct SceneLoadData {
     StagingHeader hdr;
+    std::vector<GeometryBlock> geometryBlocks;
     std::vector<MeshInfo> meshInfo;
     std::vector<ObjectInfo> objectInfo;
     TextureInfo textureInfo;
     std::vector<MaterialTextures> textureIndices;
     EnvironmentInit envInit;
     PhysicsMetadata physics;
+    std::vector<SceneChunk> chunks;
     std::string scenePath;
+    // File offset of the staged data that GeometryBlock offsets refer to
+    uint64_t stagingOffset;
 
     std::variant<std::ifstream, std::vector<char>> data;
 
@@ -176,6 +225,8 @@ struct Scene {
     std::vector<ObjectInfo> objectInfo;
     EnvironmentInit envInit;
     uint32_t numMaterials;
+    // Source of ObjectInstance::libraryFlag objects, may be null
+    std::shared_ptr<Scene> objectLibrary;
 };
 
 }
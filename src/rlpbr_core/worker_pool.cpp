@@ -0,0 +1,112 @@
+#include "worker_pool.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace RLpbr {
+
+WorkerPool::WorkerPool(uint32_t num_workers)
+    : workers_(),
+      lock_(),
+      start_cv_(),
+      finish_cv_(),
+      generation_(0),
+      num_pending_(0),
+      exit_(false),
+      fn_(nullptr),
+      num_items_(0)
+{
+    workers_.reserve(num_workers);
+    for (uint32_t i = 0; i < num_workers; i++) {
+        workers_.emplace_back([this, i]() {
+            workerLoop(i);
+        });
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> guard(lock_);
+        exit_ = true;
+    }
+    start_cv_.notify_all();
+
+    for (thread &worker : workers_) {
+        worker.join();
+    }
+}
+
+void WorkerPool::parallelFor(uint32_t num_items,
+                             const function<void(uint32_t)> &fn)
+{
+    if (workers_.empty() || num_items <= 1) {
+        for (uint32_t i = 0; i < num_items; i++) {
+            fn(i);
+        }
+        return;
+    }
+
+    {
+        lock_guard<mutex> guard(lock_);
+        fn_ = &fn;
+        num_items_ = num_items;
+        num_pending_ = workers_.size();
+        generation_++;
+    }
+    start_cv_.notify_all();
+
+    runChunk(0);
+
+    unique_lock<mutex> guard(lock_);
+    finish_cv_.wait(guard, [this]() { return num_pending_ == 0; });
+    fn_ = nullptr;
+}
+
+void WorkerPool::workerLoop(uint32_t worker_idx)
+{
+    uint64_t last_generation = 0;
+
+    while (true) {
+        {
+            unique_lock<mutex> guard(lock_);
+            start_cv_.wait(guard, [&]() {
+                return exit_ || generation_ != last_generation;
+            });
+
+            if (exit_) {
+                return;
+            }
+
+            last_generation = generation_;
+        }
+
+        runChunk(worker_idx + 1);
+
+        bool last;
+        {
+            lock_guard<mutex> guard(lock_);
+            last = --num_pending_ == 0;
+        }
+
+        if (last) {
+            finish_cv_.notify_one();
+        }
+    }
+}
+
+void WorkerPool::runChunk(uint32_t chunk_idx)
+{
+    uint32_t num_chunks = numThreads();
+    uint32_t chunk_size = (num_items_ + num_chunks - 1) / num_chunks;
+
+    uint32_t start = min(chunk_idx * chunk_size, num_items_);
+    uint32_t end = min(start + chunk_size, num_items_);
+
+    for (uint32_t i = start; i < end; i++) {
+        (*fn_)(i);
+    }
+}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RLpbr {
+
+// Fixed set of threads for splitting per environment CPU work. Items are
+// statically partitioned into contiguous chunks, so which thread processes
+// an item never affects the results.
+class WorkerPool {
+public:
+    // num_workers = 0 runs everything on the calling thread
+    explicit WorkerPool(uint32_t num_workers);
+    WorkerPool(const WorkerPool &) = delete;
+    ~WorkerPool();
+
+    // Calls fn(idx) for every idx in [0, num_items) and waits for all calls
+    // to finish. The calling thread processes the first chunk.
+    void parallelFor(uint32_t num_items,
+                     const std::function<void(uint32_t)> &fn);
+
+    inline uint32_t numThreads() const { return workers_.size() + 1; }
+
+private:
+    void workerLoop(uint32_t worker_idx);
+    void runChunk(uint32_t chunk_idx);
+
+    std::vector<std::thread> workers_;
+
+    std::mutex lock_;
+    std::condition_variable start_cv_;
+    std::condition_variable finish_cv_;
+    uint64_t generation_;
+    uint32_t num_pending_;
+    bool exit_;
+
+    const std::function<void(uint32_t)> *fn_;
+    uint32_t num_items_;
+};
+
+}
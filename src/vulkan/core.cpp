@@ -319,17 +319,44 @@ VkPhysicalDevice InstanceState::findPhysicalDevice(
     fatalExit();
 }
 
+DeviceUUID InstanceState::getDeviceUUID(uint32_t idx) const
+{
+    uint32_t num_gpus;
+    REQ_VK(dt.enumeratePhysicalDevices(hdl, &num_gpus, nullptr));
+
+    DynArray<VkPhysicalDevice> phys(num_gpus);
+    REQ_VK(dt.enumeratePhysicalDevices(hdl, &num_gpus, phys.data()));
+
+    if (idx >= num_gpus) {
+        cerr << "Vulkan device " << idx << " out of range" << endl;
+        fatalExit();
+    }
+
+    VkPhysicalDeviceIDProperties dev_id {};
+    dev_id.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 props {};
+    props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    props.pNext = &dev_id;
+    dt.getPhysicalDeviceProperties2(phys[idx], &props);
+
+    DeviceUUID uuid;
+    memcpy(uuid.data(), dev_id.deviceUUID,
+           sizeof(DeviceUUID::value_type) * uuid.size());
+
+    return uuid;
+}
+
 DeviceState InstanceState::makeDevice(
     const DeviceUUID &uuid,
     uint32_t desired_gfx_queues,
     uint32_t desired_compute_queues,
     uint32_t desired_transfer_queues,
     add_pointer_t<VkBool32(VkInstance, VkPhysicalDevice, uint32_t)>
-        present_check) const
+        present_check,
+    bool cuda_interop) const
 {
     vector<const char *> extensions {
-        VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
-        VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME,
         VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
         VK_KHR_RAY_QUERY_EXTENSION_NAME,
         VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
@@ -339,6 +366,13 @@ DeviceState InstanceState::makeDevice(
         VK_EXT_SUBGROUP_SIZE_CONTROL_EXTENSION_NAME,
     };
 
+    // Only needed to share outputs with CUDA, leaving them out allows
+    // devices without them (e.g. software implementations)
+    if (cuda_interop) {
+        extensions.push_back(VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME);
+        extensions.push_back(VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME);
+    }
+
     bool need_present = present_check != nullptr;
 
     if (need_present) {
@@ -528,7 +562,8 @@ DeviceState InstanceState::makeDevice(
                         num_transfer_queues,
                         phy,
                         dev,
-                        DeviceDispatch(dev, get_dev_addr, need_present, true)};
+                        DeviceDispatch(dev, get_dev_addr, need_present, true,
+                                       cuda_interop)};
 }
 
 }
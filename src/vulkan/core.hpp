@@ -52,7 +52,11 @@ public:
         uint32_t desired_compute_queues,
         uint32_t desired_transfer_queues,
         std::add_pointer_t<VkBool32(VkInstance, VkPhysicalDevice, uint32_t)>
-            present_check) const;
+            present_check,
+        bool cuda_interop = true) const;
+
+    // UUID of the idx-th physical device in vulkan enumeration order
+    DeviceUUID getDeviceUUID(uint32_t idx) const;
 
 private:
     InstanceState(InstanceInitializer init, bool need_present);
@@ -24,7 +24,8 @@ InstanceDispatch::InstanceDispatch(VkInstance ctx,
 
 DeviceDispatch::DeviceDispatch(VkDevice ctx,
                                PFN_vkGetDeviceProcAddr get_dev_addr,
-                               bool need_present, bool need_rt)
+                               bool need_present, bool need_rt,
+                               bool need_external)
 #include "dispatch_device_impl.cpp"
 {}
 
@@ -177,6 +177,11 @@ void HostBuffer::flush(const DeviceState &dev,
     dev.dt.flushMappedMemoryRanges(dev.hdl, 1, &sub_range);
 }
 
+void HostBuffer::invalidate(const DeviceState &dev)
+{
+    dev.dt.invalidateMappedMemoryRanges(dev.hdl, 1, &mem_range_);
+}
+
 LocalBuffer::LocalBuffer(VkBuffer buf, AllocDeleter<false> deleter)
     : buffer(buf),
       deleter_(deleter)
@@ -46,6 +46,9 @@ public:
                VkDeviceSize offset,
                VkDeviceSize num_bytes);
 
+    // Makes device writes visible to the host (for non-coherent memory)
+    void invalidate(const DeviceState &dev);
+
     VkBuffer buffer;
     void *ptr;
 
@@ -3,9 +3,12 @@
 
 #include "scene.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <sstream>
 #include <cmath>
+#include <utility>
 
 using namespace std;
 
@@ -32,7 +35,36 @@ static InitConfig getInitConfig(const RenderConfig &cfg, bool validate)
     };
 }
 
+static OutputChannels getOutputChannels(const RenderConfig &cfg)
+{
+    OutputChannels channels = cfg.outputChannels;
+    if (channels == OutputChannels(0)) {
+        channels = OutputChannels::ColorHalf;
+    }
+
+    if ((channels & OutputChannels::DepthHalf) &&
+        (channels & OutputChannels::DepthFloat)) {
+        cerr << "Only one depth output format can be enabled" << endl;
+        fatalExit();
+    }
+
+    // Color outputs are written by the tonemapping pass
+    if ((channels & OutputChannels::ColorRGB8) &&
+        !(cfg.flags & RenderFlags::Tonemap)) {
+        cerr << "RGB8 output requires tonemapping" << endl;
+        fatalExit();
+    }
+
+    return channels;
+}
+
+static uint32_t getMaxViews(const RenderConfig &cfg)
+{
+    return max(cfg.maxViewsPerEnv, 1u);
+}
+
 static ParamBufferConfig getParamBufferConfig(uint32_t batch_size,
+                                              uint32_t max_views,
                                               const MemoryAllocator &alloc)
 {
     ParamBufferConfig cfg {};
@@ -59,6 +91,17 @@ static ParamBufferConfig getParamBufferConfig(uint32_t batch_size,
 
     cur_offset = cfg.envOffset + cfg.totalEnvParamBytes;
 
+    cfg.viewOffset = alloc.alignStorageBufferOffset(cur_offset);
+    cfg.totalViewBytes = sizeof(PackedView) * batch_size * max_views;
+
+    cur_offset = cfg.viewOffset + cfg.totalViewBytes;
+
+    cfg.renderSettingsOffset = alloc.alignStorageBufferOffset(cur_offset);
+    cfg.totalRenderSettingsBytes =
+        sizeof(PackedRenderSettings) * batch_size * max_views;
+
+    cur_offset = cfg.renderSettingsOffset + cfg.totalRenderSettingsBytes;
+
     // Ensure that full block is aligned to maximum requirement
     cfg.totalParamBytes =  alloc.alignStorageBufferOffset(cur_offset);
 
@@ -67,7 +110,8 @@ static ParamBufferConfig getParamBufferConfig(uint32_t batch_size,
 
 static FramebufferConfig getFramebufferConfig(const RenderConfig &cfg)
 {
-    uint32_t batch_size = cfg.batchSize;
+    // Every view of every environment gets its own image
+    uint32_t batch_size = cfg.batchSize * getMaxViews(cfg);
 
     uint32_t minibatch_size =
         max(batch_size / VulkanConfig::minibatch_divisor, batch_size);
@@ -98,13 +142,18 @@ static FramebufferConfig getFramebufferConfig(const RenderConfig &cfg)
     uint32_t batch_fb_width = cfg.imgWidth * batch_fb_images_wide;
     uint32_t batch_fb_height = cfg.imgHeight * batch_fb_images_tall;
 
-    uint32_t pixels_per_batch = batch_fb_width * batch_fb_height;
+    uint64_t pixels_per_batch = uint64_t(batch_fb_width) * batch_fb_height;
 
-    uint32_t output_bytes = 4 * sizeof(uint16_t) * pixels_per_batch;
-    uint32_t hdr_bytes = 4 * sizeof(float) * pixels_per_batch;
-    uint32_t normal_bytes = 3 * sizeof(uint16_t) * pixels_per_batch;
-    uint32_t albedo_bytes = 3 * sizeof(uint16_t) * pixels_per_batch;
-    uint32_t reservoir_bytes = sizeof(Reservoir) * pixels_per_batch;
+    VkDeviceSize output_bytes = 4 * sizeof(uint16_t) * pixels_per_batch;
+    VkDeviceSize hdr_bytes = 4 * sizeof(float) * pixels_per_batch;
+    VkDeviceSize normal_bytes = 3 * sizeof(uint16_t) * pixels_per_batch;
+    VkDeviceSize albedo_bytes = 3 * sizeof(uint16_t) * pixels_per_batch;
+    VkDeviceSize rgb8_bytes = 4 * sizeof(uint8_t) * pixels_per_batch;
+    VkDeviceSize depth_bytes =
+        ((getOutputChannels(cfg) & OutputChannels::DepthHalf) ?
+            sizeof(uint16_t) : sizeof(float)) * pixels_per_batch;
+    VkDeviceSize id_bytes = sizeof(uint32_t) * pixels_per_batch;
+    VkDeviceSize reservoir_bytes = sizeof(Reservoir) * pixels_per_batch;
 
     // FIXME: dedup this with the EXPOSURE_RES_X code
     uint32_t num_tiles_wide =
@@ -112,11 +161,11 @@ static FramebufferConfig getFramebufferConfig(const RenderConfig &cfg)
     uint32_t num_tiles_tall =
         divideRoundUp(cfg.imgHeight, VulkanConfig::localWorkgroupY);
 
-    uint32_t illuminance_bytes =
-        sizeof(float) * num_tiles_wide * num_tiles_tall * batch_size;
+    uint64_t tiles_per_batch =
+        uint64_t(num_tiles_wide) * num_tiles_tall * batch_size;
 
-    uint32_t adaptive_bytes =
-        sizeof(AdaptiveTile) * num_tiles_wide * num_tiles_tall * batch_size;
+    VkDeviceSize illuminance_bytes = sizeof(float) * tiles_per_batch;
+    VkDeviceSize adaptive_bytes = sizeof(AdaptiveTile) * tiles_per_batch;
 
     return FramebufferConfig {
         cfg.imgWidth,
@@ -134,6 +183,9 @@ static FramebufferConfig getFramebufferConfig(const RenderConfig &cfg)
         hdr_bytes,
         normal_bytes,
         albedo_bytes,
+        rgb8_bytes,
+        depth_bytes,
+        id_bytes,
         reservoir_bytes,
         illuminance_bytes,
         adaptive_bytes,
@@ -154,6 +206,30 @@ static RenderState makeRenderState(const DeviceState &dev,
         return 32 - __builtin_clz(v) - 1;
     };
 
+    // Per image settings pack two 16 bit values per word
+    if (cfg.imgWidth > 65535 || cfg.imgHeight > 65535 ||
+        cfg.spp > 65535 || cfg.maxDepth > 65535 ||
+        cfg.batchSize > 65535 || getMaxViews(cfg) > 65535) {
+        cerr << "Resolution, spp, max depth, batch size and views are "
+            "limited to 65535" << endl;
+        fatalExit();
+    }
+
+    // Shaders index the output buffers with 32 bit pixel offsets
+    if (uint64_t(cfg.imgWidth) * cfg.imgHeight * cfg.batchSize *
+            getMaxViews(cfg) > UINT32_MAX) {
+        cerr << "Batch size * views * resolution is limited to 2^32 pixels"
+             << endl;
+        fatalExit();
+    }
+
+    if (getMaxViews(cfg) > 1 && (cfg.flags & (RenderFlags::AdaptiveSample |
+                                              RenderFlags::Denoise))) {
+        cerr << "Multiple views are not supported with adaptive sampling or "
+            "denoising" << endl;
+        fatalExit();
+    }
+
     uint32_t spp = cfg.spp;
     if (cfg.flags & RenderFlags::AdaptiveSample) {
 #if 0
@@ -213,6 +289,7 @@ static RenderState makeRenderState(const DeviceState &dev,
         string("NUM_WORKGROUPS_X (") + to_string(num_workgroups_x) + "u)",
         string("NUM_WORKGROUPS_Y (") + to_string(num_workgroups_y) + "u)",
         string("BATCH_SIZE (") + to_string(cfg.batchSize) + "u)",
+        string("MAX_VIEWS (") + to_string(getMaxViews(cfg)) + "u)",
         sampling_define,
         string("ZSOBOL_NUM_BASE4 (") + to_string(num_index_digits_base4) + "u)",
         string("ZSOBOL_INDEX_SHIFT (") + to_string(index_shift) + "u)",
@@ -238,6 +315,24 @@ static RenderState makeRenderState(const DeviceState &dev,
          rt_defines.emplace_back("TONEMAP");
     }
 
+    OutputChannels channels = getOutputChannels(cfg);
+    if ((channels & OutputChannels::DepthHalf) ||
+        (channels & OutputChannels::DepthFloat)) {
+        rt_defines.emplace_back("OUTPUT_DEPTH");
+
+        if (channels & OutputChannels::DepthHalf) {
+            rt_defines.emplace_back("DEPTH_HALF");
+        }
+    }
+
+    if (channels & OutputChannels::InstanceID) {
+        rt_defines.emplace_back("OUTPUT_INSTANCE");
+    }
+
+    if (channels & OutputChannels::SemanticID) {
+        rt_defines.emplace_back("OUTPUT_SEMANTIC");
+    }
+
     if (cfg.flags & RenderFlags::AdaptiveSample) {
         rt_defines.emplace_back("ADAPTIVE_SAMPLING");
     }
@@ -312,6 +407,14 @@ static RenderState makeRenderState(const DeviceState &dev,
         string("RES_Y (") + to_string(cfg.imgHeight) + "u)",
     };
 
+    if (channels & OutputChannels::ColorHalf) {
+        tonemap_defines.emplace_back("OUTPUT_COLOR_HALF");
+    }
+
+    if (channels & OutputChannels::ColorRGB8) {
+        tonemap_defines.emplace_back("OUTPUT_RGB8");
+    }
+
     if (init_cfg.validate) {
         rt_defines.push_back("VALIDATE");
         exposure_defines.push_back("VALIDATE");
@@ -519,87 +622,95 @@ static FramebufferState makeFramebuffer(const DeviceState &dev,
 {
     vector<LocalBuffer> outputs;
     vector<VkDeviceMemory> backings;
+    vector<ExportedOutput> exported_outputs;
     vector<CudaImportedBuffer> exported;
+    vector<HostBuffer> host_outputs;
 
-    uint32_t num_buffers = 2;
-    uint32_t num_exported_buffers = 1;
+    OutputChannels channels = cfg.outputChannels;
+    bool need_depth = (channels & OutputChannels::DepthHalf) ||
+        (channels & OutputChannels::DepthFloat);
 
-    int output_idx = 0;
-    int hdr_idx = 1;
-    int normal_idx = -1;
-    int albedo_idx = -1;
-    int illuminance_idx = -1;
-    int adaptive_idx = -1;
+    // Upper bound, all buffers are optional besides hdr
+    constexpr uint32_t max_buffers = 10;
 
-    if (cfg.auxiliaryOutputs) {
-        num_buffers += 2;
-        num_exported_buffers += 2;
+    outputs.reserve(max_buffers);
+    backings.reserve(max_buffers);
+    exported_outputs.reserve(max_buffers);
+    exported.reserve(max_buffers);
+    host_outputs.reserve(max_buffers);
 
-        normal_idx = 2;
-        albedo_idx = 3;
-    }
+    auto addOutput = [&](VkDeviceSize num_bytes, bool user_visible) {
+        int idx = outputs.size();
 
-    if (cfg.tonemap) {
-        illuminance_idx = num_buffers++;
-    }
+        auto [buffer, mem] = alloc.makeDedicatedBuffer(num_bytes);
 
-    if (cfg.adaptiveSampling) {
-        adaptive_idx = num_buffers++;
-    }
+        outputs.emplace_back(move(buffer));
+        backings.emplace_back(move(mem));
 
-    outputs.reserve(num_buffers);
-    backings.reserve(num_buffers);
-    exported.reserve(num_exported_buffers);
+        if (user_visible) {
+            exported_outputs.push_back({
+                idx,
+                num_bytes,
+            });
+
+            if (cfg.hostOutputs) {
+                host_outputs.emplace_back(
+                    alloc.makeHostBuffer(num_bytes));
+            } else {
+                exported.emplace_back(dev, cfg.gpuID, backings.back(),
+                                      num_bytes);
+            }
+        }
 
-    auto [main_buffer, main_mem] =
-        alloc.makeDedicatedBuffer(fb_cfg.outputBytes);
+        return idx;
+    };
 
-    outputs.emplace_back(move(main_buffer));
-    backings.emplace_back(move(main_mem));
-    exported.emplace_back(dev, cfg.gpuID, backings.back(),
-                          fb_cfg.outputBytes);
+    int output_idx = -1;
+    int normal_idx = -1;
+    int albedo_idx = -1;
+    int illuminance_idx = -1;
+    int adaptive_idx = -1;
+    int rgb8_idx = -1;
+    int depth_idx = -1;
+    int instance_idx = -1;
+    int semantic_idx = -1;
 
-    auto [hdr_buffer, hdr_mem] =
-        alloc.makeDedicatedBuffer(fb_cfg.hdrBytes);
+    if (channels & OutputChannels::ColorHalf) {
+        output_idx = addOutput(fb_cfg.outputBytes, true);
+    }
 
-    outputs.emplace_back(move(hdr_buffer));
-    backings.emplace_back(move(hdr_mem));
+    int hdr_idx = addOutput(fb_cfg.hdrBytes, false);
 
     if (cfg.auxiliaryOutputs) {
-        auto [normal_buffer, normal_mem] =
-            alloc.makeDedicatedBuffer(fb_cfg.normalBytes);
+        normal_idx = addOutput(fb_cfg.normalBytes, true);
+        albedo_idx = addOutput(fb_cfg.albedoBytes, true);
+    }
+
+    if (channels & OutputChannels::ColorRGB8) {
+        rgb8_idx = addOutput(fb_cfg.rgb8Bytes, true);
+    }
 
-        outputs.emplace_back(move(normal_buffer));
-        backings.emplace_back(move(normal_mem));
-        exported.emplace_back(dev, cfg.gpuID, backings.back(),
-                              fb_cfg.normalBytes);
+    if (need_depth) {
+        depth_idx = addOutput(fb_cfg.depthBytes, true);
+    }
 
-        auto [albedo_buffer, albedo_mem] =
-            alloc.makeDedicatedBuffer(fb_cfg.albedoBytes);
+    if (channels & OutputChannels::InstanceID) {
+        instance_idx = addOutput(fb_cfg.idBytes, true);
+    }
 
-        outputs.emplace_back(move(albedo_buffer));
-        backings.emplace_back(move(albedo_mem));
-        exported.emplace_back(dev, cfg.gpuID, backings.back(),
-                              fb_cfg.albedoBytes);
+    if (channels & OutputChannels::SemanticID) {
+        semantic_idx = addOutput(fb_cfg.idBytes, true);
     }
 
     if (cfg.tonemap) {
-        auto [illum_buffer, illum_mem] =
-            alloc.makeDedicatedBuffer(fb_cfg.illuminanceBytes);
-
-        outputs.emplace_back(move(illum_buffer));
-        backings.emplace_back(move(illum_mem));
+        illuminance_idx = addOutput(fb_cfg.illuminanceBytes, false);
     }
 
     optional<HostBuffer> adaptive_readback;
     optional<HostBuffer> exposure_readback;
 
     if (cfg.adaptiveSampling) {
-        auto [adaptive_buffer, adaptive_mem] =
-            alloc.makeDedicatedBuffer(fb_cfg.adaptiveBytes);
-
-        outputs.emplace_back(move(adaptive_buffer));
-        backings.emplace_back(move(adaptive_mem));
+        adaptive_idx = addOutput(fb_cfg.adaptiveBytes, false);
 
         // FIXME: specific readback buffer type
         adaptive_readback = alloc.makeHostBuffer(fb_cfg.adaptiveBytes, true);
@@ -624,7 +735,9 @@ static FramebufferState makeFramebuffer(const DeviceState &dev,
     return FramebufferState {
         move(outputs),
         move(backings),
+        move(exported_outputs),
         move(exported),
+        move(host_outputs),
         move(reservoirs),
         move(reservoir_mem),
         move(adaptive_readback),
@@ -635,6 +748,10 @@ static FramebufferState makeFramebuffer(const DeviceState &dev,
         albedo_idx,
         illuminance_idx,
         adaptive_idx,
+        rgb8_idx,
+        depth_idx,
+        instance_idx,
+        semantic_idx,
     };
 }
 
@@ -665,15 +782,38 @@ static PerBatchState makePerBatchState(const DeviceState &dev,
     VkCommandPool cmd_pool = makeCmdPool(dev, dev.computeQF);
     VkCommandBuffer render_cmd = makeCmdBuffer(dev, cmd_pool);
 
-    half *output_buffer = (half *)fb.exported[0].getDevicePointer();
+    auto getOutputPtr = [&fb](int output_idx) -> void * {
+        for (int i = 0; i < (int)fb.exportedOutputs.size(); i++) {
+            if (fb.exportedOutputs[i].outputIdx != output_idx) {
+                continue;
+            }
+
+            if (fb.hostOutputs.size() > 0) {
+                return fb.hostOutputs[i].ptr;
+            } else {
+                return fb.exported[i].getDevicePointer();
+            }
+        }
+
+        return nullptr;
+    };
+
+    half *output_buffer = (half *)getOutputPtr(fb.outputIdx);
 
     half *normal_buffer = nullptr, *albedo_buffer = nullptr;
     if (auxiliary_outputs) {
-        normal_buffer = (half *)fb.exported[1].getDevicePointer();
+        normal_buffer = (half *)getOutputPtr(fb.normalIdx);
 
-        albedo_buffer = (half *)fb.exported[2].getDevicePointer();
+        albedo_buffer = (half *)getOutputPtr(fb.albedoIdx);
     }
 
+    ChannelOutputs channel_buffers {
+        (uint8_t *)getOutputPtr(fb.rgb8Idx),
+        getOutputPtr(fb.depthIdx),
+        (uint32_t *)getOutputPtr(fb.instanceIdx),
+        (uint32_t *)getOutputPtr(fb.semanticIdx),
+    };
+
     AdaptiveTile *adaptive_readback_ptr = nullptr;
     if (adaptive_sampling) {
         adaptive_readback_ptr = (AdaptiveTile *)fb.adaptiveReadback->ptr;
@@ -696,6 +836,12 @@ static PerBatchState makePerBatchState(const DeviceState &dev,
     PackedEnv *env_ptr =
         reinterpret_cast<PackedEnv *>(base_ptr + param_cfg.envOffset);
 
+    PackedView *view_ptr =
+        reinterpret_cast<PackedView *>(base_ptr + param_cfg.viewOffset);
+
+    PackedRenderSettings *settings_ptr = reinterpret_cast<PackedRenderSettings *>(
+        base_ptr + param_cfg.renderSettingsOffset);
+
     DescriptorUpdates desc_updates(14);
 
     VkDescriptorBufferInfo transform_info {
@@ -722,6 +868,18 @@ static PerBatchState makePerBatchState(const DeviceState &dev,
         param_cfg.totalEnvParamBytes,
     };
 
+    VkDescriptorBufferInfo view_info {
+        dev_param_buffer.buffer,
+        param_cfg.viewOffset,
+        param_cfg.totalViewBytes,
+    };
+
+    VkDescriptorBufferInfo settings_info {
+        dev_param_buffer.buffer,
+        param_cfg.renderSettingsOffset,
+        param_cfg.totalRenderSettingsBytes,
+    };
+
     VkDescriptorImageInfo diffuse_avg_info {
         VK_NULL_HANDLE,
         precomp_tex.msDiffuseAverage.second,
@@ -752,12 +910,6 @@ static PerBatchState makePerBatchState(const DeviceState &dev,
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
     };
 
-    VkDescriptorBufferInfo out_info {
-        fb.outputs[fb.outputIdx].buffer,
-        0,
-        fb_cfg.outputBytes,
-    };
-
     VkDescriptorBufferInfo hdr_info {
         fb.outputs[fb.hdrIdx].buffer,
         0,
@@ -777,6 +929,12 @@ static PerBatchState makePerBatchState(const DeviceState &dev,
         desc_updates.buffer(rt_sets[i], &env_info, 3,
                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
 
+        desc_updates.buffer(rt_sets[i], &settings_info, 22,
+                            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+        desc_updates.buffer(rt_sets[i], &view_info, 23,
+                            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
         desc_updates.textures(rt_sets[i], &diffuse_avg_info, 1, 6);
         desc_updates.textures(rt_sets[i], &diffuse_dir_info, 1, 7);
         desc_updates.textures(rt_sets[i], &ggx_avg_info, 1, 8);
@@ -833,6 +991,8 @@ static PerBatchState makePerBatchState(const DeviceState &dev,
     }
 
     VkDescriptorBufferInfo illuminance_info;
+    VkDescriptorBufferInfo out_info;
+    VkDescriptorBufferInfo rgb8_info;
 
     if (tonemap) {
         illuminance_info = {
@@ -852,14 +1012,65 @@ static PerBatchState makePerBatchState(const DeviceState &dev,
         desc_updates.buffer(exposure_set, &hdr_info, 1,
                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
 
+        desc_updates.buffer(exposure_set, &settings_info, 2,
+                            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
         desc_updates.buffer(tonemap_set, &illuminance_info, 0,
                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
 
         desc_updates.buffer(tonemap_set, &hdr_info, 1,
                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
 
-        desc_updates.buffer(tonemap_set, &out_info, 2,
+        desc_updates.buffer(tonemap_set, &settings_info, 4,
                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+        if (fb.outputIdx != -1) {
+            out_info = {
+                fb.outputs[fb.outputIdx].buffer,
+                0,
+                fb_cfg.outputBytes,
+            };
+
+            desc_updates.buffer(tonemap_set, &out_info, 2,
+                                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        }
+
+        if (fb.rgb8Idx != -1) {
+            rgb8_info = {
+                fb.outputs[fb.rgb8Idx].buffer,
+                0,
+                fb_cfg.rgb8Bytes,
+            };
+
+            desc_updates.buffer(tonemap_set, &rgb8_info, 3,
+                                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        }
+    }
+
+    // Primary hit channels, shared by both rt sets
+    array<VkDescriptorBufferInfo, 3> channel_infos;
+    array<pair<int, VkDeviceSize>, 3> channel_bindings {{
+        { fb.depthIdx, fb_cfg.depthBytes },
+        { fb.instanceIdx, fb_cfg.idBytes },
+        { fb.semanticIdx, fb_cfg.idBytes },
+    }};
+
+    for (int i = 0; i < (int)channel_bindings.size(); i++) {
+        auto [output_idx, num_bytes] = channel_bindings[i];
+        if (output_idx == -1) {
+            continue;
+        }
+
+        channel_infos[i] = {
+            fb.outputs[output_idx].buffer,
+            0,
+            num_bytes,
+        };
+
+        for (int j = 0; j < (int)rt_sets.size(); j++) {
+            desc_updates.buffer(rt_sets[j], &channel_infos[i], 19 + i,
+                                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        }
     }
 
     VkDescriptorBufferInfo tile_input_info;
@@ -896,6 +1107,7 @@ static PerBatchState makePerBatchState(const DeviceState &dev,
         output_buffer,
         normal_buffer,
         albedo_buffer,
+        channel_buffers,
         move(rt_pool),
         move(rt_sets),
         move(exposure_pool),
@@ -906,6 +1118,8 @@ static PerBatchState makePerBatchState(const DeviceState &dev,
         material_ptr,
         light_ptr,
         env_ptr,
+        view_ptr,
+        settings_ptr,
         (InputTile *)tile_input_buffer->ptr,
         adaptive_readback_ptr,
     };
@@ -1162,15 +1376,6 @@ static DynArray<QueueState> initComputeQueues(const RenderConfig &cfg,
     return queues;
 }
 
-static glm::u32vec3 getLaunchSize(const RenderConfig &cfg)
-{
-    return {
-        divideRoundUp(cfg.imgWidth, VulkanConfig::localWorkgroupX),
-        divideRoundUp(cfg.imgHeight, VulkanConfig::localWorkgroupY),
-        divideRoundUp(cfg.batchSize, VulkanConfig::localWorkgroupZ),
-    };
-}
-
 static InstanceState makeInstance(const InitConfig &init_cfg)
 {
     if (init_cfg.needPresent) {
@@ -1194,11 +1399,18 @@ static DeviceState makeDevice(const InstanceState &inst,
 
     uint32_t num_compute_queues = 2 + cfg.numLoaders;
 
-    return inst.makeDevice(getUUIDFromCudaID(cfg.gpuID),
+    // Without CUDA interop gpuID is a vulkan device index
+    bool cuda_interop = !(cfg.flags & RenderFlags::HostOutputs);
+    DeviceUUID uuid = cuda_interop ?
+        getUUIDFromCudaID(cfg.gpuID) :
+        inst.getDeviceUUID(cfg.gpuID);
+
+    return inst.makeDevice(uuid,
                            1,
                            num_compute_queues, 
                            cfg.numLoaders,
-                           present_callback);
+                           present_callback,
+                           cuda_interop);
 }
 
 VulkanBackend::VulkanBackend(const RenderConfig &cfg, bool validate)
@@ -1219,20 +1431,35 @@ VulkanBackend::VulkanBackend(const RenderConfig &cfg,
           cfg.flags & RenderFlags::Randomize,
           cfg.flags & RenderFlags::AdaptiveSample,
           cfg.flags & RenderFlags::Denoise,
+          cfg.numWorkerThreads,
+          cfg.randomSeed,
+          cfg.maxInFlightBatches,
+          cfg.flags & RenderFlags::HostOutputs,
+          getOutputChannels(cfg),
+          {
+              cfg.imgWidth,
+              cfg.imgHeight,
+              cfg.spp,
+              cfg.maxDepth,
+          },
+          getMaxViews(cfg),
+          cfg.culling,
+          cfg.cullDistance,
+          cfg.streamingBudget,
       }),
       inst(makeInstance(init_cfg)),
       dev(makeDevice(inst, cfg, init_cfg)),
       alloc(dev, inst),
+      env_pool_(dev, alloc),
       fb_cfg_(getFramebufferConfig(cfg)),
       param_cfg_(
-          getParamBufferConfig(cfg.batchSize, alloc)),
+          getParamBufferConfig(cfg.batchSize, getMaxViews(cfg), alloc)),
       render_state_(makeRenderState(dev, cfg, init_cfg)),
       pipelines_(makePipelines(dev, render_state_)),
       transfer_queues_(initTransferQueues(cfg, dev)),
       compute_queues_(initComputeQueues(cfg, dev)),
       bsdf_precomp_(loadPrecomputedTextures(dev, alloc, compute_queues_[0],
                     dev.computeQF)),
-      launch_size_(getLaunchSize(cfg)),
       num_loaders_(0),
       scene_pool_(render_state_.rt.makePool(1, 1)),
       shared_scene_state_(dev, scene_pool_, render_state_.rt.getLayout(1),
@@ -1242,13 +1469,16 @@ VulkanBackend::VulkanBackend(const RenderConfig &cfg,
       cur_env_maps_(nullptr),
       cur_queue_(0),
       frame_counter_(0),
+      num_renders_(0),
+      in_flight_batches_(),
       present_(init_cfg.needPresent ?
           make_optional<PresentationState>(inst, dev, dev.computeQF,
                                            1, glm::u32vec2(1, 1), true) :
           optional<PresentationState>()),
       denoiser_((cfg.flags & RenderFlags::Denoise) ?
                 make_optional<Denoiser>(alloc, cfg) :
-                optional<Denoiser>())
+                optional<Denoiser>()),
+      packing_pool_(cfg.numWorkerThreads)
 {
     if (init_cfg.needPresent) {
         present_->forceTransition(dev, compute_queues_[0], dev.computeQF);
@@ -1276,16 +1506,19 @@ LoaderImpl VulkanBackend::makeLoader()
 EnvironmentImpl VulkanBackend::makeEnvironment(const shared_ptr<Scene> &scene,
                                                const Camera &cam)
 {
-    // FIXME: allow seeding, get rid of thread_local, need some kind of
-    // VulkanBackend thread context
-    static thread_local mt19937 rand_gen {random_device {}()};
-
     const VulkanScene &vk_scene = *static_cast<VulkanScene *>(scene.get());
-    VulkanEnvironment *environment =
-        new VulkanEnvironment(dev, vk_scene, cam, rand_gen,
-                              cfg_.enableRandomization,
-                              cur_env_maps_->texData.textures.size() / 2);
-    return makeEnvironmentImpl<VulkanEnvironment>(environment);
+
+    // Library objects are never streamed in
+    const VulkanScene *library =
+        static_cast<const VulkanScene *>(scene->objectLibrary.get());
+    if (library && library->chunkStreamer) {
+        cerr << "Object libraries can't contain streamed chunks" << endl;
+        fatalExit();
+    }
+
+    VulkanEnvironment *environment = env_pool_.acquire(vk_scene, cam);
+    return makeEnvironmentImpl<VulkanEnvironment>(environment,
+        VulkanEnvironment::release);
 }
 
 void VulkanBackend::setActiveEnvironmentMaps(
@@ -1297,8 +1530,12 @@ void VulkanBackend::setActiveEnvironmentMaps(
 
 RenderBatch::Handle VulkanBackend::makeRenderBatch()
 {
-    auto deleter = [](void *, BatchBackend *base_ptr) {
+    auto deleter = [](void *state, BatchBackend *base_ptr) {
+        auto backend = static_cast<VulkanBackend *>(state);
         auto ptr = static_cast<VulkanBatch *>(base_ptr);
+
+        // Don't free resources the GPU may still be using
+        backend->retireBatch(*ptr);
         delete ptr;
     };
 
@@ -1337,9 +1574,15 @@ RenderBatch::Handle VulkanBackend::makeRenderBatch()
         move(render_input_dev),
         move(batch_state),
         0,
+        vector<EnvUploadLayout>(cfg_.batchSize, EnvUploadLayout {}),
+        0,
+        0,
+        false,
+        0.f,
+        0,
     };
 
-    return RenderBatch::Handle(backend, {nullptr, deleter});
+    return RenderBatch::Handle(backend, {this, deleter});
 }
 
 static PackedCamera packCamera(const Camera &cam)
@@ -1349,27 +1592,206 @@ static PackedCamera packCamera(const Camera &cam)
     // FIXME, consider elevating the quaternion representation to
     // external camera interface
     // FIXME: cam.aspectRatio is no longer respected
-    glm::quat rotation =
-        glm::quat_cast(glm::mat3(cam.right, -cam.up, cam.view));
+    glm::vec3 view = cam.view;
+    glm::vec3 up = cam.up;
+    glm::vec3 right = cam.right;
+    float scale = cam.tanFOV;
+
+    if (cam.type == CameraType::CubemapFace) {
+        CameraHelper::cubemapFaceBasis(cam.view, cam.up, cam.right,
+            CubeFace(uint32_t(cam.typeParam)), view, up, right);
+        scale = 1.f;
+    } else if (cam.type == CameraType::Orthographic) {
+        scale = cam.typeParam;
+    }
+
+    glm::quat rotation = glm::quat_cast(glm::mat3(right, -up, view));
 
     packed.rotation =
         glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
 
-    packed.posAndTanFOV = glm::vec4(cam.position, cam.tanFOV);
+    packed.posAndTanFOV = glm::vec4(cam.position, scale);
+    packed.typeAndParam = glm::vec2(
+        glm::uintBitsToFloat(static_cast<uint32_t>(cam.type)),
+        cam.typeParam);
 
     return packed;
 }
 
+// Conservative visibility of each instance from any of the environment's
+// views. Returns true if the result differs from the previous pass.
+static bool cullInstances(const Environment &env,
+                          const EnvironmentRenderSettings &settings,
+                          const vector<AABB> &object_bounds,
+                          const vector<AABB> *library_bounds,
+                          InstanceCulling mode,
+                          float max_distance,
+                          vector<uint8_t> &visible_instances)
+{
+    struct ViewBounds {
+        glm::vec3 position;
+        float originRadius;
+        bool frustum;
+        // Outward facing normals of the side and near planes
+        glm::vec3 planes[5];
+    };
+
+    float aspect = float(settings.imgWidth) / float(settings.imgHeight);
+
+    uint32_t num_views = env.getNumViews();
+    DynArray<ViewBounds> views(num_views);
+    for (uint32_t view_idx = 0; view_idx < num_views; view_idx++) {
+        const Camera &cam = env.getView(view_idx);
+        ViewBounds &view = views[view_idx];
+
+        view.position = cam.position;
+
+        // Orthographic rays start anywhere on the view rectangle
+        view.originRadius = cam.type == CameraType::Orthographic ?
+            cam.typeParam * sqrtf(aspect * aspect + 1.f) : 0.f;
+
+        view.frustum = mode == InstanceCulling::Primary &&
+            cam.type == CameraType::Pinhole;
+
+        glm::vec3 fwd = glm::normalize(cam.view);
+        glm::vec3 right = glm::normalize(cam.right);
+        glm::vec3 up = glm::normalize(cam.up);
+
+        glm::vec3 right_slope = aspect * cam.tanFOV * fwd;
+        glm::vec3 up_slope = cam.tanFOV * fwd;
+
+        view.planes[0] = right - right_slope;
+        view.planes[1] = -right - right_slope;
+        view.planes[2] = up - up_slope;
+        view.planes[3] = -up - up_slope;
+        view.planes[4] = -fwd;
+    }
+
+    float max_dist_sq = max_distance > 0.f ?
+        max_distance * max_distance : INFINITY;
+
+    const vector<ObjectInstance> &instances = env.getInstances();
+    const vector<InstanceTransform> &transforms = env.getTransforms();
+    uint32_t num_instances = instances.size();
+
+    bool changed = visible_instances.size() != num_instances;
+    visible_instances.resize(num_instances);
+
+    for (uint32_t inst_idx = 0; inst_idx < num_instances; inst_idx++) {
+        uint32_t obj_idx = instances[inst_idx].objectIndex;
+        const AABB &bounds = (obj_idx & ObjectInstance::libraryFlag) ?
+            (*library_bounds)[obj_idx & ~ObjectInstance::libraryFlag] :
+            object_bounds[obj_idx];
+        const glm::mat4x3 &txfm = transforms[inst_idx].mat;
+
+        glm::vec3 obj_center = (bounds.pMin + bounds.pMax) / 2.f;
+        glm::vec3 obj_extent = (bounds.pMax - bounds.pMin) / 2.f;
+
+        // World space box around the transformed object box
+        glm::vec3 center = txfm * glm::vec4(obj_center, 1.f);
+        glm::vec3 extent =
+            glm::abs(txfm[0]) * obj_extent.x +
+            glm::abs(txfm[1]) * obj_extent.y +
+            glm::abs(txfm[2]) * obj_extent.z;
+
+        bool visible = false;
+        for (const ViewBounds &view : views) {
+            glm::vec3 to_center = center - view.position;
+
+            glm::vec3 closest = glm::max(glm::abs(to_center) - extent, 0.f);
+            float dist = max(glm::length(closest) - view.originRadius, 0.f);
+
+            if (dist * dist > max_dist_sq) {
+                continue;
+            }
+
+            bool in_frustum = true;
+            if (view.frustum) {
+                for (const glm::vec3 &plane : view.planes) {
+                    float min_plane_dist = glm::dot(to_center, plane) -
+                        glm::dot(extent, glm::abs(plane));
+
+                    if (min_plane_dist > 0.f) {
+                        in_frustum = false;
+                        break;
+                    }
+                }
+            }
+
+            if (in_frustum) {
+                visible = true;
+                break;
+            }
+        }
+
+        changed |= visible_instances[inst_idx] != visible;
+        visible_instances[inst_idx] = visible;
+    }
+
+    return changed;
+}
+
 static VulkanBatch *getVkBatch(RenderBatch &batch)
 {
     return static_cast<VulkanBatch *>(batch.getBackend());
 }
 
+float VulkanBackend::retireBatch(VulkanBatch &batch)
+{
+    if (!batch.inFlight) {
+        return 0.f;
+    }
+
+    auto start = chrono::steady_clock::now();
+    waitForFenceInfinitely(dev, batch.state.fence);
+    auto end = chrono::steady_clock::now();
+
+    resetFence(dev, batch.state.fence);
+    batch.inFlight = false;
+
+    for (HostBuffer &host_output : batch.fb.hostOutputs) {
+        host_output.invalidate(dev);
+    }
+
+    auto iter = find(in_flight_batches_.begin(), in_flight_batches_.end(),
+                     &batch);
+    if (iter != in_flight_batches_.end()) {
+        in_flight_batches_.erase(iter);
+    }
+
+    return chrono::duration<float, milli>(end - start).count();
+}
+
 void VulkanBackend::render(RenderBatch &batch)
 {
     VulkanBatch &batch_backend = *getVkBatch(batch);
     Environment *envs = batch.getEnvironments();
     PerBatchState &batch_state = batch_backend.state;
+
+    // This batch's buffers are about to be rewritten, so its previous
+    // frame must be finished. Other batches keep running unless the
+    // in flight limit has been reached.
+    batch_backend.lastStallMS = retireBatch(batch_backend);
+    while (cfg_.maxInFlightBatches > 0 &&
+           in_flight_batches_.size() >= cfg_.maxInFlightBatches) {
+        batch_backend.lastStallMS +=
+            retireBatch(*in_flight_batches_.front());
+    }
+
+    // Streamed out chunks and released environments can't be reused
+    // until every batch submitted before oldest_render has finished
+    batch_backend.renderIndex = num_renders_++;
+    uint64_t oldest_render = batch_backend.renderIndex;
+    for (const VulkanBatch *in_flight : in_flight_batches_) {
+        oldest_render = min(oldest_render, in_flight->renderIndex);
+    }
+    env_pool_.recycle(oldest_render);
+
+    // Waits for intermediate submissions within this frame
+    auto waitForSubmit = [&]() {
+        batch_backend.inFlight = true;
+        batch_backend.lastStallMS += retireBatch(batch_backend);
+    };
     VkCommandBuffer render_cmd = batch_state.renderCmd;
 
     auto startRenderSetup = [&]() {
@@ -1411,79 +1833,397 @@ void VulkanBackend::render(RenderBatch &batch)
 
     startRenderSetup();
 
-    // TLAS build
-    for (int batch_idx = 0; batch_idx < (int)cfg_.batchSize; batch_idx++) {
+    uint32_t batch_size = cfg_.batchSize;
+    bool cull_instances = cfg_.culling != InstanceCulling::None;
+
+    // Serial prepass: assign each environment its ranges in the parameter
+    // buffers and grow TLAS instance storage, so the per environment work
+    // below only touches memory owned by that environment.
+    // Environments still using their scene's default instances share a
+    // single transform range per scene, uploaded by the first of them.
+    vector<EnvUploadLayout> cur_layouts(batch_size);
+    vector<uint8_t> upload_transforms(batch_size);
+    vector<pair<const VulkanScene *, uint32_t>> shared_txfm_offsets;
+    uint32_t inst_offset = 0;
+    uint32_t material_offset = 0;
+    uint32_t light_offset = 0;
+    uint32_t num_shared_envs = 0;
+    for (uint32_t batch_idx = 0; batch_idx < batch_size; batch_idx++) {
+        if (!batch.isActive(batch_idx)) {
+            continue;
+        }
+
         const Environment &env = envs[batch_idx];
+        VulkanEnvironment &env_backend =
+            *(VulkanEnvironment *)(env.getBackend());
+        const VulkanScene *scene =
+            static_cast<const VulkanScene *>(env.getScene().get());
 
-        if (env.isDirty()) {
-            VulkanEnvironment &env_backend =
-                *(VulkanEnvironment *)(env.getBackend());
-            const VulkanScene &scene =
-                *static_cast<const VulkanScene *>(env.getScene().get());
+        uint32_t num_instances = env.getNumInstances();
+        uint32_t num_materials = env.getInstanceMaterials().size();
+        uint32_t num_lights = env_backend.lights.size();
+
+        uint32_t env_inst_offset = inst_offset;
+        bool owns_transforms = true;
+        if (env.hasDefaultInstances()) {
+            num_shared_envs++;
+
+            auto shared_iter = find_if(shared_txfm_offsets.begin(),
+                                       shared_txfm_offsets.end(),
+                [scene](const auto &entry) {
+                    return entry.first == scene;
+                });
+
+            if (shared_iter != shared_txfm_offsets.end()) {
+                env_inst_offset = shared_iter->second;
+                owns_transforms = false;
+            } else {
+                shared_txfm_offsets.emplace_back(scene, inst_offset);
+            }
+        }
 
-            env_backend.tlas.build(dev, alloc, env.getInstances(),
-                                   env.getTransforms(), env.getInstanceFlags(),
-                                   scene.objectInfo, scene.blases, render_cmd);
+        // Culled and streamed environments never use the scene's default
+        // TLAS
+        bool own_tlas = cull_instances || scene->chunkStreamer;
+        if (own_tlas || (!env.hasDefaultInstances() && env.isDirty())) {
+            env_pool_.reserveTLAS(env_backend.tlas, num_instances,
+                                  env_backend.releaseRenderIdx);
+        }
+        env_backend.releaseRenderIdx = batch_backend.renderIndex + 1;
+
+        cur_layouts[batch_idx] = {
+            &env_backend,
+            env_inst_offset,
+            num_instances,
+            material_offset,
+            num_materials,
+            light_offset,
+            num_lights,
+        };
+        upload_transforms[batch_idx] = owns_transforms;
 
-            env.clearDirty();
+        if (owns_transforms) {
+            inst_offset += num_instances;
         }
+        material_offset += num_materials;
+        light_offset += num_lights;
     }
 
-    VkMemoryBarrier tlas_barrier;
-    tlas_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
-    tlas_barrier.pNext = nullptr;
-    tlas_barrier.srcAccessMask =
-        VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
-    tlas_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    // Outputs are packed in environment then view order
+    // (Renderer::getOutputOffset). Every view gets its own launch slot.
+    // Slots are ordered by decreasing environment cost instead, so the
+    // most expensive environments are scheduled first and cheap ones fill
+    // in the tail of the dispatch. Inactive environments only get slots
+    // when their outputs need clearing.
+    vector<EnvironmentRenderSettings> env_settings(batch_size);
+    vector<uint32_t> launch_order;
+    launch_order.reserve(batch_size);
+    uint32_t launch_width = 0;
+    uint32_t launch_height = 0;
+    bool default_settings = true;
+    for (uint32_t batch_idx = 0; batch_idx < batch_size; batch_idx++) {
+        const EnvironmentRenderSettings &max_settings = cfg_.maxSettings;
+        EnvironmentRenderSettings settings =
+            envs[batch_idx].getRenderSettings(max_settings);
+
+        if (settings.imgWidth > max_settings.imgWidth ||
+            settings.imgHeight > max_settings.imgHeight ||
+            settings.spp > max_settings.spp ||
+            settings.maxDepth > max_settings.maxDepth) {
+            cerr << "Environment " << batch_idx <<
+                ": render settings exceed the RenderConfig limits" << endl;
+            fatalExit();
+        }
 
-    dev.dt.cmdPipelineBarrier(render_cmd,
-        VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
-        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
-        &tlas_barrier, 0, nullptr, 0, nullptr);
+        if (envs[batch_idx].getNumViews() > cfg_.maxViews) {
+            cerr << "Environment " << batch_idx << ": more than " <<
+                cfg_.maxViews << " views (RenderConfig::maxViewsPerEnv)" <<
+                endl;
+            fatalExit();
+        }
 
-    uint32_t inst_offset = 0;
-    uint32_t material_offset = 0;
-    uint32_t light_offset = 0;
+        default_settings &= settings.imgWidth == max_settings.imgWidth &&
+            settings.imgHeight == max_settings.imgHeight &&
+            settings.spp == max_settings.spp &&
+            settings.maxDepth == max_settings.maxDepth;
+
+        env_settings[batch_idx] = settings;
+
+        if (batch.isActive(batch_idx) || batch.clearInactive()) {
+            launch_width = max(launch_width, settings.imgWidth);
+            launch_height = max(launch_height, settings.imgHeight);
+            launch_order.push_back(batch_idx);
+        }
+    }
+
+    if ((!default_settings || !batch.allActive()) &&
+        (cfg_.adaptiveSampling || cfg_.denoise)) {
+        cerr << "Per environment render settings and partial batches are "
+            "not supported with adaptive sampling or denoising" << endl;
+        fatalExit();
+    }
+
+    if (!default_settings) {
+        auto envCost = [&](uint32_t batch_idx) {
+            const EnvironmentRenderSettings &settings =
+                env_settings[batch_idx];
+            return uint64_t(settings.imgWidth) * settings.imgHeight *
+                settings.spp * settings.maxDepth * envs[batch_idx].getNumViews();
+        };
+
+        stable_sort(launch_order.begin(), launch_order.end(),
+                    [&](uint32_t a, uint32_t b) {
+            return envCost(a) > envCost(b);
+        });
+    }
+
+    // Settings are bounded by the renderer's, so offsets fit in 32 bits
+    vector<uint64_t> pixel_offsets(batch_size);
+    uint64_t pixel_offset = 0;
+    for (uint32_t batch_idx = 0; batch_idx < batch_size; batch_idx++) {
+        const EnvironmentRenderSettings &settings = env_settings[batch_idx];
+        pixel_offsets[batch_idx] = pixel_offset;
+        pixel_offset += uint64_t(settings.imgWidth) * settings.imgHeight *
+            envs[batch_idx].getNumViews();
+    }
+
+    uint32_t num_slots = 0;
+    for (uint32_t batch_idx : launch_order) {
+        const EnvironmentRenderSettings &settings = env_settings[batch_idx];
+        uint64_t num_pixels = uint64_t(settings.imgWidth) * settings.imgHeight;
+
+        // 0 spp tells the shaders to only clear the outputs
+        uint32_t spp = batch.isActive(batch_idx) ? settings.spp : 0;
+
+        uint32_t num_views = envs[batch_idx].getNumViews();
+        for (uint32_t view_idx = 0; view_idx < num_views; view_idx++) {
+            batch_state.renderSettingsPtr[num_slots++].data = glm::u32vec4(
+                settings.imgWidth | (settings.imgHeight << 16),
+                spp | (settings.maxDepth << 16),
+                uint32_t(pixel_offsets[batch_idx] + view_idx * num_pixels),
+                batch_idx | (view_idx << 16));
+        }
+    }
+
+    glm::u32vec3 launch_size {
+        divideRoundUp(launch_width, VulkanConfig::localWorkgroupX),
+        divideRoundUp(launch_height, VulkanConfig::localWorkgroupY),
+        num_slots,
+    };
+
+    // The staging and device parameter buffers persist across frames, so
+    // only ranges that changed since the last upload need to be rewritten.
+    // Each environment owns a fixed set of copy slots (transforms,
+    // materials, lights), zero sized slots are skipped.
+    constexpr uint32_t copies_per_env = 3;
+    vector<VkBufferCopy> param_copies(batch_size * copies_per_env + 1,
+                                      VkBufferCopy {});
+
+    // Chunk residency follows the views of every live environment of the
+    // scene, refreshed here for the environments being rendered. Uploads
+    // and BLAS builds are recorded ahead of the TLAS builds.
+    vector<ChunkStreamer *> chunk_streamers;
+    for (uint32_t batch_idx = 0; batch_idx < batch_size; batch_idx++) {
+        if (!batch.isActive(batch_idx)) {
+            continue;
+        }
+
+        const Environment &env = envs[batch_idx];
+        VulkanEnvironment &env_backend =
+            *(VulkanEnvironment *)(env.getBackend());
+        ChunkStreamer *chunk_streamer = env_backend.chunkStreamer;
+        if (!chunk_streamer) {
+            continue;
+        }
+
+        env_backend.viewPositions.clear();
+        for (uint32_t view_idx = 0; view_idx < env.getNumViews();
+             view_idx++) {
+            env_backend.viewPositions.push_back(
+                env.getView(view_idx).position);
+        }
+
+        if (find(chunk_streamers.begin(), chunk_streamers.end(),
+                 chunk_streamer) == chunk_streamers.end()) {
+            chunk_streamers.push_back(chunk_streamer);
+        }
+    }
+
+    for (ChunkStreamer *chunk_streamer : chunk_streamers) {
+        chunk_streamer->update(cfg_.streamingBudget, render_cmd,
+            batch_backend.renderIndex, oldest_render);
+    }
 
     // Write environment data into linear buffers
-    for (int batch_idx = 0; batch_idx < (int)cfg_.batchSize; batch_idx++) {
+    packing_pool_.parallelFor(batch_size, [&](uint32_t batch_idx) {
+        // Inactive environments upload nothing. Forgetting the slot's
+        // layout forces a full upload once the environment is back, since
+        // active environments may have been packed over its ranges.
+        if (!batch.isActive(batch_idx)) {
+            batch_backend.uploadLayouts[batch_idx] = {};
+            return;
+        }
+
         Environment &env = envs[batch_idx];
         VulkanEnvironment &env_backend =
             *static_cast<VulkanEnvironment *>(env.getBackend());
         const VulkanScene &scene_backend =
             *static_cast<const VulkanScene *>(env.getScene().get());
 
+        VkBufferCopy *env_copies =
+            &param_copies[batch_idx * copies_per_env];
+        auto addParamCopy = [&](VkDeviceSize offset, VkDeviceSize num_bytes) {
+            *env_copies++ = {
+                offset,
+                offset,
+                num_bytes,
+            };
+        };
+
+        const VulkanScene *library_backend =
+            static_cast<const VulkanScene *>(
+                scene_backend.objectLibrary.get());
+
+        // Instances of chunks streamed in or out since the last TLAS build
+        // need rewriting
+        ChunkStreamer *chunk_streamer = scene_backend.chunkStreamer.get();
+        if (chunk_streamer &&
+            env_backend.chunkEpoch != chunk_streamer->getEpoch()) {
+            env_backend.chunkEpoch = chunk_streamer->getEpoch();
+            env.setDirty();
+        }
+
+        // The TLAS is only rebuilt when the culled set changes
+        if (cull_instances) {
+            bool visibility_changed = cullInstances(env,
+                env_settings[batch_idx], scene_backend.objectBounds,
+                library_backend ? &library_backend->objectBounds : nullptr,
+                cfg_.culling, cfg_.cullDistance,
+                env_backend.visibleInstances);
+
+            if (visibility_changed) {
+                env.setDirty();
+            }
+        }
+
+        bool own_tlas = cull_instances || chunk_streamer;
+        if (env.isDirty() && (own_tlas || !env.hasDefaultInstances())) {
+            env_backend.tlas.writeInstances(env.getInstances(),
+                env.getTransforms(), env.getInstanceFlags(),
+                scene_backend.objectInfo, scene_backend.blases,
+                library_backend,
+                cull_instances ? env_backend.visibleInstances.data() :
+                    nullptr,
+                chunk_streamer ? &chunk_streamer->getBLASes() : nullptr);
+        }
+
         PackedEnv &packed_env = batch_state.envPtr[batch_idx];
 
-        packed_env.cam = packCamera(env.getCamera());
-        packed_env.prevCam = packCamera(env_backend.prevCam);
         packed_env.data.x = scene_backend.sceneID->getID();
+        packed_env.librarySceneID = library_backend ?
+            library_backend->sceneID->getID() : packed_env.data.x;
+
+        // Views added since the last frame have no motion
+        uint32_t num_views = env.getNumViews();
+        PackedView *packed_views =
+            &batch_state.viewPtr[batch_idx * cfg_.maxViews];
+        for (uint32_t view_idx = 0; view_idx < num_views; view_idx++) {
+            const Camera &cam = env.getView(view_idx);
+            const Camera &prev_cam = view_idx < env_backend.prevCams.size() ?
+                env_backend.prevCams[view_idx] : cam;
+
+            packed_views[view_idx].cam = packCamera(cam);
+            packed_views[view_idx].prevCam = packCamera(prev_cam);
+        }
+
+        // Set prevCams for next iteration
+        env_backend.prevCams.resize(num_views, env.getCamera());
+        for (uint32_t view_idx = 0; view_idx < num_views; view_idx++) {
+            env_backend.prevCams[view_idx] = env.getView(view_idx);
+        }
 
-        // Set prevCam for next iteration
-        env_backend.prevCam = env.getCamera();
+        if (!env_backend.domainRandomized ||
+                env_backend.randomizedStream != env.getRandomStream() ||
+                env_backend.randomizedEpisode != env.getEpisode()) {
+            CounterRNG rng(cfg_.randomSeed, env.getRandomStream(),
+                           env.getEpisode(), RandomSubsequence::Domain);
+
+            env_backend.domainRandomization = randomizeDomain(rng,
+                cur_env_maps_->texData.textures.size() / 2,
+                cfg_.enableRandomization);
+            env_backend.domainRandomized = true;
+            env_backend.randomizedStream = env.getRandomStream();
+            env_backend.randomizedEpisode = env.getEpisode();
+        }
 
         const auto &env_transforms = env.getTransforms();
-        uint32_t num_instances = env.getNumInstances();
-        memcpy(&batch_state.transformPtr[inst_offset], env_transforms.data(),
-               sizeof(InstanceTransform) * num_instances);
-        inst_offset += num_instances;
+        const auto &env_mats = as_const(env).getInstanceMaterials();
 
-        const auto &env_mats = env.getInstanceMaterials();
+        EnvUploadLayout &prev_layout = batch_backend.uploadLayouts[batch_idx];
+        const EnvUploadLayout &cur_layout = cur_layouts[batch_idx];
 
-        memcpy(&batch_state.materialPtr[material_offset], env_mats.data(),
-               env_mats.size() * sizeof(uint32_t));
+        // Anything else may have been written into this slot since
+        bool same_env = prev_layout.env == &env_backend &&
+            env_backend.lastUploadBatch == &batch_backend;
 
-        packed_env.data.y = material_offset;
-        material_offset += env_mats.size();
+        DirtyRange txfm_range = env.getDirtyTransforms();
+        if (!same_env || prev_layout.instOffset != cur_layout.instOffset ||
+            prev_layout.numInstances != cur_layout.numInstances) {
+            txfm_range = { 0, cur_layout.numInstances };
+        }
+        txfm_range.end = min(txfm_range.end, cur_layout.numInstances);
+
+        if (upload_transforms[batch_idx] && !txfm_range.empty()) {
+            uint32_t txfm_offset = cur_layout.instOffset + txfm_range.begin;
+            uint32_t num_txfms = txfm_range.end - txfm_range.begin;
+            memcpy(&batch_state.transformPtr[txfm_offset],
+                   env_transforms.data() + txfm_range.begin,
+                   sizeof(InstanceTransform) * num_txfms);
+            addParamCopy(sizeof(InstanceTransform) * txfm_offset,
+                         sizeof(InstanceTransform) * num_txfms);
+        }
 
-        memcpy(&batch_state.lightPtr[light_offset], env_backend.lights.data(),
-               env_backend.lights.size() * sizeof(PackedLight));
+        DirtyRange mat_range = env.getDirtyMaterials();
+        if (!same_env ||
+            prev_layout.materialOffset != cur_layout.materialOffset ||
+            prev_layout.numMaterials != cur_layout.numMaterials) {
+            mat_range = { 0, cur_layout.numMaterials };
+        }
+        mat_range.end = min(mat_range.end, cur_layout.numMaterials);
+
+        if (!mat_range.empty()) {
+            uint32_t mat_offset = cur_layout.materialOffset + mat_range.begin;
+            uint32_t num_mats = mat_range.end - mat_range.begin;
+            memcpy(&batch_state.materialPtr[mat_offset],
+                   env_mats.data() + mat_range.begin,
+                   sizeof(uint32_t) * num_mats);
+            addParamCopy(param_cfg_.materialIndicesOffset +
+                    sizeof(uint32_t) * mat_offset,
+                sizeof(uint32_t) * num_mats);
+        }
+
+        packed_env.data.y = cur_layout.materialOffset;
+
+        bool lights_dirty = env.areLightsDirty() || !same_env ||
+            prev_layout.lightOffset != cur_layout.lightOffset ||
+            prev_layout.numLights != cur_layout.numLights;
+
+        if (lights_dirty && cur_layout.numLights > 0) {
+            memcpy(&batch_state.lightPtr[cur_layout.lightOffset],
+                   env_backend.lights.data(),
+                   sizeof(PackedLight) * cur_layout.numLights);
+            addParamCopy(param_cfg_.lightsOffset +
+                    sizeof(PackedLight) * cur_layout.lightOffset,
+                sizeof(PackedLight) * cur_layout.numLights);
+        }
 
-        packed_env.data.z = light_offset;
-        packed_env.data.w = env_backend.lights.size();
-        light_offset += env_backend.lights.size();
+        packed_env.data.z = cur_layout.lightOffset;
+        packed_env.data.w = cur_layout.numLights;
+
+        prev_layout = cur_layout;
+        env_backend.lastUploadBatch = &batch_backend;
+        env.clearUploadDirty();
 
-        packed_env.tlasAddr = env_backend.tlas.tlasStorageDevAddr;
         //packed_env.reservoirGridAddr = env_backend.reservoirGrid.devAddr;
         packed_env.reservoirGridAddr = 0;
 
@@ -1504,19 +2244,99 @@ void VulkanBackend::render(RenderBatch &batch)
             env_backend.domainRandomization.lightFilter.z;
         packed_env.lightFilterAndEnvIdx.w =
             glm::uintBitsToFloat(env_backend.domainRandomization.envMapIdx);
+    });
+
+    // TLAS build. Command recording and allocation stay on this thread.
+    // Inactive environments stay dirty until they're rendered again.
+    for (uint32_t batch_idx = 0; batch_idx < batch_size; batch_idx++) {
+        if (!batch.isActive(batch_idx)) {
+            continue;
+        }
+
+        const Environment &env = envs[batch_idx];
+        VulkanEnvironment &env_backend =
+            *(VulkanEnvironment *)(env.getBackend());
+
+        const VulkanScene &scene =
+            *static_cast<const VulkanScene *>(env.getScene().get());
+
+        if (env.hasDefaultInstances() && !cull_instances &&
+            !scene.chunkStreamer) {
+            batch_state.envPtr[batch_idx].tlasAddr =
+                scene.defaultTLAS.tlas.tlasStorageDevAddr;
+            batch_state.envPtr[batch_idx].instanceIndicesAddr =
+                scene.defaultTLAS.tlas.instanceIndicesDevAddr;
+
+            env.clearDirty();
+            continue;
+        }
+
+        if (env.isDirty()) {
+            env_backend.tlas.build(dev, alloc, render_cmd);
+
+            env.clearDirty();
+        }
+
+        batch_state.envPtr[batch_idx].tlasAddr =
+            env_backend.tlas.tlasStorageDevAddr;
+        batch_state.envPtr[batch_idx].instanceIndicesAddr =
+            env_backend.tlas.instanceIndicesDevAddr;
     }
 
-    batch_backend.renderInputStaging.flush(dev);
+    VkMemoryBarrier tlas_barrier;
+    tlas_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    tlas_barrier.pNext = nullptr;
+    tlas_barrier.srcAccessMask =
+        VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    tlas_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    dev.dt.cmdPipelineBarrier(render_cmd,
+        VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+        &tlas_barrier, 0, nullptr, 0, nullptr);
+
+    // Per environment parameters, cameras and render settings change
+    // every frame
+    param_copies.back() = {
+        param_cfg_.envOffset,
+        param_cfg_.envOffset,
+        param_cfg_.renderSettingsOffset + sizeof(PackedRenderSettings) *
+            batch_size * cfg_.maxViews - param_cfg_.envOffset,
+    };
+
+    // Merge adjacent ranges to keep the number of copy regions down
+    sort(param_copies.begin(), param_copies.end(),
+         [](const VkBufferCopy &a, const VkBufferCopy &b) {
+        return a.srcOffset < b.srcOffset;
+    });
+
+    uint32_t num_param_copies = 0;
+    uint64_t upload_bytes = 0;
+    for (const VkBufferCopy &copy : param_copies) {
+        if (copy.size == 0) continue;
 
-    VkBufferCopy param_copy;
-    param_copy.srcOffset = 0;
-    param_copy.dstOffset = 0;
-    param_copy.size = param_cfg_.totalParamBytes;
+        upload_bytes += copy.size;
+
+        if (num_param_copies > 0) {
+            VkBufferCopy &prev = param_copies[num_param_copies - 1];
+            if (prev.srcOffset + prev.size == copy.srcOffset) {
+                prev.size += copy.size;
+                continue;
+            }
+        }
+
+        param_copies[num_param_copies++] = copy;
+    }
+
+    batch_backend.lastUploadBytes = upload_bytes;
+    batch_backend.lastNumSharedEnvs = num_shared_envs;
+
+    batch_backend.renderInputStaging.flush(dev);
 
     dev.dt.cmdCopyBuffer(render_cmd,
                          batch_backend.renderInputStaging.buffer,
                          batch_backend.renderInputDev.buffer,
-                         1, &param_copy);
+                         num_param_copies, param_copies.data());
 
 
     auto submitCmd = [&]() {
@@ -1676,8 +2496,7 @@ void VulkanBackend::render(RenderBatch &batch)
         adaptiveReadback();
 
         submitCmd();
-        waitForFenceInfinitely(dev, batch_state.fence);
-        resetFence(dev, batch_state.fence);
+        waitForSubmit();
 
         constexpr float norm_variance_threshold = 5e-4;
         constexpr int max_adaptive_iters = 10000;
@@ -1748,8 +2567,7 @@ void VulkanBackend::render(RenderBatch &batch)
             adaptiveReadback();
 
             submitCmd();
-            waitForFenceInfinitely(dev, batch_state.fence);
-            resetFence(dev, batch_state.fence);
+            waitForSubmit();
         }
 
         startRenderSetup();
@@ -1775,17 +2593,16 @@ void VulkanBackend::render(RenderBatch &batch)
 
         dev.dt.cmdDispatch(
             render_cmd,
-            launch_size_.x,
-            launch_size_.y,
-            launch_size_.z);
+            launch_size.x,
+            launch_size.y,
+            launch_size.z);
 
-        frame_counter_ += cfg_.batchSize;
+        frame_counter_ += cfg_.batchSize * cfg_.maxViews;
     }
 
     if (cfg_.denoise) {
         submitCmd();
-        waitForFenceInfinitely(dev, batch_state.fence);
-        resetFence(dev, batch_state.fence);
+        waitForSubmit();
 
         denoiser_->denoise(dev, fb_cfg_, batch_state.cmdPool, 
             render_cmd, batch_state.fence, compute_queues_[cur_queue_],
@@ -1817,7 +2634,7 @@ void VulkanBackend::render(RenderBatch &batch)
             render_cmd,
             1,
             1,
-            cfg_.batchSize);
+            launch_size.z);
 
         dev.dt.cmdPipelineBarrier(render_cmd,
             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
@@ -1834,12 +2651,58 @@ void VulkanBackend::render(RenderBatch &batch)
 
         dev.dt.cmdDispatch(
             render_cmd,
-            launch_size_.x,
-            launch_size_.y,
-            launch_size_.z);
+            launch_size.x,
+            launch_size.y,
+            launch_size.z);
+    }
+
+    if (cfg_.hostOutputs) {
+        FramebufferState &fb = batch_backend.fb;
+
+        VkMemoryBarrier readback_barrier;
+        readback_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        readback_barrier.pNext = nullptr;
+        readback_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        readback_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        dev.dt.cmdPipelineBarrier(
+            render_cmd,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            1, &readback_barrier, 0, nullptr, 0, nullptr);
+
+        for (int i = 0; i < (int)fb.exportedOutputs.size(); i++) {
+            const ExportedOutput &exported = fb.exportedOutputs[i];
+
+            VkBufferCopy copy_info;
+            copy_info.srcOffset = 0;
+            copy_info.dstOffset = 0;
+            copy_info.size = exported.numBytes;
+
+            dev.dt.cmdCopyBuffer(render_cmd,
+                fb.outputs[exported.outputIdx].buffer,
+                fb.hostOutputs[i].buffer,
+                1, &copy_info);
+        }
+
+        VkMemoryBarrier host_barrier;
+        host_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        host_barrier.pNext = nullptr;
+        host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+        dev.dt.cmdPipelineBarrier(
+            render_cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            0,
+            1, &host_barrier, 0, nullptr, 0, nullptr);
     }
 
     submitCmd();
+    batch_backend.inFlight = true;
+    in_flight_batches_.push_back(&batch_backend);
 
     batch_backend.curBuffer = (batch_backend.curBuffer + 1) & 1;
     cur_queue_ = (cur_queue_ + 1) & 1;
@@ -1849,10 +2712,27 @@ void VulkanBackend::waitForBatch(RenderBatch &batch)
 {
     auto &batch_backend = *getVkBatch(batch);
 
-    VkFence fence = batch_backend.state.fence;
-    assert(fence != VK_NULL_HANDLE);
-    waitForFenceInfinitely(dev, fence);
-    resetFence(dev, fence);
+    batch_backend.lastStallMS += retireBatch(batch_backend);
+}
+
+bool VulkanBackend::isBatchReady(RenderBatch &batch)
+{
+    auto &batch_backend = *getVkBatch(batch);
+    if (!batch_backend.inFlight) {
+        return true;
+    }
+
+    VkResult res = dev.dt.getFenceStatus(dev.hdl, batch_backend.state.fence);
+    if (res == VK_NOT_READY) {
+        return false;
+    }
+    REQ_VK(res);
+
+    // Fence is signaled so this doesn't block, but host outputs need to be
+    // made visible before the caller reads them
+    retireBatch(batch_backend);
+
+    return true;
 }
 
 half *VulkanBackend::getOutputPointer(RenderBatch &batch)
@@ -1871,5 +2751,37 @@ AuxiliaryOutputs VulkanBackend::getAuxiliaryOutputs(RenderBatch &batch)
     };
 }
 
+ChannelOutputs VulkanBackend::getChannelOutputs(RenderBatch &batch)
+{
+    auto &batch_backend = *getVkBatch(batch);
+
+    return batch_backend.state.channelBuffers;
+}
+
+void VulkanBackend::resetEnvironments(RenderBatch &batch)
+{
+    Environment *envs = batch.getEnvironments();
+
+    packing_pool_.parallelFor(cfg_.batchSize, [&](uint32_t batch_idx) {
+        envs[batch_idx].reset();
+    });
+}
+
+BatchStatistics VulkanBackend::getBatchStatistics(RenderBatch &batch)
+{
+    auto &batch_backend = *getVkBatch(batch);
+    EnvironmentPoolStatistics pool_stats = env_pool_.getStatistics();
+
+    return {
+        batch_backend.lastUploadBytes,
+        batch_backend.lastNumSharedEnvs,
+        pool_stats.envHits,
+        pool_stats.envMisses,
+        pool_stats.tlasHits,
+        pool_stats.tlasMisses,
+        batch_backend.lastStallMS,
+    };
+}
+
 }
 }
@@ -2,6 +2,7 @@
 
 #include <array>
 #include <atomic>
+#include <deque>
 #include <memory>
 #include <optional>
 #include <string>
@@ -10,6 +11,7 @@
 #include <rlpbr/config.hpp>
 #include <rlpbr/render.hpp>
 #include <rlpbr_core/common.hpp>
+#include <rlpbr_core/worker_pool.hpp>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_precision.hpp>
@@ -50,13 +52,16 @@ struct FramebufferConfig {
     uint32_t numTilesWide;
     uint32_t numTilesTall;
 
-    uint32_t outputBytes;
-    uint32_t hdrBytes;
-    uint32_t normalBytes;
-    uint32_t albedoBytes;
-    uint32_t reservoirBytes;
-    uint32_t illuminanceBytes;
-    uint32_t adaptiveBytes;
+    VkDeviceSize outputBytes;
+    VkDeviceSize hdrBytes;
+    VkDeviceSize normalBytes;
+    VkDeviceSize albedoBytes;
+    VkDeviceSize rgb8Bytes;
+    VkDeviceSize depthBytes;
+    VkDeviceSize idBytes;
+    VkDeviceSize reservoirBytes;
+    VkDeviceSize illuminanceBytes;
+    VkDeviceSize adaptiveBytes;
 };
 
 struct ParamBufferConfig {
@@ -71,14 +76,30 @@ struct ParamBufferConfig {
     VkDeviceSize envOffset;
     VkDeviceSize totalEnvParamBytes;
 
+    VkDeviceSize viewOffset;
+    VkDeviceSize totalViewBytes;
+
+    VkDeviceSize renderSettingsOffset;
+    VkDeviceSize totalRenderSettingsBytes;
+
     VkDeviceSize totalParamBytes;
 };
 
+// Output buffer handed to the user, through CUDA or host memory
+struct ExportedOutput {
+    int outputIdx;
+    VkDeviceSize numBytes;
+};
+
 struct FramebufferState {
     std::vector<LocalBuffer> outputs;
     std::vector<VkDeviceMemory> backings;
 
+    std::vector<ExportedOutput> exportedOutputs;
     std::vector<CudaImportedBuffer> exported;
+    // Readback copies of the exported outputs, replaces exported when
+    // hostOutputs is set
+    std::vector<HostBuffer> hostOutputs;
 
     std::vector<LocalBuffer> reservoirs;
     std::vector<VkDeviceMemory> reservoirMemory;
@@ -92,6 +113,10 @@ struct FramebufferState {
     int albedoIdx;
     int illuminanceIdx;
     int adaptiveIdx;
+    int rgb8Idx;
+    int depthIdx;
+    int instanceIdx;
+    int semanticIdx;
 };
 
 struct RenderState {
@@ -127,6 +152,7 @@ struct PerBatchState {
     half *outputBuffer;
     half *normalBuffer;
     half *albedoBuffer;
+    ChannelOutputs channelBuffers;
 
     FixedDescriptorPool rtPool;
     std::array<VkDescriptorSet, 2> rtSets;
@@ -139,6 +165,8 @@ struct PerBatchState {
     uint32_t *materialPtr;
     PackedLight *lightPtr;
     PackedEnv *envPtr;
+    PackedView *viewPtr;
+    PackedRenderSettings *renderSettingsPtr;
     InputTile *tileInputPtr;
     AdaptiveTile *adaptiveReadbackPtr;
 };
@@ -155,6 +183,18 @@ struct BSDFPrecomputed {
     ImgAndView msGGXInverse;
 };
 
+// Where an environment's data was placed in the parameter buffers on the
+// last upload. Ranges are only reuploaded when modified or moved.
+struct EnvUploadLayout {
+    const VulkanEnvironment *env;
+    uint32_t instOffset;
+    uint32_t numInstances;
+    uint32_t materialOffset;
+    uint32_t numMaterials;
+    uint32_t lightOffset;
+    uint32_t numLights;
+};
+
 struct VulkanBatch : public BatchBackend {
     FramebufferState fb;
 
@@ -164,6 +204,17 @@ struct VulkanBatch : public BatchBackend {
     PerBatchState state;
 
     uint32_t curBuffer;
+
+    std::vector<EnvUploadLayout> uploadLayouts;
+    uint64_t lastUploadBytes;
+    uint32_t lastNumSharedEnvs;
+
+    // Submitted and not yet waited on, state.fence is pending
+    bool inFlight;
+    float lastStallMS;
+    // Submission index of the last render, for retiring streamed chunks
+    // and pooled environments
+    uint64_t renderIndex;
 };
 
 class VulkanBackend : public RenderBackend {
@@ -179,6 +230,17 @@ public:
         bool enableRandomization;
         bool adaptiveSampling;
         bool denoise;
+        uint32_t numWorkerThreads;
+        uint64_t randomSeed;
+        uint32_t maxInFlightBatches;
+        bool hostOutputs;
+        OutputChannels outputChannels;
+        // Per environment defaults and upper bounds
+        EnvironmentRenderSettings maxSettings;
+        uint32_t maxViews;
+        InstanceCulling culling;
+        float cullDistance;
+        uint64_t streamingBudget;
     };
 
     VulkanBackend(const RenderConfig &cfg, bool validate);
@@ -196,19 +258,32 @@ public:
 
     void waitForBatch(RenderBatch &batch);
 
+    bool isBatchReady(RenderBatch &batch);
+
     half *getOutputPointer(RenderBatch &batch);
     AuxiliaryOutputs getAuxiliaryOutputs(RenderBatch &batch);
 
+    ChannelOutputs getChannelOutputs(RenderBatch &batch);
+
+    BatchStatistics getBatchStatistics(RenderBatch &batch);
+
+    void resetEnvironments(RenderBatch &batch);
+
 private:
     VulkanBackend(const RenderConfig &cfg,
                   const InitConfig &backend_cfg);
 
+    // Waits for batch's pending submission if any, returns the time
+    // blocked in milliseconds
+    float retireBatch(VulkanBatch &batch);
+
     const Config cfg_;
 
     const InstanceState inst;
     const DeviceState dev;
 
     MemoryAllocator alloc;
+    EnvironmentPool env_pool_;
 
     const FramebufferConfig fb_cfg_;
     const ParamBufferConfig param_cfg_;
@@ -219,7 +294,6 @@ private:
     DynArray<QueueState> compute_queues_;
 
     BSDFPrecomputed bsdf_precomp_;
-    glm::u32vec3 launch_size_;
 
     std::atomic_int num_loaders_;
     VkDescriptorPool scene_pool_;
@@ -229,9 +303,15 @@ private:
 
     uint32_t cur_queue_;
     uint32_t frame_counter_;
+    uint64_t num_renders_;
+
+    // Submission order, for maxInFlightBatches
+    std::deque<VulkanBatch *> in_flight_batches_;
 
     std::optional<PresentationState> present_;
     std::optional<Denoiser> denoiser_;
+
+    WorkerPool packing_pool_;
 };
 
 }
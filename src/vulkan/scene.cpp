@@ -11,6 +11,7 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/string_cast.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <iostream>
@@ -74,7 +75,7 @@ static ReservoirGrid makeReservoirGrid(
     };
 }
 
-DomainRandomization randomizeDomain(mt19937 &rand_gen,
+DomainRandomization randomizeDomain(CounterRNG &rng,
                                     uint32_t num_env_maps,
                                     bool enable_randomization)
 {
@@ -86,44 +87,68 @@ DomainRandomization randomizeDomain(mt19937 &rand_gen,
         };
     }
 
-    uniform_real_distribution<float> rand_dist(0, 1.f);
-
-    float env_angle = rand_dist(rand_gen) * 2.f * M_PI;
+    float env_angle = rng.nextFloat() * 2.f * M_PI;
 
     glm::quat env_rot = glm::angleAxis(env_angle, glm::vec3(0.f, 1.f, 0.f));
 
-    glm::vec3 light_filter(rand_dist(rand_gen),
-                           rand_dist(rand_gen),
-                           rand_dist(rand_gen));
+    float filter_r = rng.nextFloat();
+    float filter_g = rng.nextFloat();
+    float filter_b = rng.nextFloat();
+    glm::vec3 light_filter(filter_r, filter_g, filter_b);
 
     light_filter = glm::normalize(light_filter);
 
     // FIXME: Not very useful currently
     light_filter = glm::vec3(1.f);
 
-    uniform_int_distribution<uint32_t> env_map_dist(0, num_env_maps - 1);
-
     return DomainRandomization {
         env_rot,
         light_filter,
-        env_map_dist(rand_gen),
+        rng.nextBounded(num_env_maps),
     };
 }
 
 VulkanEnvironment::VulkanEnvironment(const DeviceState &d,
+                                     EnvironmentPool &p,
                                      const VulkanScene &scene,
-                                     const Camera &cam,
-                                     mt19937 &rand_gen,
-                                     bool should_randomize,
-                                     uint32_t num_env_maps)
+                                     const Camera &cam)
     : EnvironmentBackend {},
       lights(),
       dev(d),
+      pool(p),
       tlas(),
-      prevCam(cam),
-      domainRandomization(randomizeDomain(rand_gen, num_env_maps,
-                                          should_randomize))
+      prevCams(1, cam),
+      visibleInstances(),
+      chunkStreamer(nullptr),
+      viewPositions(),
+      chunkEpoch(0),
+      releaseRenderIdx(0),
+      lastUploadBatch(nullptr),
+      domainRandomization(),
+      domainRandomized(false),
+      randomizedStream(0),
+      randomizedEpisode(0)
+{
+    init(scene, cam);
+}
+
+VulkanEnvironment::~VulkanEnvironment()
 {
+    tlas.free(dev);
+}
+
+void VulkanEnvironment::init(const VulkanScene &scene, const Camera &cam)
+{
+    prevCams.assign(1, cam);
+    visibleInstances.clear();
+    viewPositions.assign(1, cam.position);
+    chunkEpoch = 0;
+    // A recycled environment may sit at the address of one a batch has
+    // already seen, so force a full upload
+    lastUploadBatch = nullptr;
+    domainRandomized = false;
+
+    lights.clear();
     for (const LightProperties &light : scene.envInit.lights) {
         PackedLight packed;
         memcpy(&packed.data.x, &light.type, sizeof(uint32_t));
@@ -132,19 +157,21 @@ VulkanEnvironment::VulkanEnvironment(const DeviceState &d,
             packed.data.z = glm::uintBitsToFloat(light.sphereMatIdx);
             packed.data.w = light.radius;
         } else if (light.type == LightType::Triangle) {
-            packed.data.y = glm::uintBitsToFloat(light.triIdxOffset);
+            packed.data.y =
+                glm::uintBitsToFloat(uint32_t(light.triIdxOffset));
             packed.data.z = glm::uintBitsToFloat(light.triMatIdx);
+            packed.data.w = glm::uintBitsToFloat(light.triBlockIdx);
         } else if (light.type == LightType::Portal) {
             packed.data.y = glm::uintBitsToFloat(light.portalIdxOffset);
         }
 
         lights.push_back(packed);
     }
-}
 
-VulkanEnvironment::~VulkanEnvironment()
-{
-    tlas.free(dev);
+    chunkStreamer = scene.chunkStreamer.get();
+    if (chunkStreamer) {
+        chunkStreamer->addEnvironment(this);
+    }
 }
 
 uint32_t VulkanEnvironment::addLight(const glm::vec3 &position,
@@ -165,6 +192,158 @@ void VulkanEnvironment::removeLight(uint32_t idx)
     lights.pop_back();
 }
 
+void VulkanEnvironment::release(EnvironmentBackend *env)
+{
+    auto *vk_env = static_cast<VulkanEnvironment *>(env);
+    if (vk_env->chunkStreamer) {
+        vk_env->chunkStreamer->removeEnvironment(vk_env);
+        vk_env->chunkStreamer = nullptr;
+    }
+
+    vk_env->pool.release(vk_env);
+}
+
+static uint32_t tlasBucket(uint32_t num_instances)
+{
+    uint32_t bucket = 0;
+    while ((1u << bucket) < num_instances) {
+        bucket++;
+    }
+
+    return bucket;
+}
+
+EnvironmentPool::EnvironmentPool(const DeviceState &d, MemoryAllocator &a)
+    : dev(d),
+      alloc(a),
+      lock_(),
+      free_envs_(),
+      free_tlases_(),
+      retired_envs_(),
+      retired_tlases_(),
+      stats_ {0, 0, 0, 0}
+{}
+
+EnvironmentPool::~EnvironmentPool()
+{
+    for (VulkanEnvironment *env : free_envs_) {
+        delete env;
+    }
+
+    for (VulkanEnvironment *env : retired_envs_) {
+        delete env;
+    }
+
+    for (vector<TLAS> &bucket : free_tlases_) {
+        for (TLAS &tlas : bucket) {
+            tlas.free(dev);
+        }
+    }
+
+    for (RetiredTLAS &retired : retired_tlases_) {
+        retired.tlas.free(dev);
+    }
+}
+
+VulkanEnvironment *EnvironmentPool::acquire(const VulkanScene &scene,
+                                            const Camera &cam)
+{
+    VulkanEnvironment *env = nullptr;
+    {
+        lock_guard<mutex> guard(lock_);
+        if (free_envs_.size() > 0) {
+            env = free_envs_.back();
+            free_envs_.pop_back();
+            stats_.envHits++;
+        } else {
+            stats_.envMisses++;
+        }
+    }
+
+    if (env) {
+        env->init(scene, cam);
+        return env;
+    }
+
+    return new VulkanEnvironment(dev, *this, scene, cam);
+}
+
+void EnvironmentPool::release(VulkanEnvironment *env)
+{
+    lock_guard<mutex> guard(lock_);
+    retired_envs_.push_back(env);
+}
+
+void EnvironmentPool::recycle(uint64_t oldest_render_idx)
+{
+    lock_guard<mutex> guard(lock_);
+
+    auto pending_end = partition(retired_envs_.begin(), retired_envs_.end(),
+        [&](const VulkanEnvironment *env) {
+            return env->releaseRenderIdx > oldest_render_idx;
+        });
+    free_envs_.insert(free_envs_.end(), pending_end, retired_envs_.end());
+    retired_envs_.erase(pending_end, retired_envs_.end());
+
+    vector<RetiredTLAS> pending_tlases;
+    for (RetiredTLAS &retired : retired_tlases_) {
+        if (retired.renderIdx > oldest_render_idx) {
+            pending_tlases.emplace_back(move(retired));
+            continue;
+        }
+
+        vector<TLAS> &bucket =
+            free_tlases_[tlasBucket(retired.tlas.numBuildInstances)];
+        if (bucket.size() < maxFreeTLASesPerBucket) {
+            bucket.emplace_back(move(retired.tlas));
+        } else {
+            retired.tlas.free(dev);
+        }
+    }
+    retired_tlases_ = move(pending_tlases);
+}
+
+void EnvironmentPool::reserveTLAS(TLAS &tlas, uint32_t num_instances,
+                                  uint64_t release_render_idx)
+{
+    if (tlas.buildStorage.has_value() &&
+        num_instances <= tlas.numBuildInstances) {
+        return;
+    }
+
+    uint32_t bucket = tlasBucket(num_instances);
+    if (bucket >= numTLASBuckets) {
+        cerr << "Too many instances for TLAS: " << num_instances << endl;
+        fatalExit();
+    }
+
+    lock_guard<mutex> guard(lock_);
+
+    if (tlas.buildStorage.has_value()) {
+        retired_tlases_.push_back({
+            release_render_idx,
+            move(tlas),
+        });
+    }
+
+    vector<TLAS> &bucket_tlases = free_tlases_[bucket];
+    if (bucket_tlases.size() > 0) {
+        tlas = move(bucket_tlases.back());
+        bucket_tlases.pop_back();
+        stats_.tlasHits++;
+    } else {
+        tlas = TLAS {};
+        tlas.reserveInstances(alloc, 1u << bucket);
+        stats_.tlasMisses++;
+    }
+}
+
+EnvironmentPoolStatistics EnvironmentPool::getStatistics() const
+{
+    lock_guard<mutex> guard(lock_);
+    return stats_;
+}
+
 VulkanLoader::VulkanLoader(const DeviceState &d,
                            MemoryAllocator &alc,
                            const QueueState &transfer_queue,
@@ -732,9 +911,8 @@ static optional<BLASBuildResults> makeBLASes(
     MemoryAllocator &alloc, 
     const vector<MeshInfo> &meshes,
     const vector<ObjectInfo> &objects,
-    uint32_t max_num_vertices,
-    VkDeviceAddress vert_base,
-    VkDeviceAddress index_base,
+    const vector<GeometryBlock> &blocks,
+    const vector<GeometryBlockAddrs> &block_addrs,
     VkCommandBuffer build_cmd)
 {
     vector<VkAccelerationStructureGeometryKHR> geo_infos;
@@ -754,20 +932,33 @@ static optional<BLASBuildResults> makeBLASes(
     VkDeviceSize total_scratch_bytes = 0;
     VkDeviceSize total_accel_bytes = 0;
 
+    // objects may be any subset of the scene's objects, so per mesh build
+    // inputs are indexed by geometry_offsets rather than mesh index
+    vector<uint32_t> geometry_offsets;
+    geometry_offsets.reserve(objects.size());
+
     for (const ObjectInfo &object : objects) {
+        uint32_t geometry_offset = geo_infos.size();
+        geometry_offsets.push_back(geometry_offset);
+
         for (int mesh_idx = 0; mesh_idx < (int)object.numMeshes; mesh_idx++) {
             const MeshInfo &mesh = meshes[object.meshIndex + mesh_idx];
 
-            VkDeviceAddress vert_addr = vert_base;
+            const GeometryBlock &block = blocks[mesh.blockIndex];
+            const GeometryBlockAddrs &addrs = block_addrs[mesh.blockIndex];
+
+            VkDeviceAddress vert_addr = addrs.vertAddr;
             VkDeviceAddress index_addr =
-                index_base + mesh.indexOffset * sizeof(uint32_t);
+                addrs.idxAddr + mesh.indexOffset * sizeof(uint32_t);
 
             VkAccelerationStructureGeometryKHR geo_info;
             geo_info.sType =
                 VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
             geo_info.pNext = nullptr;
             geo_info.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
-            geo_info.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+            // Non opaque geometry runs the alpha test during traversal
+            geo_info.flags = mesh.alphaMode == AlphaMode::Opaque ?
+                VK_GEOMETRY_OPAQUE_BIT_KHR : 0;
             auto &tri_info = geo_info.geometry.triangles;
             tri_info.sType =
                 VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
@@ -775,7 +966,7 @@ static optional<BLASBuildResults> makeBLASes(
             tri_info.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
             tri_info.vertexData.deviceAddress = vert_addr;
             tri_info.vertexStride = sizeof(Vertex);
-            tri_info.maxVertex = max_num_vertices;
+            tri_info.maxVertex = block.numVertices;
             tri_info.indexType = VK_INDEX_TYPE_UINT32;
             tri_info.indexData.deviceAddress = index_addr;
             tri_info.transformData.deviceAddress = 0;
@@ -804,7 +995,7 @@ static optional<BLASBuildResults> makeBLASes(
         build_info.srcAccelerationStructure = VK_NULL_HANDLE;
         build_info.dstAccelerationStructure = VK_NULL_HANDLE;
         build_info.geometryCount = object.numMeshes;
-        build_info.pGeometries = &geo_infos[object.meshIndex];
+        build_info.pGeometries = &geo_infos[geometry_offset];
         build_info.ppGeometries = nullptr;
         // Set device address to 0 before space calculation 
         build_info.scratchData.deviceAddress = 0;
@@ -818,7 +1009,7 @@ static optional<BLASBuildResults> makeBLASes(
         dev.dt.getAccelerationStructureBuildSizesKHR(
             dev.hdl, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
             &build_infos.back(),
-            &num_triangles[object.meshIndex],
+            &num_triangles[geometry_offset],
             &size_info);
 
          // Must be aligned to 256 as per spec
@@ -891,7 +1082,7 @@ static optional<BLASBuildResults> makeBLASes(
             dev_addr,
         });
 
-        range_info_ptrs.push_back(&range_infos[objects[obj_idx].meshIndex]);
+        range_info_ptrs.push_back(&range_infos[geometry_offsets[obj_idx]]);
     }
 
     dev.dt.cmdBuildAccelerationStructuresKHR(build_cmd,
@@ -1259,9 +1450,8 @@ static optional<BLASBuildResults> getBLASes(
     const string_view blas_path,
     const vector<MeshInfo> &meshes,
     const vector<ObjectInfo> &objects,
-    uint32_t max_num_vertices,
-    VkDeviceAddress vert_base,
-    VkDeviceAddress index_base,
+    const vector<GeometryBlock> &blocks,
+    const vector<GeometryBlockAddrs> &block_addrs,
     VkCommandBuffer build_cmd)
 {
     optional<BLASBuildResults> blas_results;
@@ -1273,8 +1463,7 @@ static optional<BLASBuildResults> getBLASes(
 
     if (!blas_results.has_value()) {
         blas_results = makeBLASes(dev, alloc, meshes, objects,
-                                  max_num_vertices, vert_base,
-                                  index_base, build_cmd);
+                                  blocks, block_addrs, build_cmd);
     }
 
     if (blas_results.has_value()) {
@@ -1303,52 +1492,99 @@ static optional<BLASBuildResults> getBLASes(
     return blas_results;
 }
 
-void TLAS::build(const DeviceState &dev,
-                 MemoryAllocator &alloc,
-                 const vector<ObjectInstance> &instances,
-                 const vector<InstanceTransform> &instance_transforms,
-                 const vector<InstanceFlags> &instance_flags,
-                 const vector<ObjectInfo> &objects,
-                 const BLASData &blases,
-                 VkCommandBuffer build_cmd)
+void TLAS::reserveInstances(MemoryAllocator &alloc, uint32_t num_instances)
 {
-    int new_num_instances = instances.size();
-    if ((int)numBuildInstances < new_num_instances) {
-        numBuildInstances = new_num_instances;
+    if (!buildStorage.has_value() || numBuildInstances < num_instances) {
+        numBuildInstances = max(num_instances, 1u);
 
         buildStorage = alloc.makeHostBuffer(
-            sizeof(VkAccelerationStructureInstanceKHR) * numBuildInstances,
-            true);
+            (sizeof(VkAccelerationStructureInstanceKHR) + sizeof(uint32_t)) *
+                numBuildInstances, true);
     }
+}
+
+void TLAS::writeInstances(const vector<ObjectInstance> &instances,
+                          const vector<InstanceTransform> &instance_transforms,
+                          const vector<InstanceFlags> &instance_flags,
+                          const vector<ObjectInfo> &objects,
+                          const BLASData &blases,
+                          const VulkanScene *library,
+                          const uint8_t *visible_instances,
+                          const vector<BLAS> *chunk_blases)
+{
+    int new_num_instances = instances.size();
+    assert((uint32_t)new_num_instances <= numBuildInstances);
 
     VkAccelerationStructureInstanceKHR *accel_insts =
         reinterpret_cast<VkAccelerationStructureInstanceKHR  *>(
             buildStorage->ptr);
+    uint32_t *inst_indices =
+        reinterpret_cast<uint32_t *>(accel_insts + numBuildInstances);
 
+    uint32_t num_active = 0;
     for (int inst_idx = 0; inst_idx < new_num_instances; inst_idx++) {
         const ObjectInstance &inst = instances[inst_idx];
-        const InstanceTransform &txfm = instance_transforms[inst_idx];
+        const ObjectInfo *obj_info;
+        const BLASData *obj_blases;
+        uint32_t mesh_offset_flags;
+        uint32_t obj_idx = inst.objectIndex & ~ObjectInstance::libraryFlag;
+        if (inst.objectIndex & ObjectInstance::libraryFlag) {
+            obj_info = &library->objectInfo[obj_idx];
+            obj_blases = &library->blases;
+            mesh_offset_flags = MeshOffsetLibraryFlag;
+        } else {
+            obj_info = &objects[obj_idx];
+            obj_blases = &blases;
+            mesh_offset_flags = 0;
+        }
+
+        uint32_t num_obj_blases = obj_blases->accelStructs.size();
+        const BLAS *blas = nullptr;
+        if (obj_idx < num_obj_blases) {
+            blas = &obj_blases->accelStructs[obj_idx];
+        } else if (chunk_blases && obj_blases == &blases) {
+            blas = &(*chunk_blases)[obj_idx - num_obj_blases];
+        }
+
+        // Culled, deleted and non resident instances are left out of the
+        // build entirely
+        if ((visible_instances && !visible_instances[inst_idx]) ||
+                !blas || blas->devAddr == 0 ||
+                (instance_flags[inst_idx] & InstanceFlags::Deleted)) {
+            continue;
+        }
 
         VkAccelerationStructureInstanceKHR &inst_info =
-            accel_insts[inst_idx];
+            accel_insts[num_active];
+        inst_indices[num_active] = inst_idx;
+        num_active++;
 
+        const InstanceTransform &txfm = instance_transforms[inst_idx];
         memcpy(&inst_info.transform,
                glm::value_ptr(glm::transpose(txfm.mat)),
                sizeof(VkTransformMatrixKHR));
 
+        inst_info.instanceCustomIndex = inst.materialOffset;
+        inst_info.instanceShaderBindingTableRecordOffset = 
+            obj_info->meshIndex | mesh_offset_flags;
+        inst_info.flags = 0;
+
         if (instance_flags[inst_idx] & InstanceFlags::Transparent) {
             inst_info.mask = 2;
         } else {
             inst_info.mask = 1;
         }
-        inst_info.instanceCustomIndex = inst.materialOffset;
-        inst_info.instanceShaderBindingTableRecordOffset = 
-            objects[inst.objectIndex].meshIndex;
-        inst_info.flags = 0;
-        inst_info.accelerationStructureReference =
-            blases.accelStructs[inst.objectIndex].devAddr;
+        inst_info.accelerationStructureReference = blas->devAddr;
     }
 
+    numInstances = num_active;
+    compacted = num_active != (uint32_t)new_num_instances;
+}
+
+void TLAS::build(const DeviceState &dev,
+                 MemoryAllocator &alloc,
+                 VkCommandBuffer build_cmd)
+{
     buildStorage->flush(dev);
 
     VkBufferDeviceAddressInfo inst_build_addr_info {
@@ -1359,6 +1595,9 @@ void TLAS::build(const DeviceState &dev,
     VkDeviceAddress inst_build_data_addr = 
         dev.dt.getBufferDeviceAddress(dev.hdl, &inst_build_addr_info);
 
+    instanceIndicesDevAddr = compacted ? inst_build_data_addr +
+        sizeof(VkAccelerationStructureInstanceKHR) * numBuildInstances : 0;
+
     VkAccelerationStructureGeometryKHR tlas_geometry;
     tlas_geometry.sType =
         VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
@@ -1392,46 +1631,54 @@ void TLAS::build(const DeviceState &dev,
         VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
     size_info.pNext = nullptr;
 
+    // Sizes are queried for the full instance capacity rather than
+    // numInstances, so the handle and storage stay valid until it grows
     dev.dt.getAccelerationStructureBuildSizesKHR(dev.hdl,
         VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
         &build_info, &numBuildInstances, &size_info);
 
-    size_t new_storage_bytes = size_info.accelerationStructureSize +
-        size_info.buildScratchSize;
+    if (hdl == VK_NULL_HANDLE || numAccelInstances < numBuildInstances) {
+        dev.dt.destroyAccelerationStructureKHR(dev.hdl, hdl, nullptr);
 
-    if (new_storage_bytes > numStorageBytes) {
-        numStorageBytes = new_storage_bytes;
+        size_t new_storage_bytes = size_info.accelerationStructureSize +
+            size_info.buildScratchSize;
 
-        tlasStorage = alloc.makeLocalBuffer(numStorageBytes, true);
+        if (new_storage_bytes > numStorageBytes) {
+            numStorageBytes = new_storage_bytes;
 
-        if (!tlasStorage.has_value()) {
-            cerr << "Failed to allocate TLAS storage" << endl;
-            fatalExit();
+            tlasStorage = alloc.makeLocalBuffer(numStorageBytes, true);
+
+            if (!tlasStorage.has_value()) {
+                cerr << "Failed to allocate TLAS storage" << endl;
+                fatalExit();
+            }
         }
-    }
 
-    VkAccelerationStructureCreateInfoKHR create_info;
-    create_info.sType =
-        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-    create_info.pNext = nullptr;
-    create_info.createFlags = 0;
-    create_info.buffer = tlasStorage->buffer;
-    create_info.offset = 0;
-    create_info.size = size_info.accelerationStructureSize;
-    create_info.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-    create_info.deviceAddress = 0;
+        VkAccelerationStructureCreateInfoKHR create_info;
+        create_info.sType =
+            VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+        create_info.pNext = nullptr;
+        create_info.createFlags = 0;
+        create_info.buffer = tlasStorage->buffer;
+        create_info.offset = 0;
+        create_info.size = size_info.accelerationStructureSize;
+        create_info.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+        create_info.deviceAddress = 0;
 
-    REQ_VK(dev.dt.createAccelerationStructureKHR(dev.hdl, &create_info,
-                                                 nullptr, &hdl));
+        REQ_VK(dev.dt.createAccelerationStructureKHR(dev.hdl, &create_info,
+                                                     nullptr, &hdl));
 
-    VkAccelerationStructureDeviceAddressInfoKHR accel_addr_info;
-    accel_addr_info.sType =
-        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-    accel_addr_info.pNext = nullptr;
-    accel_addr_info.accelerationStructure = hdl;
+        VkAccelerationStructureDeviceAddressInfoKHR accel_addr_info;
+        accel_addr_info.sType =
+            VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+        accel_addr_info.pNext = nullptr;
+        accel_addr_info.accelerationStructure = hdl;
 
-    tlasStorageDevAddr = dev.dt.getAccelerationStructureDeviceAddressKHR(
-        dev.hdl, &accel_addr_info);
+        tlasStorageDevAddr = dev.dt.getAccelerationStructureDeviceAddressKHR(
+            dev.hdl, &accel_addr_info);
+
+        numAccelInstances = numBuildInstances;
+    }
 
     VkBufferDeviceAddressInfoKHR storage_addr_info;
     storage_addr_info.sType =
@@ -1446,7 +1693,7 @@ void TLAS::build(const DeviceState &dev,
         storage_base + size_info.accelerationStructureSize;
 
     VkAccelerationStructureBuildRangeInfoKHR range_info;
-    range_info.primitiveCount = numBuildInstances;
+    range_info.primitiveCount = numInstances;
     range_info.primitiveOffset = 0;
     range_info.firstVertex = 0;
     range_info.transformOffset = 0;
@@ -1461,6 +1708,424 @@ void TLAS::free(const DeviceState &dev)
     dev.dt.destroyAccelerationStructureKHR(dev.hdl, hdl, nullptr);
 }
 
+DefaultTLAS::DefaultTLAS(const DeviceState &d, TLAS &&t)
+    : dev(&d),
+      tlas(move(t))
+{}
+
+DefaultTLAS::DefaultTLAS(DefaultTLAS &&o)
+    : dev(o.dev),
+      tlas(move(o.tlas))
+{
+    o.dev = nullptr;
+}
+
+DefaultTLAS::~DefaultTLAS()
+{
+    if (dev) {
+        tlas.free(*dev);
+    }
+}
+
+ChunkStreamer::ChunkStreamer(const DeviceState &d,
+                             MemoryAllocator &a,
+                             const string &scene_path,
+                             uint64_t staging_offset,
+                             const vector<SceneChunk> &chunks,
+                             const vector<GeometryBlock> &blocks,
+                             vector<GeometryBlockAddrs> block_addrs,
+                             const vector<MeshInfo> &meshes,
+                             const vector<ObjectInfo> &objects,
+                             VkBuffer block_addr_buffer,
+                             VkDeviceSize block_addr_offset)
+    : dev(d),
+      alloc(a),
+      scene_file_(filesystem::path(scene_path), ios::binary),
+      staging_offset_(staging_offset),
+      blocks_(blocks),
+      block_addrs_(move(block_addrs)),
+      meshes_(meshes),
+      objects_(objects),
+      block_addr_buffer_(block_addr_buffer),
+      block_addr_offset_(block_addr_offset),
+      first_object_(chunks.front().objectOffset),
+      chunks_(),
+      object_blases_(objects.size() - first_object_, BLAS {}),
+      retired_(),
+      epoch_(1),
+      env_lock_(),
+      envs_(),
+      load_lock_(),
+      load_cv_(),
+      load_requests_(),
+      completed_loads_(),
+      exit_(false),
+      load_thread_()
+{
+    if (!scene_file_.is_open()) {
+        cerr << "Failed to reopen " << scene_path << " for streaming"
+             << endl;
+        fatalExit();
+    }
+
+    chunks_.reserve(chunks.size());
+    for (const SceneChunk &chunk : chunks) {
+        uint32_t end_block = chunk.blockOffset + chunk.numBlocks;
+
+        // Chunks never own the final block
+        uint64_t num_geometry_bytes = blocks_[end_block].vertexOffset -
+            blocks_[chunk.blockOffset].vertexOffset;
+
+        chunks_.push_back({
+            chunk,
+            num_geometry_bytes,
+            0,
+            ChunkState::Evicted,
+            0,
+            {},
+            {},
+        });
+    }
+
+    load_thread_ = thread([this]() {
+        loadLoop();
+    });
+}
+
+ChunkStreamer::~ChunkStreamer()
+{
+    {
+        lock_guard<mutex> guard(load_lock_);
+        exit_ = true;
+    }
+    load_cv_.notify_one();
+    load_thread_.join();
+
+    // Environments may outlive their scene
+    lock_guard<mutex> guard(env_lock_);
+    for (VulkanEnvironment *env : envs_) {
+        env->chunkStreamer = nullptr;
+    }
+}
+
+void ChunkStreamer::addEnvironment(VulkanEnvironment *env)
+{
+    lock_guard<mutex> guard(env_lock_);
+    envs_.push_back(env);
+}
+
+void ChunkStreamer::removeEnvironment(VulkanEnvironment *env)
+{
+    lock_guard<mutex> guard(env_lock_);
+    envs_.erase(find(envs_.begin(), envs_.end(), env));
+}
+
+// Only this thread touches scene_file_
+void ChunkStreamer::loadLoop()
+{
+    while (true) {
+        uint32_t chunk_idx;
+        {
+            unique_lock<mutex> guard(load_lock_);
+            load_cv_.wait(guard, [this]() {
+                return exit_ || !load_requests_.empty();
+            });
+
+            if (exit_) {
+                return;
+            }
+
+            chunk_idx = load_requests_.front();
+            load_requests_.erase(load_requests_.begin());
+        }
+
+        const SceneChunk &info = chunks_[chunk_idx].info;
+
+        vector<HostBuffer> staging;
+        staging.reserve(info.numBlocks);
+        for (uint32_t block_idx = info.blockOffset;
+             block_idx < info.blockOffset + info.numBlocks; block_idx++) {
+            const GeometryBlock &block = blocks_[block_idx];
+            uint64_t num_block_bytes =
+                blocks_[block_idx + 1].vertexOffset - block.vertexOffset;
+
+            HostBuffer block_staging =
+                alloc.makeStagingBuffer(num_block_bytes);
+            scene_file_.seekg(staging_offset_ + block.vertexOffset);
+            scene_file_.read((char *)block_staging.ptr, num_block_bytes);
+            block_staging.flush(dev);
+
+            staging.emplace_back(move(block_staging));
+        }
+
+        lock_guard<mutex> guard(load_lock_);
+        completed_loads_.push_back({
+            chunk_idx,
+            move(staging),
+        });
+    }
+}
+
+void ChunkStreamer::uploadChunk(StreamedChunk &chunk,
+                                vector<HostBuffer> &&staging,
+                                VkCommandBuffer cmd,
+                                RetiredResources &frame_temporaries)
+{
+    const SceneChunk &info = chunk.info;
+
+    for (uint32_t i = 0; i < info.numBlocks; i++) {
+        uint32_t block_idx = info.blockOffset + i;
+        const GeometryBlock &block = blocks_[block_idx];
+        uint64_t num_block_bytes =
+            blocks_[block_idx + 1].vertexOffset - block.vertexOffset;
+
+        optional<LocalBuffer> buffer_opt =
+            alloc.makeLocalBuffer(num_block_bytes, true);
+
+        if (!buffer_opt.has_value()) {
+            cerr << "Out of memory, failed to allocate chunk geometry"
+                 << endl;
+            fatalExit();
+        }
+
+        VkBufferCopy copy_settings {};
+        copy_settings.size = num_block_bytes;
+        dev.dt.cmdCopyBuffer(cmd, staging[i].buffer, buffer_opt->buffer,
+                             1, &copy_settings);
+
+        VkBufferDeviceAddressInfo addr_info;
+        addr_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        addr_info.pNext = nullptr;
+        addr_info.buffer = buffer_opt->buffer;
+        VkDeviceAddress block_addr =
+            dev.dt.getBufferDeviceAddress(dev.hdl, &addr_info);
+
+        block_addrs_[block_idx] = {
+            block_addr,
+            block_addr + (block.indexOffset - block.vertexOffset),
+        };
+
+        chunk.geometry.emplace_back(move(*buffer_opt));
+        frame_temporaries.staging.emplace_back(move(staging[i]));
+    }
+
+    // Chunks can have more blocks than cmdUpdateBuffer's 64KB allows
+    uint64_t num_addr_bytes = sizeof(GeometryBlockAddrs) * info.numBlocks;
+    HostBuffer addr_staging = alloc.makeStagingBuffer(num_addr_bytes);
+    memcpy(addr_staging.ptr, &block_addrs_[info.blockOffset],
+           num_addr_bytes);
+    addr_staging.flush(dev);
+
+    VkBufferCopy addr_copy {};
+    addr_copy.dstOffset = block_addr_offset_ +
+        sizeof(GeometryBlockAddrs) * info.blockOffset;
+    addr_copy.size = num_addr_bytes;
+    dev.dt.cmdCopyBuffer(cmd, addr_staging.buffer, block_addr_buffer_,
+                         1, &addr_copy);
+
+    frame_temporaries.staging.emplace_back(move(addr_staging));
+}
+
+void ChunkStreamer::update(uint64_t budget,
+                           VkCommandBuffer cmd,
+                           uint64_t render_idx,
+                           uint64_t oldest_render_idx)
+{
+    retired_.erase(remove_if(retired_.begin(), retired_.end(),
+        [&](const RetiredResources &retired) {
+            return retired.renderIdx <= oldest_render_idx;
+        }), retired_.end());
+
+    vector<glm::vec3> positions;
+    {
+        lock_guard<mutex> guard(env_lock_);
+        for (const VulkanEnvironment *env : envs_) {
+            positions.insert(positions.end(), env->viewPositions.begin(),
+                             env->viewPositions.end());
+        }
+    }
+
+    uint32_t num_chunks = chunks_.size();
+
+    // Nearest chunks first, resident set is the longest prefix that fits
+    vector<pair<float, uint32_t>> chunk_order;
+    chunk_order.reserve(num_chunks);
+    for (uint32_t chunk_idx = 0; chunk_idx < num_chunks; chunk_idx++) {
+        const AABB &bounds = chunks_[chunk_idx].info.bounds;
+
+        float min_dist = INFINITY;
+        for (const glm::vec3 &pos : positions) {
+            glm::vec3 closest = glm::max(
+                glm::max(bounds.pMin - pos, pos - bounds.pMax), 0.f);
+            min_dist = min(min_dist, glm::length(closest));
+        }
+
+        chunk_order.emplace_back(min_dist, chunk_idx);
+    }
+    sort(chunk_order.begin(), chunk_order.end());
+
+    vector<uint8_t> keep(num_chunks, 0);
+    uint64_t resident_bytes = 0;
+    for (auto [dist, chunk_idx] : chunk_order) {
+        const StreamedChunk &chunk = chunks_[chunk_idx];
+        uint64_t chunk_bytes = chunk.numGeometryBytes + chunk.numBLASBytes;
+
+        if (budget > 0 && resident_bytes + chunk_bytes > budget) {
+            break;
+        }
+
+        keep[chunk_idx] = 1;
+        resident_bytes += chunk_bytes;
+    }
+
+    // Batches submitted before this one may still reference evicted chunks
+    RetiredResources evicted {
+        render_idx,
+        {},
+        {},
+        {},
+    };
+
+    // Staging and scratch memory is used by this submission
+    RetiredResources frame_temporaries {
+        render_idx + 1,
+        {},
+        {},
+        {},
+    };
+
+    vector<uint32_t> loaded_chunks;
+    for (uint32_t chunk_idx = 0; chunk_idx < num_chunks; chunk_idx++) {
+        StreamedChunk &chunk = chunks_[chunk_idx];
+        bool resident = chunk.state == ChunkState::Resident;
+
+        if ((resident || chunk.state == ChunkState::Uploaded) &&
+            !keep[chunk_idx]) {
+            for (LocalBuffer &buffer : chunk.geometry) {
+                evicted.buffers.emplace_back(move(buffer));
+            }
+            chunk.geometry.clear();
+
+            evicted.blases.emplace_back(move(*chunk.blases));
+            chunk.blases.reset();
+
+            for (uint32_t i = 0; i < chunk.info.numBlocks; i++) {
+                block_addrs_[chunk.info.blockOffset + i] = {0, 0};
+            }
+
+            if (resident) {
+                for (uint32_t i = 0; i < chunk.info.numObjects; i++) {
+                    object_blases_[chunk.info.objectOffset - first_object_ +
+                                   i] = BLAS {};
+                }
+                epoch_++;
+            }
+
+            chunk.state = ChunkState::Evicted;
+            chunk.renderIdx = render_idx;
+        } else if (chunk.state == ChunkState::Uploaded &&
+                   chunk.renderIdx < oldest_render_idx) {
+            // The uploading submission has finished, so batches on any
+            // queue can now build TLASes over the chunk
+            for (uint32_t i = 0; i < chunk.info.numObjects; i++) {
+                object_blases_[chunk.info.objectOffset - first_object_ + i] =
+                    chunk.blases->accelStructs[i];
+            }
+
+            chunk.state = ChunkState::Resident;
+            epoch_++;
+        }
+    }
+
+    if (!evicted.blases.empty()) {
+        retired_.emplace_back(move(evicted));
+    }
+
+    vector<CompletedLoad> completed;
+    {
+        lock_guard<mutex> guard(load_lock_);
+        completed = move(completed_loads_);
+        completed_loads_.clear();
+    }
+
+    // Reads of chunks that fell out of the resident set in the meantime
+    // are dropped. The block address table entries of an evicted chunk
+    // can't be rewritten while batches submitted before the eviction may
+    // still read them, so those uploads wait.
+    vector<CompletedLoad> deferred;
+    for (CompletedLoad &load : completed) {
+        StreamedChunk &chunk = chunks_[load.chunkIdx];
+
+        if (!keep[load.chunkIdx]) {
+            chunk.state = ChunkState::Evicted;
+        } else if (chunk.renderIdx > oldest_render_idx) {
+            deferred.emplace_back(move(load));
+        } else {
+            uploadChunk(chunk, move(load.staging), cmd, frame_temporaries);
+            loaded_chunks.push_back(load.chunkIdx);
+            chunk.state = ChunkState::Uploaded;
+            chunk.renderIdx = render_idx;
+        }
+    }
+
+    // Newly wanted chunks become resident in a later update, once read
+    {
+        lock_guard<mutex> guard(load_lock_);
+        for (CompletedLoad &load : deferred) {
+            completed_loads_.emplace_back(move(load));
+        }
+
+        for (auto [dist, chunk_idx] : chunk_order) {
+            StreamedChunk &chunk = chunks_[chunk_idx];
+            if (keep[chunk_idx] && chunk.state == ChunkState::Evicted) {
+                chunk.state = ChunkState::Loading;
+                load_requests_.push_back(chunk_idx);
+            }
+        }
+    }
+    load_cv_.notify_one();
+
+    if (loaded_chunks.empty()) {
+        return;
+    }
+
+    VkMemoryBarrier upload_barrier;
+    upload_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    upload_barrier.pNext = nullptr;
+    upload_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    upload_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    dev.dt.cmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR |
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &upload_barrier, 0, nullptr, 0, nullptr);
+
+    for (uint32_t chunk_idx : loaded_chunks) {
+        StreamedChunk &chunk = chunks_[chunk_idx];
+        const SceneChunk &info = chunk.info;
+
+        vector<ObjectInfo> chunk_objects(
+            objects_.begin() + info.objectOffset,
+            objects_.begin() + info.objectOffset + info.numObjects);
+
+        auto blas_result = makeBLASes(dev, alloc, meshes_, chunk_objects,
+                                      blocks_, block_addrs_, cmd);
+
+        if (!blas_result.has_value()) {
+            cerr << "OOM while streaming in chunk acceleration structures"
+                 << endl;
+            fatalExit();
+        }
+
+        chunk.numBLASBytes = blas_result->totalBLASBytes;
+        chunk.blases.emplace(move(blas_result->blases));
+        frame_temporaries.buffers.emplace_back(move(*blas_result->scratch));
+    }
+
+    retired_.emplace_back(move(frame_temporaries));
+}
+
 SharedSceneState::SharedSceneState(const DeviceState &dev,
                                    VkDescriptorPool scene_pool,
                                    VkDescriptorSetLayout scene_layout,
@@ -1532,6 +2197,46 @@ SceneID::~SceneID()
     shared_->freeSceneIDs.push_back(id_);
 }
 
+// Object space bounds of every object, read back from the staged geometry
+static vector<AABB> computeObjectBounds(const vector<MeshInfo> &meshes,
+                                        const vector<ObjectInfo> &objects,
+                                        const vector<GeometryBlock> &blocks,
+                                        const vector<HostBuffer> &staging)
+{
+    vector<AABB> bounds;
+    bounds.reserve(objects.size());
+
+    for (const ObjectInfo &obj : objects) {
+        AABB obj_bounds {
+            glm::vec3(INFINITY),
+            glm::vec3(-INFINITY),
+        };
+
+        for (uint32_t mesh_idx = obj.meshIndex;
+             mesh_idx < obj.meshIndex + obj.numMeshes; mesh_idx++) {
+            const MeshInfo &mesh = meshes[mesh_idx];
+            const GeometryBlock &block = blocks[mesh.blockIndex];
+            const char *block_data =
+                (const char *)staging[mesh.blockIndex].ptr;
+
+            const PackedVertex *vertices = (const PackedVertex *)block_data;
+            const uint32_t *indices = (const uint32_t *)(block_data +
+                block.indexOffset - block.vertexOffset) + mesh.indexOffset;
+
+            uint64_t num_indices = uint64_t(mesh.numTriangles) * 3;
+            for (uint64_t i = 0; i < num_indices; i++) {
+                const glm::vec3 &pos = vertices[indices[i]].position;
+                obj_bounds.pMin = glm::min(obj_bounds.pMin, pos);
+                obj_bounds.pMax = glm::max(obj_bounds.pMax, pos);
+            }
+        }
+
+        bounds.push_back(obj_bounds);
+    }
+
+    return bounds;
+}
+
 shared_ptr<Scene> VulkanLoader::loadScene(SceneLoadData &&load_info)
 {
     TextureData texture_store(dev, alloc);
@@ -1551,28 +2256,125 @@ shared_ptr<Scene> VulkanLoader::loadScene(SceneLoadData &&load_info)
         texture_views = move(staged_textures->textureViews);
     }
 
-    // Copy all geometry into single buffer
-    optional<LocalBuffer> data_opt =
-        alloc.makeLocalBuffer(load_info.hdr.totalBytes, true);
+    // Each geometry block gets its own buffer, so large scenes aren't
+    // limited by the maximum allocation size. The remaining scene data
+    // (meshes, materials, etc) shares the final block's buffer.
+    const vector<GeometryBlock> &geometry_blocks = load_info.geometryBlocks;
+    uint32_t num_blocks = geometry_blocks.size();
 
-    if (!data_opt.has_value()) {
-        cerr << "Out of memory, failed to allocate geometry storage" << endl;
-        fatalExit();
+    auto blockEnd = [&](uint32_t block_idx) {
+        return block_idx == num_blocks - 1 ? load_info.hdr.totalBytes :
+            geometry_blocks[block_idx + 1].vertexOffset;
+    };
+
+    // Chunks are the final objects and own every block but the last, they
+    // are left to the ChunkStreamer
+    const vector<SceneChunk> &chunks = load_info.chunks;
+    uint32_t first_chunk_object = chunks.empty() ?
+        load_info.objectInfo.size() : chunks.front().objectOffset;
+    uint32_t first_chunk_block = chunks.empty() ?
+        num_blocks : chunks.front().blockOffset;
+
+    auto isChunkBlock = [&](uint32_t block_idx) {
+        return block_idx >= first_chunk_block && block_idx < num_blocks - 1;
+    };
+
+    vector<LocalBuffer> geometry_buffers;
+    vector<HostBuffer> geometry_staging;
+    vector<GeometryBlockAddrs> block_addrs;
+    vector<uint32_t> resident_blocks;
+    geometry_buffers.reserve(num_blocks);
+    geometry_staging.reserve(num_blocks);
+    block_addrs.reserve(num_blocks);
+    resident_blocks.reserve(num_blocks);
+
+    for (uint32_t block_idx = 0; block_idx < num_blocks; block_idx++) {
+        const GeometryBlock &block = geometry_blocks[block_idx];
+        uint64_t num_block_bytes = blockEnd(block_idx) - block.vertexOffset;
+
+        if (isChunkBlock(block_idx)) {
+            if (holds_alternative<ifstream>(load_info.data)) {
+                get_if<ifstream>(&load_info.data)->seekg(num_block_bytes,
+                                                          ios::cur);
+            }
+
+            block_addrs.push_back({0, 0});
+            continue;
+        }
+
+        resident_blocks.push_back(block_idx);
+
+        optional<LocalBuffer> buffer_opt =
+            alloc.makeLocalBuffer(num_block_bytes, true);
+
+        if (!buffer_opt.has_value()) {
+            cerr << "Out of memory, failed to allocate geometry storage"
+                 << endl;
+            fatalExit();
+        }
+
+        geometry_buffers.emplace_back(move(*buffer_opt));
+
+        HostBuffer staging = alloc.makeStagingBuffer(num_block_bytes);
+
+        // Blocks tile the staged data in order, so the file can be
+        // read sequentially
+        if (holds_alternative<ifstream>(load_info.data)) {
+            ifstream &file = *get_if<ifstream>(&load_info.data);
+            file.read((char *)staging.ptr, num_block_bytes);
+        } else {
+            char *data_src = get_if<vector<char>>(&load_info.data)->data();
+            memcpy(staging.ptr, data_src + block.vertexOffset,
+                   num_block_bytes);
+        }
+
+        geometry_staging.emplace_back(move(staging));
+
+        VkBufferDeviceAddressInfo addr_info;
+        addr_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        addr_info.pNext = nullptr;
+        addr_info.buffer = geometry_buffers.back().buffer;
+        VkDeviceAddress block_addr =
+            dev.dt.getBufferDeviceAddress(dev.hdl, &addr_info);
+
+        block_addrs.push_back({
+            block_addr,
+            block_addr + (block.indexOffset - block.vertexOffset),
+        });
     }
 
-    LocalBuffer data = move(data_opt.value());
+    // Blocks before the chunks keep their index in geometry_staging
+    vector<ObjectInfo> resident_objects(load_info.objectInfo.begin(),
+        load_info.objectInfo.begin() + first_chunk_object);
 
-    HostBuffer data_staging =
-        alloc.makeStagingBuffer(load_info.hdr.totalBytes);
+    vector<AABB> object_bounds = computeObjectBounds(load_info.meshInfo,
+        resident_objects, geometry_blocks, geometry_staging);
 
-    if (holds_alternative<ifstream>(load_info.data)) {
-        ifstream &file = *get_if<ifstream>(&load_info.data);
-        file.read((char *)data_staging.ptr, load_info.hdr.totalBytes);
-    } else {
-        char *data_src = get_if<vector<char>>(&load_info.data)->data();
-        memcpy(data_staging.ptr, data_src, load_info.hdr.totalBytes);
+    // Chunk geometry is in world space
+    for (const SceneChunk &chunk : chunks) {
+        for (uint32_t i = 0; i < chunk.numObjects; i++) {
+            object_bounds.push_back(chunk.bounds);
+        }
     }
 
+    const GeometryBlock &last_block = geometry_blocks.back();
+    auto metadataOffset = [&](uint64_t offset) {
+        return offset - last_block.vertexOffset;
+    };
+    auto metadataAddr = [&](uint64_t offset) {
+        return block_addrs.back().vertAddr + metadataOffset(offset);
+    };
+
+    memcpy((char *)geometry_staging.back().ptr +
+               metadataOffset(load_info.hdr.blockAddrOffset),
+           block_addrs.data(), sizeof(GeometryBlockAddrs) * num_blocks);
+
+    // Staged mesh infos lack the load time object indices
+    memcpy((char *)geometry_staging.back().ptr +
+               metadataOffset(load_info.hdr.meshOffset),
+           load_info.meshInfo.data(),
+           sizeof(MeshInfo) * load_info.meshInfo.size());
+
     // Reset command buffers
     REQ_VK(dev.dt.resetCommandPool(dev.hdl, transfer_cmd_pool_, 0));
     REQ_VK(dev.dt.resetCommandPool(dev.hdl, render_cmd_pool_, 0));
@@ -1582,11 +2384,19 @@ shared_ptr<Scene> VulkanLoader::loadScene(SceneLoadData &&load_info)
     begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     REQ_VK(dev.dt.beginCommandBuffer(transfer_cmd_, &begin_info));
 
-    // Copy vertex/index buffer onto GPU
-    VkBufferCopy copy_settings {};
-    copy_settings.size = load_info.hdr.totalBytes;
-    dev.dt.cmdCopyBuffer(transfer_cmd_, data_staging.buffer, data.buffer,
-                         1, &copy_settings);
+    // Copy vertex/index buffers onto GPU
+    uint32_t num_resident_blocks = resident_blocks.size();
+    for (uint32_t i = 0; i < num_resident_blocks; i++) {
+        uint32_t block_idx = resident_blocks[i];
+
+        VkBufferCopy copy_settings {};
+        copy_settings.size =
+            blockEnd(block_idx) - geometry_blocks[block_idx].vertexOffset;
+        dev.dt.cmdCopyBuffer(transfer_cmd_,
+                             geometry_staging[i].buffer,
+                             geometry_buffers[i].buffer,
+                             1, &copy_settings);
+    }
 
     // Set initial texture layouts
     DynArray<VkImageMemoryBarrier> texture_barriers(num_textures);
@@ -1673,22 +2483,26 @@ shared_ptr<Scene> VulkanLoader::loadScene(SceneLoadData &&load_info)
     }
 
     // Transfer queue relinquish geometry
-    VkBufferMemoryBarrier geometry_barrier;
-    geometry_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-    geometry_barrier.pNext = nullptr;
-    geometry_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    geometry_barrier.dstAccessMask = 0;
-    geometry_barrier.srcQueueFamilyIndex = dev.transferQF;
-    geometry_barrier.dstQueueFamilyIndex = render_qf_;
-
-    geometry_barrier.buffer = data.buffer;
-    geometry_barrier.offset = 0;
-    geometry_barrier.size = load_info.hdr.totalBytes;
+    DynArray<VkBufferMemoryBarrier> geometry_barriers(num_resident_blocks);
+    for (uint32_t i = 0; i < num_resident_blocks; i++) {
+        VkBufferMemoryBarrier &geometry_barrier = geometry_barriers[i];
+        geometry_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        geometry_barrier.pNext = nullptr;
+        geometry_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        geometry_barrier.dstAccessMask = 0;
+        geometry_barrier.srcQueueFamilyIndex = dev.transferQF;
+        geometry_barrier.dstQueueFamilyIndex = render_qf_;
+
+        geometry_barrier.buffer = geometry_buffers[i].buffer;
+        geometry_barrier.offset = 0;
+        geometry_barrier.size = VK_WHOLE_SIZE;
+    }
 
     // Geometry & texture barrier execute.
     dev.dt.cmdPipelineBarrier(
         transfer_cmd_, VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &geometry_barrier,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr,
+        geometry_barriers.size(), geometry_barriers.data(),
         texture_barriers.size(), texture_barriers.data());
 
     REQ_VK(dev.dt.endCommandBuffer(transfer_cmd_));
@@ -1711,16 +2525,19 @@ shared_ptr<Scene> VulkanLoader::loadScene(SceneLoadData &&load_info)
     // Finish moving geometry onto render queue family
     // geometry and textures need separate barriers due to different
     // dependent stages
-    geometry_barrier.srcAccessMask = 0;
-    geometry_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    for (VkBufferMemoryBarrier &geometry_barrier : geometry_barriers) {
+        geometry_barrier.srcAccessMask = 0;
+        geometry_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    }
 
     VkPipelineStageFlags dst_geo_render_stage =
         VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR |
         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 
     dev.dt.cmdPipelineBarrier(render_cmd_, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                              dst_geo_render_stage, 0, 0, nullptr, 1,
-                              &geometry_barrier, 0, nullptr);
+                              dst_geo_render_stage, 0, 0, nullptr,
+                              geometry_barriers.size(),
+                              geometry_barriers.data(), 0, nullptr);
 
     if (num_textures > 0) {
         for (VkImageMemoryBarrier &barrier : texture_barriers) {
@@ -1739,23 +2556,15 @@ shared_ptr<Scene> VulkanLoader::loadScene(SceneLoadData &&load_info)
             texture_barriers.size(), texture_barriers.data());
     }
 
-    VkBufferDeviceAddressInfo addr_info;
-    addr_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-    addr_info.pNext = nullptr;
-    addr_info.buffer = data.buffer;
-    VkDeviceAddress geometry_addr =
-        dev.dt.getBufferDeviceAddress(dev.hdl, &addr_info);
-
     string blas_path =
         filesystem::path(load_info.scenePath).replace_extension("blas_cache");
 
     auto blas_result = getBLASes(dev, alloc,
                                  blas_path,
                                  load_info.meshInfo,
-                                 load_info.objectInfo,
-                                 load_info.hdr.numVertices,
-                                 geometry_addr,
-                                 geometry_addr + load_info.hdr.indexOffset,
+                                 resident_objects,
+                                 geometry_blocks,
+                                 block_addrs,
                                  render_cmd_);
 
     if (!blas_result.has_value()) {
@@ -1798,6 +2607,43 @@ shared_ptr<Scene> VulkanLoader::loadScene(SceneLoadData &&load_info)
                     serialized_query_pool_, max_queries_);
     }
 
+    // Shared by all environments until they modify their instances
+    TLAS default_tlas {};
+    default_tlas.reserveInstances(alloc,
+        load_info.envInit.defaultInstances.size());
+    default_tlas.writeInstances(load_info.envInit.defaultInstances,
+                                load_info.envInit.defaultTransforms,
+                                load_info.envInit.defaultInstanceFlags,
+                                load_info.objectInfo, blases);
+
+    {
+        VkCommandBufferBeginInfo begin_info {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+        REQ_VK(dev.dt.resetCommandPool(dev.hdl, render_cmd_pool_, 0));
+        REQ_VK(dev.dt.beginCommandBuffer(render_cmd_, &begin_info));
+
+        default_tlas.build(dev, alloc, render_cmd_);
+
+        REQ_VK(dev.dt.endCommandBuffer(render_cmd_));
+
+        VkSubmitInfo tlas_submit {};
+        tlas_submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        tlas_submit.commandBufferCount = 1;
+        tlas_submit.pCommandBuffers = &render_cmd_;
+
+        render_queue_.submit(dev, 1, &tlas_submit, fence_);
+
+        waitForFenceInfinitely(dev, fence_);
+        resetFence(dev, fence_);
+    }
+
+    // Instance data is never rewritten, and the shaders only read the
+    // instance indices if some instance was dropped
+    if (!default_tlas.compacted) {
+        default_tlas.buildStorage.reset();
+    }
+
     // Set Layout
     // 0: Scene addresses uniform
     // 1: textures
@@ -1856,15 +2702,15 @@ shared_ptr<Scene> VulkanLoader::loadScene(SceneLoadData &&load_info)
         // removed
         scene_id = 0;
 
-        vert_info.buffer = data.buffer;
+        vert_info.buffer = geometry_buffers.front().buffer;
         vert_info.offset = 0;
         vert_info.range =
-            load_info.hdr.numVertices * sizeof(PackedVertex);
+            geometry_blocks.front().numVertices * sizeof(PackedVertex);
 
         desc_updates.storage(scene_set_, &vert_info, 0);
 
-        mat_info.buffer = data.buffer;
-        mat_info.offset = load_info.hdr.materialOffset;
+        mat_info.buffer = geometry_buffers.back().buffer;
+        mat_info.offset = metadataOffset(load_info.hdr.materialOffset);
         mat_info.range = load_info.hdr.numMaterials * sizeof(MaterialParams);
 
         desc_updates.storage(scene_set_, &mat_info, 2);
@@ -1886,17 +2732,19 @@ shared_ptr<Scene> VulkanLoader::loadScene(SceneLoadData &&load_info)
     if (shared_scene_state_) {
         GPUSceneInfo &gpu_scene_info = 
             ((GPUSceneInfo *)shared_scene_state_->addrData.ptr)[scene_id];
-        gpu_scene_info.vertAddr = geometry_addr;
-        gpu_scene_info.idxAddr = geometry_addr + load_info.hdr.indexOffset;
-        gpu_scene_info.matAddr = geometry_addr + load_info.hdr.materialOffset;
-        gpu_scene_info.meshAddr = geometry_addr + load_info.hdr.meshOffset;
+        gpu_scene_info.vertAddr = block_addrs.front().vertAddr;
+        gpu_scene_info.idxAddr = block_addrs.front().idxAddr;
+        gpu_scene_info.matAddr = metadataAddr(load_info.hdr.materialOffset);
+        gpu_scene_info.meshAddr = metadataAddr(load_info.hdr.meshOffset);
+        gpu_scene_info.blockAddr =
+            metadataAddr(load_info.hdr.blockAddrOffset);
         shared_scene_state_->addrData.flush(dev);
         shared_scene_state_->lock.unlock();
     }
 
     uint32_t num_meshes = load_info.meshInfo.size();
 
-    return make_shared<VulkanScene>(VulkanScene {
+    auto scene = make_shared<VulkanScene>(VulkanScene {
         {
             move(load_info.meshInfo),
             move(load_info.objectInfo),
@@ -1904,12 +2752,26 @@ shared_ptr<Scene> VulkanLoader::loadScene(SceneLoadData &&load_info)
             load_info.hdr.numMaterials,
         },
         move(texture_store),
-        move(data),
-        load_info.hdr.indexOffset,
+        move(geometry_buffers),
+        geometry_blocks.front().indexOffset,
         num_meshes,
         move(scene_id_tracker),
         move(blases),
+        DefaultTLAS(dev, move(default_tlas)),
+        move(object_bounds),
+        nullptr,
     });
+
+    // Every chunk starts out non resident
+    if (chunks.size() > 0) {
+        scene->chunkStreamer = make_unique<ChunkStreamer>(dev, alloc,
+            load_info.scenePath, load_info.stagingOffset, chunks,
+            geometry_blocks, move(block_addrs), scene->meshInfo,
+            scene->objectInfo, scene->geometryBuffers.back().buffer,
+            metadataOffset(load_info.hdr.blockAddrOffset));
+    }
+
+    return scene;
 }
 
 shared_ptr<EnvironmentMapGroup> VulkanLoader::loadEnvironmentMaps(
@@ -1,15 +1,19 @@
 #pragma once
 
 #include <rlpbr/config.hpp>
+#include <rlpbr_core/rng.hpp>
 #include <rlpbr_core/scene.hpp>
 
+#include <array>
+#include <condition_variable>
 #include <filesystem>
+#include <fstream>
 #include <list>
 #include <mutex>
 #include <optional>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
-#include <random>
 
 #include "descriptors.hpp"
 #include "utils.hpp"
@@ -24,6 +28,9 @@ namespace RLpbr {
 namespace vk {
 
 struct VulkanScene;
+struct VulkanBatch;
+class EnvironmentPool;
+class ChunkStreamer;
 
 struct BLAS {
     VkAccelerationStructureKHR hdl;
@@ -50,23 +57,61 @@ struct TLAS {
     VkAccelerationStructureKHR hdl;
     std::optional<HostBuffer> buildStorage;
     uint32_t numBuildInstances;
+    uint32_t numInstances;
 
     std::optional<LocalBuffer> tlasStorage;
     VkDeviceAddress tlasStorageDevAddr;
     size_t numStorageBytes;
 
+    // hdl and tlasStorage are sized for this many instances, so rebuilds
+    // with fewer instances reuse them
+    uint32_t numAccelInstances;
+
+    // Inactive instances are compacted out of the build. buildStorage
+    // holds the environment instance index of each TLAS instance after
+    // the instances themselves; 0 if no instance was dropped.
+    bool compacted;
+    VkDeviceAddress instanceIndicesDevAddr;
+
+    // Builds are split in three steps so the host side instance setup can
+    // run for many TLASes concurrently: reserveInstances and build must be
+    // called from a single thread, writeInstances touches only this TLAS.
+    void reserveInstances(MemoryAllocator &alloc, uint32_t num_instances);
+
+    // library resolves ObjectInstance::libraryFlag objects. Instances with
+    // a 0 entry in visible_instances are inactive, nullptr keeps every
+    // instance. Objects past the end of blases are chunk
+    // objects, looked up in chunk_blases (ChunkStreamer::getBLASes);
+    // instances of chunks that aren't resident are inactive as well.
+    void writeInstances(
+        const std::vector<ObjectInstance> &instances,
+        const std::vector<InstanceTransform> &instance_transforms,
+        const std::vector<InstanceFlags> &instance_flags,
+        const std::vector<ObjectInfo> &objects,
+        const BLASData &blases,
+        const VulkanScene *library = nullptr,
+        const uint8_t *visible_instances = nullptr,
+        const std::vector<BLAS> *chunk_blases = nullptr);
+
     void build(const DeviceState &dev,
                MemoryAllocator &alloc,
-               const std::vector<ObjectInstance> &instances,
-               const std::vector<InstanceTransform> &instance_transforms,
-               const std::vector<InstanceFlags> &instance_flags,
-               const std::vector<ObjectInfo> &objects,
-               const BLASData &blases,
                VkCommandBuffer build_cmd);
 
     void free(const DeviceState &dev);
 };
 
+// TLAS over a scene's default instances, built once at load time and used
+// by every environment that has not modified its instances
+struct DefaultTLAS {
+    DefaultTLAS(const DeviceState &dev, TLAS &&tlas);
+    DefaultTLAS(const DefaultTLAS &) = delete;
+    DefaultTLAS(DefaultTLAS &&o);
+    ~DefaultTLAS();
+
+    const DeviceState *dev;
+    TLAS tlas;
+};
+
 struct ReservoirGrid {
     AABB bbox;
     VkDeviceMemory storage;
@@ -80,28 +125,120 @@ struct DomainRandomization {
     uint32_t envMapIdx;
 };
 
+DomainRandomization randomizeDomain(CounterRNG &rng,
+                                    uint32_t num_env_maps,
+                                    bool enable_randomization);
+
 struct VulkanEnvironment : public EnvironmentBackend {
     VulkanEnvironment(const DeviceState &dev,
+                      EnvironmentPool &pool,
                       const VulkanScene &scene,
-                      const Camera &cam,
-                      std::mt19937 &rand_gen,
-                      bool should_randomize,
-                      uint32_t num_env_maps);
+                      const Camera &cam);
     VulkanEnvironment(const VulkanEnvironment &) = delete;
     ~VulkanEnvironment();
 
+    // Resets all per environment state, used when recycled from the pool.
+    // The TLAS is kept and simply rebuilt, the pool only hands out
+    // environments no pending render still reads.
+    void init(const VulkanScene &scene, const Camera &cam);
+
     uint32_t addLight(const glm::vec3 &position, const glm::vec3 &color);
 
     void removeLight(uint32_t light_idx);
 
+    // EnvironmentImpl destroy function: returns env to its pool
+    static void release(EnvironmentBackend *env);
+
     std::vector<PackedLight> lights;
 
     const DeviceState &dev;
+    EnvironmentPool &pool;
     TLAS tlas;
 
-    Camera prevCam;
+    // One per view, views added since the last render use their current
+    // camera
+    std::vector<Camera> prevCams;
+
+    // Per instance result of the last culling pass
+    std::vector<uint8_t> visibleInstances;
+
+    // The scene's streamer, if any. Every live environment is registered
+    // with it, and residency follows their view positions as of their last
+    // render (or creation), not just the views of the current batch.
+    ChunkStreamer *chunkStreamer;
+    std::vector<glm::vec3> viewPositions;
+
+    // ChunkStreamer::getEpoch when the TLAS was last written
+    uint64_t chunkEpoch;
 
+    // Renders before this index may still read the TLAS, see
+    // EnvironmentPool::recycle
+    uint64_t releaseRenderIdx;
+
+    // Batch this environment's data was last uploaded into
+    const VulkanBatch *lastUploadBatch;
+
+    // Drawn at render time whenever the frontend environment's
+    // (stream, episode) changes
     DomainRandomization domainRandomization;
+    bool domainRandomized;
+    uint32_t randomizedStream;
+    uint32_t randomizedEpisode;
+};
+
+struct EnvironmentPoolStatistics {
+    uint64_t envHits;
+    uint64_t envMisses;
+    uint64_t tlasHits;
+    uint64_t tlasMisses;
+};
+
+// Recycles environment backends and TLAS resources so environment churn
+// doesn't turn into allocator and driver object creation. Free TLASes are
+// bucketed by power of two instance capacity. Released environments and
+// TLASes are held back until the renders using them have finished.
+class EnvironmentPool {
+public:
+    EnvironmentPool(const DeviceState &dev, MemoryAllocator &alloc);
+    EnvironmentPool(const EnvironmentPool &) = delete;
+    ~EnvironmentPool();
+
+    VulkanEnvironment *acquire(const VulkanScene &scene, const Camera &cam);
+
+    void release(VulkanEnvironment *env);
+
+    // Makes sure tlas can hold num_instances. A TLAS that needs to grow is
+    // swapped for one from the larger bucket, the old one is returned to
+    // its bucket once renders before release_render_idx have finished.
+    void reserveTLAS(TLAS &tlas, uint32_t num_instances,
+                     uint64_t release_render_idx);
+
+    // Makes released environments and TLASes reusable once no render
+    // that may read them is pending. oldest_render_idx is the oldest
+    // render that may still be running.
+    void recycle(uint64_t oldest_render_idx);
+
+    EnvironmentPoolStatistics getStatistics() const;
+
+private:
+    static constexpr uint32_t numTLASBuckets = 32;
+    // Further TLASes are freed rather than kept for reuse
+    static constexpr uint32_t maxFreeTLASesPerBucket = 16;
+
+    struct RetiredTLAS {
+        uint64_t renderIdx;
+        TLAS tlas;
+    };
+
+    const DeviceState &dev;
+    MemoryAllocator &alloc;
+
+    mutable std::mutex lock_;
+    std::vector<VulkanEnvironment *> free_envs_;
+    std::array<std::vector<TLAS>, numTLASBuckets> free_tlases_;
+    std::vector<VulkanEnvironment *> retired_envs_;
+    std::vector<RetiredTLAS> retired_tlases_;
+    EnvironmentPoolStatistics stats_;
 };
 
 struct TextureData {
@@ -165,15 +302,137 @@ private:
     uint32_t id_;
 };
 
+enum class ChunkState {
+    Evicted,
+    // Queued for or being read by the load thread
+    Loading,
+    // Upload and BLAS builds recorded, not yet visible to TLAS builds
+    Uploaded,
+    Resident,
+};
+
+struct StreamedChunk {
+    SceneChunk info;
+    uint64_t numGeometryBytes;
+    // Known once the chunk has been resident
+    uint64_t numBLASBytes;
+    ChunkState state;
+    // Submission that last uploaded or evicted the chunk
+    uint64_t renderIdx;
+
+    std::vector<LocalBuffer> geometry;
+    std::optional<BLASData> blases;
+};
+
+// Keeps the chunks (SceneChunk) of a scene closest to the cameras resident
+// within a device memory budget. Geometry is read back from the scene file
+// on a dedicated load thread, and uploaded with rebuilt BLASes by the first
+// update after the read completes. Batches run on multiple queues, so a
+// chunk only becomes visible to TLAS builds once the submission that
+// uploaded it has finished.
+class ChunkStreamer {
+public:
+    ChunkStreamer(const DeviceState &dev,
+                  MemoryAllocator &alloc,
+                  const std::string &scene_path,
+                  uint64_t staging_offset,
+                  const std::vector<SceneChunk> &chunks,
+                  const std::vector<GeometryBlock> &blocks,
+                  std::vector<GeometryBlockAddrs> block_addrs,
+                  const std::vector<MeshInfo> &meshes,
+                  const std::vector<ObjectInfo> &objects,
+                  VkBuffer block_addr_buffer,
+                  VkDeviceSize block_addr_offset);
+    ChunkStreamer(const ChunkStreamer &) = delete;
+    ~ChunkStreamer();
+
+    // Called as environments of the scene are created and released
+    void addEnvironment(VulkanEnvironment *env);
+    void removeEnvironment(VulkanEnvironment *env);
+
+    // Streams chunks in and out around the registered environments' views,
+    // recording uploads and BLAS builds into cmd. render_idx identifies
+    // the batch submission cmd belongs to, freed resources are only
+    // destroyed once no batch submitted before them can still be running
+    // (oldest_render_idx is the oldest submission that may still be).
+    void update(uint64_t budget,
+                VkCommandBuffer cmd,
+                uint64_t render_idx,
+                uint64_t oldest_render_idx);
+
+    // Indexed from the first chunk object, null for non resident chunks
+    const std::vector<BLAS> &getBLASes() const { return object_blases_; }
+
+    // Changes whenever the resident set does
+    uint64_t getEpoch() const { return epoch_; }
+
+private:
+    struct RetiredResources {
+        uint64_t renderIdx;
+        std::vector<LocalBuffer> buffers;
+        std::vector<HostBuffer> staging;
+        std::vector<BLASData> blases;
+    };
+
+    struct CompletedLoad {
+        uint32_t chunkIdx;
+        std::vector<HostBuffer> staging;
+    };
+
+    void loadLoop();
+    void uploadChunk(StreamedChunk &chunk,
+                     std::vector<HostBuffer> &&staging,
+                     VkCommandBuffer cmd,
+                     RetiredResources &frame_temporaries);
+
+    const DeviceState &dev;
+    MemoryAllocator &alloc;
+
+    std::ifstream scene_file_;
+    uint64_t staging_offset_;
+    std::vector<GeometryBlock> blocks_;
+    std::vector<GeometryBlockAddrs> block_addrs_;
+    const std::vector<MeshInfo> &meshes_;
+    const std::vector<ObjectInfo> &objects_;
+    VkBuffer block_addr_buffer_;
+    VkDeviceSize block_addr_offset_;
+
+    uint32_t first_object_;
+    std::vector<StreamedChunk> chunks_;
+    std::vector<BLAS> object_blases_;
+    std::vector<RetiredResources> retired_;
+    uint64_t epoch_;
+
+    std::mutex env_lock_;
+    std::vector<VulkanEnvironment *> envs_;
+
+    // Nearest chunks are requested first
+    std::mutex load_lock_;
+    std::condition_variable load_cv_;
+    std::vector<uint32_t> load_requests_;
+    std::vector<CompletedLoad> completed_loads_;
+    bool exit_;
+    std::thread load_thread_;
+};
+
 struct VulkanScene : public Scene {
     TextureData textures;
 
-    LocalBuffer data;
+    // One buffer per geometry block, except for chunk blocks which are
+    // owned by chunkStreamer
+    std::vector<LocalBuffer> geometryBuffers;
     VkDeviceSize indexOffset;
     uint32_t numMeshes;
     std::optional<SceneID> sceneID;
 
     BLASData blases;
+    DefaultTLAS defaultTLAS;
+
+    // Object space, for CPU side culling
+    std::vector<AABB> objectBounds;
+
+    // Null unless the scene was preprocessed with chunks
+    std::unique_ptr<ChunkStreamer> chunkStreamer;
 };
 
 class VulkanLoader : public LoaderBackend {
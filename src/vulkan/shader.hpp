@@ -19,6 +19,7 @@ using VertRef = VkDeviceAddress;
 using IdxRef = VkDeviceAddress;
 using MatRef = VkDeviceAddress;
 using MeshRef = VkDeviceAddress;
+using BlockRef = VkDeviceAddress;
 
 #include "shaders/shader_common.h"
 };
@@ -26,8 +27,11 @@ using MeshRef = VkDeviceAddress;
 using Shader::PackedInstance;
 using Shader::PackedCamera;
 using Shader::PackedLight;
+using Shader::PackedView;
 using Shader::PackedEnv;
+using Shader::PackedRenderSettings;
 using Shader::GPUSceneInfo;
+using Shader::GeometryBlockAddrs;
 using Shader::RTPushConstant;
 using Shader::Reservoir;
 using Shader::InputTile;
@@ -10,14 +10,71 @@ struct RayDifferential {
     vec3 dDdY;
 };
 
-void computeCameraRay(in Camera camera, in u32vec3 idx, in vec2 jitter,
+// Rays for the non pinhole projections, camera.up points down the image.
+// Returns false outside the fisheye image circle.
+bool projectCameraRay(in Camera camera, in vec2 screen,
+                      out vec3 ray_origin, out vec3 ray_dir)
+{
+    ray_origin = camera.origin;
+
+    if (camera.type == CameraTypeEquirectangular) {
+        float phi = screen.x * M_PI;
+        float theta = screen.y * M_PI / 2.f;
+
+        ray_dir = cos(theta) *
+            (sin(phi) * camera.right + cos(phi) * camera.view) +
+            sin(theta) * camera.up;
+
+        return true;
+    } else if (camera.type == CameraTypeFisheye) {
+        vec2 circle = vec2(screen.x * camera.resolution.x /
+            camera.resolution.y, screen.y);
+        float radius = length(circle);
+
+        float theta = radius * camera.typeParam;
+        vec2 circle_dir = radius > 0.f ? circle / radius : vec2(0.f);
+
+        ray_dir = cos(theta) * camera.view + sin(theta) *
+            (circle_dir.x * camera.right + circle_dir.y * camera.up);
+
+        return radius <= 1.f;
+    } else {
+        ray_origin += camera.right * camera.rightScale * screen.x +
+            camera.up * camera.upScale * screen.y;
+        ray_dir = camera.view;
+
+        return true;
+    }
+}
+
+bool computeCameraRay(in Camera camera, in u32vec3 idx, in vec2 jitter,
                       out vec3 ray_origin, out vec3 ray_dir,
                       out RayDifferential differential)
 {
     vec2 jittered_raster = vec2(idx.x, idx.y) + jitter;
 
-    vec2 screen = vec2((2.f * jittered_raster.x) / RES_X - 1,
-                       (2.f * jittered_raster.y) / RES_Y - 1);
+    vec2 screen = 2.f * jittered_raster / camera.resolution - 1.f;
+
+    if (camera.type != CameraTypePinhole &&
+        camera.type != CameraTypeCubemapFace) {
+        // Differentials by finite differences over the per sample footprint
+        vec2 footprint = 2.f / camera.resolution * camera.invSqrtSPP;
+
+        bool valid = projectCameraRay(camera, screen, ray_origin, ray_dir);
+
+        vec3 x_origin, x_dir, y_origin, y_dir;
+        projectCameraRay(camera, screen + vec2(footprint.x, 0.f),
+                         x_origin, x_dir);
+        projectCameraRay(camera, screen + vec2(0.f, footprint.y),
+                         y_origin, y_dir);
+
+        differential.dOdX = x_origin - ray_origin;
+        differential.dOdY = y_origin - ray_origin;
+        differential.dDdX = x_dir - ray_dir;
+        differential.dDdY = y_dir - ray_dir;
+
+        return valid;
+    }
 
     vec3 right = camera.right * camera.rightScale;
     vec3 up = camera.up * camera.upScale;
@@ -28,8 +85,8 @@ void computeCameraRay(in Camera camera, in u32vec3 idx, in vec2 jitter,
     float dir_len_sq = dot(ray_dir, ray_dir);
     float inv_dir_len = inversesqrt(dir_len_sq);
 
-    vec3 rhat = right * 2.f / float(RES_X) * INV_SQRT_SPP;
-    vec3 uhat = up * 2.f / float(RES_Y) * INV_SQRT_SPP;
+    vec3 rhat = right * 2.f / camera.resolution.x * camera.invSqrtSPP;
+    vec3 uhat = up * 2.f / camera.resolution.y * camera.invSqrtSPP;
 
     float inv_dir_len_32 = inv_dir_len / dir_len_sq;
 
@@ -41,8 +98,11 @@ void computeCameraRay(in Camera camera, in u32vec3 idx, in vec2 jitter,
         inv_dir_len_32;
 
     ray_dir = ray_dir * inv_dir_len;
+
+    return true;
 }
 
+// Assumes a pinhole projection
 vec2 getScreenSpacePosition(Camera camera, vec3 world_pos)
 {
     vec3 to_pos = world_pos - camera.origin;
@@ -55,10 +115,10 @@ vec2 getScreenSpacePosition(Camera camera, vec3 world_pos)
                 camera_space.y / camera.upScale / camera_space.z);
 }
 
-i32vec2 getPixelCoords(vec2 screen_space)
+i32vec2 getPixelCoords(Camera camera, vec2 screen_space)
 {
     vec2 offset = (screen_space + 1.f) / 2.f;
-    return i32vec2(offset.x * RES_X, offset.y * RES_Y);
+    return i32vec2(offset * camera.resolution);
 }
 
 #endif
@@ -0,0 +1,96 @@
+#ifndef RLPBR_VK_CHANNELS_GLSL_INCLUDED
+#define RLPBR_VK_CHANNELS_GLSL_INCLUDED
+
+// Optional per pixel outputs taken from the primary hit
+
+#ifdef OUTPUT_DEPTH
+
+layout (set = 0, binding = 19, scalar) writeonly buffer Depth {
+#ifdef DEPTH_HALF
+    float16_t depthBuffer[];
+#else
+    float depthBuffer[];
+#endif
+};
+
+#endif
+
+#ifdef OUTPUT_INSTANCE
+
+layout (set = 0, binding = 20, scalar) writeonly buffer InstanceIDs {
+    uint32_t instanceIDBuffer[];
+};
+
+#endif
+
+#ifdef OUTPUT_SEMANTIC
+
+layout (set = 0, binding = 21, scalar) writeonly buffer SemanticIDs {
+    uint32_t semanticIDBuffer[];
+};
+
+#endif
+
+struct PrimaryChannels {
+    float depth;
+    uint32_t instanceID;
+    uint32_t semanticID;
+};
+
+PrimaryChannels missChannels()
+{
+    PrimaryChannels channels;
+    channels.depth = 0.f;
+    channels.instanceID = 0xFFFFFFFF;
+    channels.semanticID = 0xFFFFFFFF;
+
+    return channels;
+}
+
+PrimaryChannels hitChannels(in rayQueryEXT ray_query, in Environment env,
+                            in Camera cam, in vec3 ray_dir)
+{
+    PrimaryChannels channels;
+
+    float hit_t = rayQueryGetIntersectionTEXT(ray_query, true);
+
+    // Wide angle projections report distance rather than view space depth
+    if (cam.type == CameraTypeEquirectangular ||
+        cam.type == CameraTypeFisheye) {
+        channels.depth = hit_t;
+    } else {
+        channels.depth = hit_t * dot(ray_dir, normalize(cam.view));
+    }
+
+    channels.instanceID = getHitInstance(ray_query, env);
+
+#ifdef OUTPUT_SEMANTIC
+    channels.semanticID = getHitObject(ray_query, env);
+#else
+    channels.semanticID = 0xFFFFFFFF;
+#endif
+
+    return channels;
+}
+
+void setChannels(uint32_t linear_idx, in PrimaryChannels channels)
+{
+#ifdef OUTPUT_DEPTH
+#ifdef DEPTH_HALF
+    depthBuffer[nonuniformEXT(linear_idx)] =
+        float16_t(min(channels.depth, 65504.f));
+#else
+    depthBuffer[nonuniformEXT(linear_idx)] = channels.depth;
+#endif
+#endif
+
+#ifdef OUTPUT_INSTANCE
+    instanceIDBuffer[nonuniformEXT(linear_idx)] = channels.instanceID;
+#endif
+
+#ifdef OUTPUT_SEMANTIC
+    semanticIDBuffer[nonuniformEXT(linear_idx)] = channels.semanticID;
+#endif
+}
+
+#endif
@@ -184,9 +184,114 @@ void getHitParams(in rayQueryEXT ray_query, out vec2 barys,
     w2o = rayQueryGetIntersectionWorldToObjectEXT(ray_query, true);
 }
 
-uint32_t getHitInstance(in rayQueryEXT ray_query)
+// Instances of object library objects flag their mesh offset, their
+// geometry, materials and textures live in the library's scene. Strips the
+// flag from mesh_offset.
+uint32_t getHitSceneID(in Environment env, inout uint32_t mesh_offset)
 {
-    return uint32_t(rayQueryGetIntersectionInstanceIdEXT(ray_query, true));
+    if (bool(mesh_offset & MeshOffsetLibraryFlag)) {
+        mesh_offset &= ~MeshOffsetLibraryFlag;
+        return env.librarySceneID;
+    }
+
+    return env.sceneID;
+}
+
+// Alpha test for candidate hits on non opaque geometry. Masked materials
+// are resolved here, blended materials are always committed and handled
+// stochastically at shading time.
+bool candidateAlphaTest(in rayQueryEXT ray_query, in Environment env)
+{
+    uint32_t material_offset = uint32_t(
+        rayQueryGetIntersectionInstanceCustomIndexEXT(ray_query, false));
+    uint32_t geo_idx =
+        uint32_t(rayQueryGetIntersectionGeometryIndexEXT(ray_query, false));
+    uint32_t mesh_offset = uint32_t(
+        rayQueryGetIntersectionInstanceShaderBindingTableRecordOffsetEXT(
+            ray_query, false));
+
+    uint32_t scene_id = getHitSceneID(env, mesh_offset);
+    GPUSceneInfo scene_info = sceneInfos[scene_id];
+
+    uint32_t material_id = unpackMaterialID(
+        env.baseMaterialOffset + material_offset + geo_idx);
+
+    uint32_t mat_flags = fetchSceneMaterialParams(
+        scene_info.matAddr, material_id, 0).w >> 16;
+
+    if (!bool(mat_flags & MaterialFlagsAlphaMasked)) {
+        return true;
+    }
+
+    float alpha_cutoff = 0.5f;
+    if (bool(mat_flags & MaterialFlagsComplex)) {
+        alpha_cutoff = unpackUnorm4x8(fetchSceneMaterialParams(
+            scene_info.matAddr, material_id, 1).y).w;
+    }
+
+    uint32_t tri_idx =
+        uint32_t(rayQueryGetIntersectionPrimitiveIndexEXT(ray_query, false));
+    vec2 barys = rayQueryGetIntersectionBarycentricsEXT(ray_query, false);
+
+    MeshInfo mesh_info =
+        unpackMeshInfo(scene_info.meshAddr, mesh_offset + geo_idx);
+
+    VertRef vert_ref;
+    IdxRef idx_ref;
+    getGeometryBlock(scene_info, mesh_info.blockIndex, vert_ref, idx_ref);
+
+    Triangle hit_tri = fetchTriangle(vert_ref, idx_ref,
+                                     mesh_info.indexOffset + tri_idx * 3);
+
+    vec2 uv = interpolateUV(hit_tri.a.uv, hit_tri.b.uv, hit_tri.c.uv,
+                            barys);
+
+    uint32_t mat_texture_offset = getSceneTextureOffset(scene_id) +
+        material_id * TextureConstantsTexturesPerMaterial;
+
+    TextureDerivatives tex_derivs;
+    tex_derivs.dUVdX = vec2(0.f);
+    tex_derivs.dUVdY = vec2(0.f);
+
+    float alpha = fetchSceneTexture(
+        mat_texture_offset + TextureConstantsBaseOffset, uv, tex_derivs).w;
+
+    return alpha >= alpha_cutoff;
+}
+
+// TLASes with inactive instances compacted out map the TLAS instance back
+// to the environment's instance index
+uint32_t getHitInstance(in rayQueryEXT ray_query, in Environment env)
+{
+    uint32_t tlas_idx =
+        uint32_t(rayQueryGetIntersectionInstanceIdEXT(ray_query, true));
+
+    if (env.instanceIndicesAddr == 0) {
+        return tlas_idx;
+    }
+
+    IdxRef inst_indices = IdxRef(env.instanceIndicesAddr);
+    return inst_indices[nonuniformEXT(tlas_idx)].idx;
+}
+
+uint32_t getHitObject(in rayQueryEXT ray_query, in Environment env)
+{
+    uint32_t mesh_offset = uint32_t(
+        rayQueryGetIntersectionInstanceShaderBindingTableRecordOffsetEXT(
+            ray_query, true));
+
+    uint32_t geo_idx =
+        uint32_t(rayQueryGetIntersectionGeometryIndexEXT(ray_query, true));
+
+    bool from_library = bool(mesh_offset & MeshOffsetLibraryFlag);
+    uint32_t scene_id = getHitSceneID(env, mesh_offset);
+
+    MeshInfo mesh_info = unpackMeshInfo(
+        sceneInfos[scene_id].meshAddr, mesh_offset + geo_idx);
+
+    // Library objects are flagged like ObjectInstance::libraryFlag
+    return from_library ? mesh_info.objectIndex | 0x80000000 :
+        mesh_info.objectIndex;
 }
 
 #if 0
@@ -319,14 +424,18 @@ HitInfo processHit(in rayQueryEXT ray_query, in Environment env,
     getHitParams(ray_query, barys, tri_idx,
                  material_offset, geo_idx, mesh_offset, o2w, w2o);
 
-    GPUSceneInfo scene_info = sceneInfos[env.sceneID];
+    uint32_t scene_id = getHitSceneID(env, mesh_offset);
+    GPUSceneInfo scene_info = sceneInfos[scene_id];
 
     MeshInfo mesh_info =
         unpackMeshInfo(scene_info.meshAddr, mesh_offset + geo_idx);
 
+    VertRef vert_ref;
+    IdxRef idx_ref;
+    getGeometryBlock(scene_info, mesh_info.blockIndex, vert_ref, idx_ref);
+
     uint32_t index_offset = mesh_info.indexOffset + tri_idx * 3;
-    Triangle hit_tri =
-        fetchTriangle(scene_info.vertAddr, scene_info.idxAddr, index_offset);
+    Triangle hit_tri = fetchTriangle(vert_ref, idx_ref, index_offset);
     vec3 world_a = transformPosition(o2w, hit_tri.a.position);
     vec3 world_b = transformPosition(o2w, hit_tri.b.position);
     vec3 world_c = transformPosition(o2w, hit_tri.c.position);
@@ -368,7 +477,7 @@ HitInfo processHit(in rayQueryEXT ray_query, in Environment env,
     MaterialParams material_params =
         unpackMaterialParams(scene_info.matAddr, material_id);
 
-    uint32_t mat_texture_offset = env.baseTextureOffset +
+    uint32_t mat_texture_offset = getSceneTextureOffset(scene_id) +
         material_id * TextureConstantsTexturesPerMaterial;
 
     TangentFrame obj_tangent_frame =
@@ -379,7 +488,8 @@ HitInfo processHit(in rayQueryEXT ray_query, in Environment env,
         tangentFrameToWorld(o2w, w2o, obj_tangent_frame, world_geo_normal);
 
     Material material = processMaterial(material_params,
-        mat_texture_offset, uv, tex_derivs);
+        mat_texture_offset, uv, tex_derivs,
+        mesh_info.alphaMode != AlphaModeOpaque);
 
     return HitInfo(world_position, world_geo_normal,
                    world_tri_area, world_tangent_frame, material);
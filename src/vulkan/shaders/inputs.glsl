@@ -11,7 +11,7 @@ struct PackedMaterial {
 };
 
 struct PackedMeshInfo {
-    u32vec4 data;
+    u32vec4 data[2];
 };
 
 // Unpacked Structs
@@ -22,6 +22,10 @@ struct Camera {
     vec3 right;
     float rightScale;
     float upScale;
+    vec2 resolution;
+    float invSqrtSPP;
+    uint32_t type;
+    float typeParam;
 };
 
 struct Vertex {
@@ -49,7 +53,10 @@ struct Environment {
     uint32_t baseLightOffset;
     uint32_t numLights;
     uint64_t tlasAddr;
+    uint64_t instanceIndicesAddr;
     uint32_t baseTextureOffset;
+    uint32_t maxDepth;
+    uint32_t librarySceneID;
     // Domain Randomization
     vec4 envMapRotation;
     vec3 lightFilter;
@@ -58,6 +65,9 @@ struct Environment {
 
 struct MeshInfo {
     uint32_t indexOffset;
+    uint32_t alphaMode;
+    uint32_t blockIndex;
+    uint32_t objectIndex;
 };
 
 struct TextureDerivatives {
@@ -55,8 +55,12 @@ SphereLight unpackSphereLight(VertRef vert_addr, vec4 data)
         floatBitsToUint(data.z));
 }
 
-TriangleLight unpackTriangleLight(VertRef vert_addr, IdxRef idx_addr, vec4 data)
+TriangleLight unpackTriangleLight(in GPUSceneInfo scene_info, vec4 data)
 {
+    VertRef vert_addr;
+    IdxRef idx_addr;
+    getGeometryBlock(scene_info, floatBitsToUint(data.w), vert_addr, idx_addr);
+
     u32vec3 indices = fetchTriangleIndices(idx_addr,
                                            floatBitsToUint(data.y));
 
@@ -98,8 +102,7 @@ PortalLight unpackPortalLight(VertRef vert_addr, IdxRef idx_addr, vec4 data)
 }
 
 uint32_t unpackLight(in Environment env,
-                     in VertRef vert_addr,
-                     in IdxRef idx_addr,
+                     in GPUSceneInfo scene_info,
                      in uint32_t light_idx,
                      out SphereLight sphere_light,
                      out TriangleLight tri_light,
@@ -112,11 +115,12 @@ uint32_t unpackLight(in Environment env,
     uint32_t light_type = floatBitsToUint(data.x);
 
     if (light_type == LightTypeSphere) {
-        sphere_light = unpackSphereLight(vert_addr, data);
+        sphere_light = unpackSphereLight(scene_info.vertAddr, data);
     } else if (light_type == LightTypeTriangle) {
-        tri_light = unpackTriangleLight(vert_addr, idx_addr, data);
+        tri_light = unpackTriangleLight(scene_info, data);
     } else if (light_type == LightTypePortal) {
-        portal_light = unpackPortalLight(vert_addr, idx_addr, data);
+        portal_light = unpackPortalLight(scene_info.vertAddr,
+                                         scene_info.idxAddr, data);
     } 
 
     return light_type;
@@ -419,9 +423,7 @@ LightInfo sampleLights(inout Sampler rng, in Environment env,
 
             PackedLight packed =
                 lights[nonuniformEXT(env.baseLightOffset + light_idx)];
-            light = unpackTriangleLight(scene_info.vertAddr,
-                                        scene_info.idxAddr,
-                                        packed.data);
+            light = unpackTriangleLight(scene_info, packed.data);
         } else {
             light.matIdx = 0;
             light.verts[0] = vec3(0);
@@ -522,9 +524,8 @@ LightInfo sampleLights(inout Sampler rng, in Environment env,
     GPUSceneInfo scene_info = sceneInfos[env.sceneID];
 
     if (light_idx < env.numLights) {
-        light_type = unpackLight(env, scene_info.vertAddr, scene_info.idxAddr,
-                                 light_idx, sphere_light, tri_light,
-                                 portal_light);
+        light_type = unpackLight(env, scene_info, light_idx, sphere_light,
+                                 tri_light, portal_light);
     } else {
         light_type = LightTypeEnvironment;
     }
@@ -593,9 +594,7 @@ DeltaLightInfo getLight(in Environment env, int idx)
 
     GPUSceneInfo scene_info = sceneInfos[env.sceneID];
 
-    TriangleLight light = unpackTriangleLight(scene_info.vertAddr,
-        scene_info.idxAddr,
-        packed.data);
+    TriangleLight light = unpackTriangleLight(scene_info, packed.data);
 
     vec3 emittance = getMaterialEmittance(scene_info.matAddr,
                                           light.matIdx);
@@ -20,6 +20,7 @@ struct MaterialParams {
     float anisoScale;
     float anisoRotation;
     vec3 baseEmittance;
+    float alphaCutoff;
 };
 
 struct Material {
@@ -85,7 +86,7 @@ MaterialParams unpackMaterialParams(MatRef mat_ref, uint32_t material_id)
 
             params.anisoScale = unpack2.y;
             params.anisoRotation = unpack2.z;
-            // unpack2.w currently unused
+            params.alphaCutoff = unpack2.w;
         }
 
         {
@@ -102,6 +103,7 @@ MaterialParams unpackMaterialParams(MatRef mat_ref, uint32_t material_id)
         params.anisoRotation = 0.0;
         params.attenuationDistance = uintBitsToFloat(0x7f800000);
         params.baseEmittance = vec3(0.0);
+        params.alphaCutoff = 0.5;
     }
 
     return params;
@@ -118,7 +120,8 @@ vec3 getMaterialEmittance(MatRef mat_addr, uint32_t mat_idx)
 
 Material processMaterial(MaterialParams params,
                          uint32_t base_tex_idx,
-                         vec2 uv, TextureDerivatives tex_derivs)
+                         vec2 uv, TextureDerivatives tex_derivs,
+                         bool alpha_tested)
 {
     Material mat;
 
@@ -131,7 +134,17 @@ Material processMaterial(MaterialParams params,
         mat.rho.x *= tex_value.x;
         mat.rho.y *= tex_value.y;
         mat.rho.z *= tex_value.z;
-        mat.transparencyMask *= tex_value.w;
+
+        // Opaque materials ignore texture alpha. Masked hits on alpha
+        // tested geometry already passed the traversal cutoff, which is
+        // kept rather than retested at a different mip level. Meshes
+        // classified opaque skip the traversal test, so apply it here.
+        if (bool(params.flags & MaterialFlagsAlphaBlended)) {
+            mat.transparencyMask *= tex_value.w;
+        } else if (bool(params.flags & MaterialFlagsAlphaMasked) &&
+                   !alpha_tested && tex_value.w < params.alphaCutoff) {
+            mat.transparencyMask = 0.f;
+        }
     }
 
     mat.metallic = params.baseMetallic;
@@ -0,0 +1,31 @@
+#ifndef RLPBR_VK_RENDER_SETTINGS_GLSL_INCLUDED
+#define RLPBR_VK_RENDER_SETTINGS_GLSL_INCLUDED
+
+// Per image settings, indexed by launch slot. RES_X, RES_Y, SPP and
+// MAX_DEPTH are upper bounds across the batch. Packed as:
+// x: width | height << 16, y: spp | max depth << 16,
+// z: first output pixel, w: environment index | view index << 16
+// spp is 0 for inactive environments that only have their outputs cleared
+struct RenderSettings {
+    u32vec2 resolution;
+    uint32_t spp;
+    uint32_t maxDepth;
+    uint32_t pixelOffset;
+    uint32_t envIdx;
+    uint32_t viewIdx;
+};
+
+RenderSettings unpackRenderSettings(u32vec4 packed)
+{
+    RenderSettings settings;
+    settings.resolution = u32vec2(packed.x & 0xFFFF, packed.x >> 16);
+    settings.spp = packed.y & 0xFFFF;
+    settings.maxDepth = packed.y >> 16;
+    settings.pixelOffset = packed.z;
+    settings.envIdx = packed.w & 0xFFFF;
+    settings.viewIdx = packed.w >> 16;
+
+    return settings;
+}
+
+#endif
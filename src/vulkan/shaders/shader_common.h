@@ -3,26 +3,51 @@
 
 #include "comp_definitions.h"
 
+struct GeometryBlockAddrs {
+    VertRef vertAddr;
+    IdxRef idxAddr;
+};
+
+// vertAddr & idxAddr point at geometry block 0, other blocks are looked
+// up through blockAddr
 struct GPUSceneInfo {
     VertRef vertAddr;
     IdxRef idxAddr;
     MatRef matAddr;
     MeshRef meshAddr;
+    BlockRef blockAddr;
+    uint64_t pad;
 };
 
+// posAndTanFOV.w holds the projection scale: tanFOV, the orthographic half
+// height or 1 for cubemap faces
 struct PackedCamera {
     vec4 rotation;
     vec4 posAndTanFOV;
+    vec2 typeAndParam;
 };
 
-struct PackedEnv {
+// Indexed by environment * MAX_VIEWS + view
+struct PackedView {
     PackedCamera cam;
     PackedCamera prevCam;
+};
+
+struct PackedEnv {
     u32vec4 data;
     uint64_t tlasAddr;
     uint64_t reservoirGridAddr;
     vec4 envMapRotation;
     vec4 lightFilterAndEnvIdx;
+    uint32_t librarySceneID;
+    uint32_t pad;
+    // TLAS instance index => environment instance index, 0 if identity
+    uint64_t instanceIndicesAddr;
+};
+
+// Indexed by launch slot, see render_settings.glsl for the packing
+struct PackedRenderSettings {
+    u32vec4 data;
 };
 
 struct RTPushConstant {
@@ -2,11 +2,20 @@
 #define RLPBR_VK_UNPACK_GLSL_INCLUDED
 
 #include "inputs.glsl"
+#include "render_settings.glsl"
 
 // Unpack functions
-Camera unpackCamera(PackedCamera packed)
+uint32_t getSceneTextureOffset(uint32_t scene_id)
 {
-    float aspect = float(RES_X) / float(RES_Y);
+    const uint32_t textures_per_scene = MAX_MATERIALS *
+        TextureConstantsTexturesPerMaterial;
+    return scene_id * textures_per_scene;
+}
+
+Camera unpackCamera(PackedCamera packed, in RenderSettings settings)
+{
+    vec2 resolution = vec2(settings.resolution);
+    float aspect = resolution.x / resolution.y;
 
     vec4 rot = packed.rotation;
     vec3 view = quatRotate(rot, vec3(0.f, 0.f, 1.f));
@@ -17,20 +26,29 @@ Camera unpackCamera(PackedCamera packed)
 
     vec3 origin = pos_fov.xyz;
 
-    float right_scale = aspect * pos_fov.w;
+    uint32_t type = floatBitsToUint(packed.typeAndParam.x);
+
+    // Cubemap faces are square regardless of the image's aspect ratio
+    float right_scale = type == CameraTypeCubemapFace ?
+        pos_fov.w : aspect * pos_fov.w;
     float up_scale = pos_fov.w;
 
-    return Camera(origin, view, up, right, right_scale, up_scale);
+    return Camera(origin, view, up, right, right_scale, up_scale,
+                  resolution, inversesqrt(float(settings.spp)),
+                  type, packed.typeAndParam.y);
 }
 
-void unpackEnv(in uint32_t batch_idx,
+void unpackEnv(in RenderSettings settings,
                out Camera cam,
                out Camera prev_cam,
                out Environment env)
 {
-    PackedEnv packed = envs[nonuniformEXT(batch_idx)];
-    cam = unpackCamera(packed.cam);
-    prev_cam = unpackCamera(packed.prevCam);
+    PackedEnv packed = envs[nonuniformEXT(settings.envIdx)];
+
+    PackedView view =
+        views[nonuniformEXT(settings.envIdx * MAX_VIEWS + settings.viewIdx)];
+    cam = unpackCamera(view.cam, settings);
+    prev_cam = unpackCamera(view.prevCam, settings);
 
     u32vec4 data = packed.data;
 
@@ -41,10 +59,11 @@ void unpackEnv(in uint32_t batch_idx,
     env.baseLightOffset = data.z;
     env.numLights = data.w;
     env.tlasAddr = packed.tlasAddr;
+    env.instanceIndicesAddr = packed.instanceIndicesAddr;
 
-    const uint32_t textures_per_scene = MAX_MATERIALS *
-        TextureConstantsTexturesPerMaterial;
-    env.baseTextureOffset = env.sceneID * textures_per_scene;
+    env.baseTextureOffset = getSceneTextureOffset(env.sceneID);
+    env.maxDepth = settings.maxDepth;
+    env.librarySceneID = packed.librarySceneID;
 
     env.envMapRotation = packed.envMapRotation;
 
@@ -55,12 +74,33 @@ void unpackEnv(in uint32_t batch_idx,
 
 MeshInfo unpackMeshInfo(MeshRef mesh_ref, uint32_t mesh_idx)
 {
+    PackedMeshInfo packed = mesh_ref[nonuniformEXT(mesh_idx)].meshInfo;
+
+    // Block relative index offsets always fit in the low 32 bits
     MeshInfo mesh_info;
-    mesh_info.indexOffset = mesh_ref[nonuniformEXT(mesh_idx)].meshInfo.data.x;
+    mesh_info.indexOffset = packed.data[0].x;
+    mesh_info.alphaMode = packed.data[1].x;
+    mesh_info.blockIndex = packed.data[1].y;
+    mesh_info.objectIndex = packed.data[1].z;
 
     return mesh_info;
 }
 
+void getGeometryBlock(in GPUSceneInfo scene_info, uint32_t block_idx,
+                      out VertRef vert_ref, out IdxRef idx_ref)
+{
+    // Scenes that fit in a single block never touch the address table
+    if (block_idx == 0) {
+        vert_ref = scene_info.vertAddr;
+        idx_ref = scene_info.idxAddr;
+    } else {
+        u64vec2 addrs =
+            scene_info.blockAddr[nonuniformEXT(block_idx)].blockAddrs;
+        vert_ref = VertRef(addrs.x);
+        idx_ref = IdxRef(addrs.y);
+    }
+}
+
 Vertex unpackVertex(VertRef vert_ref, uint32_t idx)
 {
     PackedVertex packed = vert_ref[nonuniformEXT(idx)].vert;